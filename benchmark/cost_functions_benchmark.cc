@@ -0,0 +1,207 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+#include "bundle_adjustment.h"
+#include "cost_functions.h"
+
+using namespace mercator;
+
+namespace {
+
+Camera MakeCamera()
+{
+  Camera camera;
+  camera.SetCameraId(1);
+  camera.SetWidth(4000);
+  camera.SetHeight(3000);
+  camera.SetParams({ 3000.0, 2000.0, 1500.0, 0.01 });
+  return camera;
+}
+
+// Create an image on a circle of the given radius around the target, looking
+// at the target
+Image MakeImage(const uint32_t image_id,
+                const Eigen::Vector3d& target,
+                const double angle,
+                const double radius)
+{
+  const Eigen::Vector3d center = target
+    + radius * Eigen::Vector3d(std::cos(angle), std::sin(angle), 0.5);
+  const Eigen::Quaterniond q = Eigen::Quaterniond::FromTwoVectors(
+      (target - center).normalized(), Eigen::Vector3d::UnitZ());
+
+  Image image;
+  image.SetImageId(image_id);
+  image.SetCameraId(1);
+  image.SetRotation(q);
+  image.SetTranslation(-(q * center));
+  return image;
+}
+
+// Observation of a point in an image, perturbed by a fixed pixel offset so
+// that the residuals are not zero
+Eigen::Vector2d Observe(const Camera& camera,
+                        const Image& image,
+                        const Eigen::Vector3d& point)
+{
+  const Eigen::Vector3d local = image.Transform(point);
+  Eigen::Vector2d xy;
+  Camera::WorldToImage(camera.Params(), local, &xy);
+  return xy + Eigen::Vector2d(0.5, -0.5);
+}
+
+} // namespace
+
+// Evaluate the residuals and Jacobians of one point observed by
+// state.range(0) images, with one residual block per observation
+static void BM_EvaluatePerObservation(benchmark::State& state)
+{
+  const Camera camera = MakeCamera();
+  const Eigen::Vector3d point(1.0, 2.0, 3.0);
+  const int track_length = state.range(0);
+
+  std::vector<std::unique_ptr<ceres::CostFunction>> costs;
+  for (int i = 0; i < track_length; ++i)
+  {
+    const Image image = MakeImage(i, point, 2 * M_PI * i / track_length, 10);
+    const Eigen::Vector2d xy = Observe(camera, image, point);
+    costs.emplace_back(ReprojectionCostFunction::Create(
+          camera, image.Rotation(), image.Translation(),
+          Point2d(xy(0), xy(1))));
+  }
+
+  const double* parameters[] = { point.data() };
+  double residuals[2];
+  double jacobian[6];
+  double* jacobians[] = { jacobian };
+
+  for (auto _ : state)
+  {
+    for (const auto& cost : costs)
+    {
+      cost->Evaluate(parameters, residuals, jacobians);
+      benchmark::DoNotOptimize(residuals);
+      benchmark::DoNotOptimize(jacobian);
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * track_length);
+}
+BENCHMARK(BM_EvaluatePerObservation)->RangeMultiplier(4)->Range(2, 128);
+
+// Same as BM_EvaluatePerObservation, with all observations in one block
+static void BM_EvaluatePerPoint(benchmark::State& state)
+{
+  const Camera camera = MakeCamera();
+  const Eigen::Vector3d point(1.0, 2.0, 3.0);
+  const int track_length = state.range(0);
+
+  PointReprojectionCostFunction cost;
+  for (int i = 0; i < track_length; ++i)
+  {
+    const Image image = MakeImage(i, point, 2 * M_PI * i / track_length, 10);
+    cost.AddObservation(camera, image.RotationMatrix(), image.Translation(),
+                        Observe(camera, image, point));
+  }
+
+  const double* parameters[] = { point.data() };
+  std::vector<double> residuals(2 * track_length);
+  std::vector<double> jacobian(6 * track_length);
+  double* jacobians[] = { jacobian.data() };
+
+  for (auto _ : state)
+  {
+    cost.Evaluate(parameters, residuals.data(), jacobians);
+    benchmark::DoNotOptimize(residuals.data());
+    benchmark::DoNotOptimize(jacobian.data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * track_length);
+}
+BENCHMARK(BM_EvaluatePerPoint)->RangeMultiplier(4)->Range(2, 128);
+
+// Full bundle adjustment of state.range(0) points, each observed by
+// state.range(1) images. state.range(2) selects the grouped layout.
+static void BM_BundleAdjustmentLayout(benchmark::State& state)
+{
+  const Camera camera = MakeCamera();
+  const int num_points = state.range(0);
+  const int track_length = state.range(1);
+
+  BundleAdjustment::Options options;
+  options.group_observations_by_point = state.range(2) != 0;
+  options.solver_options.max_num_iterations = 10;
+
+  const Eigen::Vector3d target = Eigen::Vector3d::Zero();
+  std::vector<Image> images;
+  for (int i = 0; i < track_length; ++i)
+  {
+    images.push_back(
+        MakeImage(i, target, 2 * M_PI * i / track_length, 50));
+  }
+
+  std::vector<Point3d> points;
+  for (int j = 0; j < num_points; ++j)
+  {
+    Point3d point;
+    point.SetPoint3dId(j);
+    point.SetCoords(Eigen::Vector3d::Random());
+    for (auto& image : images)
+    {
+      const Eigen::Vector2d xy = Observe(camera, image, point.Coords());
+      Point2d point2d(xy(0), xy(1));
+      point2d.SetPoint3dId(j);
+      image.Points2d().push_back(point2d);
+    }
+    points.push_back(point);
+  }
+
+  for (auto _ : state)
+  {
+    BundleAdjustment ba(options);
+    ba.AddCamera(camera);
+    for (const auto& image : images)
+    {
+      ba.AddImage(image);
+    }
+    for (const auto& point : points)
+    {
+      ba.AddPoint(point);
+    }
+    ba.Run();
+  }
+
+  state.SetItemsProcessed(state.iterations() * num_points * track_length);
+}
+BENCHMARK(BM_BundleAdjustmentLayout)
+  ->ArgNames({ "points", "track", "grouped" })
+  ->ArgsProduct({ { 100, 1000 }, { 4, 16, 64 }, { 0, 1 } })
+  ->Unit(benchmark::kMillisecond);
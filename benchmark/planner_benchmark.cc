@@ -0,0 +1,363 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "bundle_adjustment.h"
+#include "mercator.h"
+#include "planner.h"
+#include "synthetic_scene.h"
+#include "util/colmap.h"
+#include "util/logger.h"
+
+using namespace mercator;
+
+namespace {
+
+// Synthetic reconstructions shared by the benchmarks, written once into a
+// temporary directory and removed at exit
+class SceneCache {
+ public:
+  ~SceneCache()
+  {
+    for (const auto& scene : paths_)
+    {
+      for (const auto* file : { "/cameras.bin", "/images.bin", "/points3D.bin" })
+      {
+        unlink((scene.second + file).c_str());
+      }
+      rmdir(scene.second.c_str());
+    }
+  }
+
+  static SceneCache& Instance()
+  {
+    static SceneCache cache;
+    return cache;
+  }
+
+  // Path of a scene with the given number of points, and enough images that
+  // each holds about 500 of them
+  const std::string& Path(const uint64_t num_points)
+  {
+    auto it = paths_.find(num_points);
+    if (it != paths_.end())
+    {
+      return it->second;
+    }
+
+    const char* tmpdir = getenv("TMPDIR");
+    std::string path = std::string(tmpdir ? tmpdir : "/tmp")
+      + "/mercator_bench_XXXXXX";
+    CHECK(mkdtemp(&path[0]) != nullptr);
+
+    SyntheticScene::Options options;
+    options.num_points = num_points;
+    options.num_images = std::max<uint64_t>(20, num_points / 500);
+    CHECK(SyntheticScene(options).Write(path));
+
+    return paths_.emplace(num_points, path).first->second;
+  }
+
+  // Reconstruction read from Path(num_points)
+  ColmapReader* Reader(const uint64_t num_points)
+  {
+    auto& reader = readers_[num_points];
+    if (!reader)
+    {
+      reader.reset(new ColmapReader);
+      CHECK(reader->Read(Path(num_points)));
+    }
+    return reader.get();
+  }
+
+ private:
+  std::map<uint64_t, std::string> paths_;
+  std::map<uint64_t, std::unique_ptr<ColmapReader>> readers_;
+};
+
+int64_t FileSize(const std::string& path)
+{
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 ? info.st_size : 0;
+}
+
+// Bundle adjustment of the points seen by at least two of num_images
+// consecutive images of a reconstruction
+void AddWindow(const ColmapReader& reader,
+               const size_t num_images,
+               BundleAdjustment* ba)
+{
+  ba->AddCamera(reader.Cameras().begin()->second);
+  ba->SetObservations(&reader.Observations());
+
+  std::map<uint64_t, int> num_views;
+  auto image = reader.Images().begin();
+  for (size_t i = 0; i < num_images && image != reader.Images().end();
+       ++i, ++image)
+  {
+    ba->AddImage(image->second);
+    for (const auto& point2d : image->second.Points2d())
+    {
+      if (point2d.HasPoint3d())
+      {
+        ++num_views[point2d.Point3dId()];
+      }
+    }
+  }
+
+  for (const auto& point : num_views)
+  {
+    if (point.second >= 2)
+    {
+      ba->AddPoint(reader.Points().at(point.first));
+    }
+  }
+}
+
+} // namespace
+
+// Read a complete reconstruction of state.range(0) points
+static void BM_ReadReconstruction(benchmark::State& state)
+{
+  const std::string& path = SceneCache::Instance().Path(state.range(0));
+
+  for (auto _ : state)
+  {
+    ColmapReader reader;
+    CHECK(reader.Read(path));
+    benchmark::DoNotOptimize(reader.Points().size());
+  }
+
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+  state.SetBytesProcessed(state.iterations() * (FileSize(path + "/cameras.bin")
+        + FileSize(path + "/images.bin") + FileSize(path + "/points3D.bin")));
+}
+BENCHMARK(BM_ReadReconstruction)
+  ->ArgName("points")
+  ->RangeMultiplier(10)->Range(10000, 1000000)
+  ->Unit(benchmark::kMillisecond);
+
+// Project every point of the reconstruction onto one of its images, as
+// done when a virtual camera is added to a problem
+static void BM_ProjectPointOntoImage(benchmark::State& state)
+{
+  const ColmapReader& reader = *SceneCache::Instance().Reader(state.range(0));
+  const Camera& camera = reader.Cameras().begin()->second;
+  Image image = reader.Images().begin()->second;
+
+  for (auto _ : state)
+  {
+    image.Points2d().clear();
+    image.NumPoints3d() = 0;
+    for (const auto& point : reader.Points())
+    {
+      ProjectPointOntoImage(point.second, camera, &image);
+    }
+    benchmark::DoNotOptimize(image.Points2d().data());
+  }
+
+  state.SetItemsProcessed(state.iterations() * reader.Points().size());
+}
+BENCHMARK(BM_ProjectPointOntoImage)
+  ->ArgName("points")
+  ->RangeMultiplier(10)->Range(10000, 1000000);
+
+// Evaluate the grouped cost function of every point of the reconstruction
+static void BM_EvaluateScene(benchmark::State& state)
+{
+  const ColmapReader& reader = *SceneCache::Instance().Reader(state.range(0));
+  const Camera& camera = reader.Cameras().begin()->second;
+  const ObservationStore& observations = reader.Observations();
+
+  std::vector<std::unique_ptr<PointReprojectionCostFunction>> costs;
+  std::vector<const double*> coords;
+  size_t num_observations = 0;
+  for (const auto& point : reader.Points())
+  {
+    std::unique_ptr<PointReprojectionCostFunction> cost(
+        new PointReprojectionCostFunction);
+    for (const auto& observation : observations.TrackForPoint(point.first))
+    {
+      const Image& image =
+        reader.Images().at(observations.ImageId(observation.image_idx));
+      cost->AddObservation(camera, image.RotationMatrix(), image.Translation(),
+                           Eigen::Vector2d(observation.x, observation.y));
+    }
+    num_observations += point.second.ImageIds().size();
+    costs.push_back(std::move(cost));
+    coords.push_back(point.second.Coords().data());
+  }
+
+  std::vector<double> residuals;
+  std::vector<double> jacobian;
+
+  for (auto _ : state)
+  {
+    for (size_t i = 0; i < costs.size(); ++i)
+    {
+      const int num_residuals = costs[i]->num_residuals();
+      residuals.resize(num_residuals);
+      jacobian.resize(3 * num_residuals);
+
+      const double* parameters[] = { coords[i] };
+      double* jacobians[] = { jacobian.data() };
+      costs[i]->Evaluate(parameters, residuals.data(), jacobians);
+      benchmark::DoNotOptimize(residuals.data());
+      benchmark::DoNotOptimize(jacobian.data());
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * num_observations);
+}
+BENCHMARK(BM_EvaluateScene)
+  ->ArgName("points")
+  ->RangeMultiplier(10)->Range(10000, 100000);
+
+// Bundle adjustment of the points seen by state.range(0) consecutive images
+static void BM_BundleAdjustment(benchmark::State& state)
+{
+  const ColmapReader& reader = *SceneCache::Instance().Reader(100000);
+
+  BundleAdjustment::Options options;
+  options.solver_options.max_num_iterations = 10;
+
+  size_t num_points = 0;
+  for (auto _ : state)
+  {
+    BundleAdjustment ba(options);
+    AddWindow(reader, state.range(0), &ba);
+    ba.Run();
+    num_points = ba.Points().size();
+  }
+
+  state.counters["points"] = num_points;
+  state.SetItemsProcessed(state.iterations() * num_points);
+}
+BENCHMARK(BM_BundleAdjustment)
+  ->ArgName("images")
+  ->RangeMultiplier(4)->Range(4, 64)
+  ->Unit(benchmark::kMillisecond);
+
+// Covariance of every point of the bundle adjustment of state.range(0)
+// consecutive images. The problem is solved once, outside the timing.
+static void BM_ComputeCovariance(benchmark::State& state)
+{
+  const ColmapReader& reader = *SceneCache::Instance().Reader(100000);
+
+  BundleAdjustment::Options options;
+  options.solver_options.max_num_iterations = 10;
+
+  BundleAdjustment ba(options);
+  AddWindow(reader, state.range(0), &ba);
+  ba.Run();
+
+  for (auto _ : state)
+  {
+    ba.ComputeCovariance();
+  }
+
+  state.counters["points"] = ba.Points().size();
+  state.SetItemsProcessed(state.iterations() * ba.Points().size());
+}
+BENCHMARK(BM_ComputeCovariance)
+  ->ArgName("images")
+  ->RangeMultiplier(4)->Range(4, 64)
+  ->Unit(benchmark::kMillisecond);
+
+// Largest eigenvalue of the covariance of every point. The cached value is
+// cleared so that the eigenvalues are computed each time.
+static void BM_PointUncertainty(benchmark::State& state)
+{
+  const ColmapReader& reader = *SceneCache::Instance().Reader(state.range(0));
+
+  std::vector<Point3d> points;
+  points.reserve(reader.Points().size());
+  for (const auto& point : reader.Points())
+  {
+    points.push_back(point.second);
+    points.back().SetUncertainty(-1.0);
+  }
+
+  for (auto _ : state)
+  {
+    for (const auto& point : points)
+    {
+      benchmark::DoNotOptimize(point.Uncertainty());
+    }
+  }
+
+  state.SetItemsProcessed(state.iterations() * points.size());
+}
+BENCHMARK(BM_PointUncertainty)
+  ->ArgName("points")
+  ->RangeMultiplier(10)->Range(10000, 1000000);
+
+// One planning iteration: build, solve and evaluate the first candidate
+// camera of a region. Regions are visited in turn, worst first.
+static void BM_PlanRegion(benchmark::State& state)
+{
+  ColmapReader* reader = SceneCache::Instance().Reader(state.range(0));
+
+  Logger logger;
+  logger.SetLogLevel(Logger::LogLevel::ERROR);
+
+  Planner::Options options;
+  options.ba_options.solver_options.max_num_iterations = 10;
+  Planner planner(options, logger, reader);
+  planner.Start();
+
+  const std::vector<PointRegion> regions =
+    planner.MakeRegions(planner.Classify());
+  if (regions.empty())
+  {
+    state.SkipWithError("Every point is covered");
+    return;
+  }
+
+  size_t region_idx = 0;
+  for (auto _ : state)
+  {
+    Image virtual_image;
+    double uncertainty;
+    planner.PlanRegion(regions[region_idx], planner.CandidateAngle(0),
+                       &virtual_image, &uncertainty);
+    region_idx = (region_idx + 1) % regions.size();
+  }
+
+  state.counters["regions"] = regions.size();
+}
+BENCHMARK(BM_PlanRegion)
+  ->ArgName("points")
+  ->RangeMultiplier(10)->Range(10000, 100000)
+  ->Unit(benchmark::kMillisecond);
@@ -6,22 +6,74 @@ set(
     SOURCES
     ${PROJECT_SOURCE_DIR}/src/mercator.h
     ${PROJECT_SOURCE_DIR}/src/camera.h
+    ${PROJECT_SOURCE_DIR}/src/camera_models.h
     ${PROJECT_SOURCE_DIR}/src/image.h
     ${PROJECT_SOURCE_DIR}/src/point2d.h
     ${PROJECT_SOURCE_DIR}/src/cost_functions.h
     ${PROJECT_SOURCE_DIR}/src/bundle_adjustment.h
+    ${PROJECT_SOURCE_DIR}/src/clustering.h
+    ${PROJECT_SOURCE_DIR}/src/planner.h
+    ${PROJECT_SOURCE_DIR}/src/point_hierarchy.h
+    ${PROJECT_SOURCE_DIR}/src/solver_statistics.h
+    ${PROJECT_SOURCE_DIR}/src/pipeline.h
+    ${PROJECT_SOURCE_DIR}/src/voxel_grid.h
+    ${PROJECT_SOURCE_DIR}/src/observation_store.h
     ${PROJECT_SOURCE_DIR}/src/point3d.h
+    ${PROJECT_SOURCE_DIR}/src/pose_table.h
+    ${PROJECT_SOURCE_DIR}/src/tiled_planner.h
+    ${PROJECT_SOURCE_DIR}/src/threshold_sweep.h
+    ${PROJECT_SOURCE_DIR}/src/batch_planner.h
+    ${PROJECT_SOURCE_DIR}/src/model_delta.h
+    ${PROJECT_SOURCE_DIR}/src/planner_service.h
+    ${PROJECT_SOURCE_DIR}/src/model_index.h
+    ${PROJECT_SOURCE_DIR}/src/result_cache.h
+    ${PROJECT_SOURCE_DIR}/src/redundancy_analysis.h
+    ${PROJECT_SOURCE_DIR}/src/problem_corpus.h
+    ${PROJECT_SOURCE_DIR}/src/synthetic_scene.h
     ${PROJECT_SOURCE_DIR}/src/camera.cc
+    ${PROJECT_SOURCE_DIR}/src/camera_models.cc
     ${PROJECT_SOURCE_DIR}/src/mercator.cc
+    ${PROJECT_SOURCE_DIR}/src/main.cc
     ${PROJECT_SOURCE_DIR}/src/point3d.cc
     ${PROJECT_SOURCE_DIR}/src/image.cc
     ${PROJECT_SOURCE_DIR}/src/bundle_adjustment.cc
+    ${PROJECT_SOURCE_DIR}/src/clustering.cc
+    ${PROJECT_SOURCE_DIR}/src/planner.cc
+    ${PROJECT_SOURCE_DIR}/src/point_hierarchy.cc
+    ${PROJECT_SOURCE_DIR}/src/solver_statistics.cc
+    ${PROJECT_SOURCE_DIR}/src/pipeline.cc
+    ${PROJECT_SOURCE_DIR}/src/voxel_grid.cc
+    ${PROJECT_SOURCE_DIR}/src/observation_store.cc
     ${PROJECT_SOURCE_DIR}/src/point2d.cc
+    ${PROJECT_SOURCE_DIR}/src/pose_table.cc
+    ${PROJECT_SOURCE_DIR}/src/tiled_planner.cc
+    ${PROJECT_SOURCE_DIR}/src/threshold_sweep.cc
+    ${PROJECT_SOURCE_DIR}/src/batch_planner.cc
+    ${PROJECT_SOURCE_DIR}/src/model_delta.cc
+    ${PROJECT_SOURCE_DIR}/src/planner_service.cc
+    ${PROJECT_SOURCE_DIR}/src/model_index.cc
+    ${PROJECT_SOURCE_DIR}/src/result_cache.cc
+    ${PROJECT_SOURCE_DIR}/src/redundancy_analysis.cc
+    ${PROJECT_SOURCE_DIR}/src/problem_corpus.cc
+    ${PROJECT_SOURCE_DIR}/src/synthetic_scene.cc
     ${PROJECT_SOURCE_DIR}/src/util/colmap.h
     ${PROJECT_SOURCE_DIR}/src/util/logger.h
+    ${PROJECT_SOURCE_DIR}/src/util/memory.h
     ${PROJECT_SOURCE_DIR}/src/util/types.h
+    ${PROJECT_SOURCE_DIR}/src/util/hash.h
+    ${PROJECT_SOURCE_DIR}/src/util/json.h
+    ${PROJECT_SOURCE_DIR}/src/util/spsc_queue.h
+    ${PROJECT_SOURCE_DIR}/src/util/thread_pool.h
+    ${PROJECT_SOURCE_DIR}/src/util/report.h
+    ${PROJECT_SOURCE_DIR}/src/util/trace.h
     ${PROJECT_SOURCE_DIR}/src/util/config.h
+    ${PROJECT_SOURCE_DIR}/src/util/hash.cc
+    ${PROJECT_SOURCE_DIR}/src/util/json.cc
     ${PROJECT_SOURCE_DIR}/src/util/logger.cc
+    ${PROJECT_SOURCE_DIR}/src/util/memory.cc
     ${PROJECT_SOURCE_DIR}/src/util/config.cc
+    ${PROJECT_SOURCE_DIR}/src/util/report.cc
+    ${PROJECT_SOURCE_DIR}/src/util/trace.cc
+    ${PROJECT_SOURCE_DIR}/src/util/thread_pool.cc
     ${PROJECT_SOURCE_DIR}/src/util/colmap.cc
 )
@@ -0,0 +1,251 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+
+#include "batch_planner.h"
+#include "util/colmap.h"
+
+namespace mercator {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double SecondsSince(const Clock::time_point start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+double Megabytes(const size_t bytes)
+{
+  return bytes / (1024.0 * 1024.0);
+}
+
+} // namespace
+
+BatchPlanner::BatchPlanner(const Options& options,
+                           const Planner::Options& planner_options,
+                           const Logger& logger)
+  : options_(options),
+    planner_options_(planner_options),
+    logger_(logger),
+    num_done_(0),
+    seconds_(0.0) {}
+
+bool BatchPlanner::Run(const std::vector<std::string>& paths)
+{
+  const Clock::time_point start = Clock::now();
+
+  results_.assign(paths.size(), ModelResult());
+  for (size_t i = 0; i < paths.size(); ++i)
+  {
+    results_[i].path = paths[i];
+  }
+  num_done_ = 0;
+
+  // Start the largest models first, so that the pool is not left waiting on
+  // one large model at the end
+  std::vector<std::pair<size_t, size_t>> order;
+  for (size_t i = 0; i < paths.size(); ++i)
+  {
+    order.emplace_back(FileSize(paths[i]), i);
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [](const std::pair<size_t, size_t>& a,
+                      const std::pair<size_t, size_t>& b)
+                   {
+                     return a.first > b.first;
+                   });
+
+  {
+    ThreadPool pool(std::max(options_.num_threads, 0));
+
+    logger_.Log() << "Planning " << paths.size() << " models on "
+                  << pool.NumThreads() << " threads" << std::endl;
+
+    for (const auto& entry : order)
+    {
+      const size_t idx = entry.second;
+      pool.Submit([this, idx, &pool] { PlanModel(idx, &pool); });
+    }
+    pool.Wait();
+  }
+
+  seconds_ = SecondsSince(start);
+
+  // Write the progress of every model before anything that follows
+  logger_.Flush();
+
+  return std::all_of(results_.begin(), results_.end(),
+                     [](const ModelResult& result) { return result.ok; });
+}
+
+const std::vector<BatchPlanner::ModelResult>& BatchPlanner::Results() const
+{
+  return results_;
+}
+
+const std::string BatchPlanner::Summary() const
+{
+  std::ostringstream ss;
+
+  size_t num_ok = 0;
+  size_t num_virtual_cameras = 0;
+  for (const auto& result : results_)
+  {
+    if (result.ok)
+    {
+      ++num_ok;
+      num_virtual_cameras += result.num_virtual_cameras;
+    }
+  }
+
+  ss << "Planned " << num_ok << " of " << results_.size() << " models, "
+     << num_virtual_cameras << " virtual cameras in total, in "
+     << std::fixed << std::setprecision(3) << seconds_ << " s";
+
+  for (const auto& result : results_)
+  {
+    if (!result.ok)
+    {
+      ss << "\n  " << result.path << " failed: " << result.error;
+    }
+  }
+
+  return ss.str();
+}
+
+bool BatchPlanner::ReadList(const std::string& path,
+                            std::vector<std::string>* paths)
+{
+  std::ifstream file(path);
+  if (!file.is_open())
+  {
+    std::cerr << "Couldn't open file " << path << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(file, line))
+  {
+    const size_t begin = line.find_first_not_of(" \t\r");
+    if (begin == std::string::npos || line[begin] == '#')
+    {
+      continue;
+    }
+    const size_t end = line.find_last_not_of(" \t\r");
+    paths->push_back(line.substr(begin, end - begin + 1));
+  }
+
+  return true;
+}
+
+void BatchPlanner::PlanModel(const size_t idx, ThreadPool* pool)
+{
+  const Clock::time_point start = Clock::now();
+  ModelResult& result = results_[idx];
+
+  // The in-memory model is larger than its files, so a model whose files
+  // exceed the limit is not read at all
+  const size_t file_size = FileSize(result.path);
+  if (options_.memory_limit > 0 && file_size > options_.memory_limit)
+  {
+    std::ostringstream ss;
+    ss << "files of " << Megabytes(file_size)
+       << " MB exceed the memory limit";
+    result.error = ss.str();
+  }
+  else
+  {
+    ColmapReader reader;
+    Planner planner(planner_options_, logger_, &reader);
+    planner.SetThreadPool(pool);
+
+    if (!reader.Read(result.path))
+    {
+      result.error = "failed to read the model";
+    }
+    else
+    {
+      for (const auto& usage : reader.MemoryUsage())
+      {
+        result.memory_bytes += usage.second;
+      }
+      result.num_points = reader.Points().size();
+
+      if (options_.memory_limit > 0 &&
+          result.memory_bytes > options_.memory_limit)
+      {
+        std::ostringstream ss;
+        ss << "model of " << Megabytes(result.memory_bytes)
+           << " MB exceeds the memory limit";
+        result.error = ss.str();
+      }
+      else
+      {
+        planner.Run();
+        result.num_virtual_cameras = planner.VirtualCameras().size();
+        result.ok = true;
+      }
+    }
+  }
+
+  result.seconds = SecondsSince(start);
+
+  const size_t num_done = ++num_done_;
+  if (result.ok)
+  {
+    logger_.Log() << "[" << num_done << "/" << results_.size() << "] "
+                  << result.path << ": " << result.num_virtual_cameras
+                  << " virtual cameras for " << result.num_points
+                  << " points in " << result.seconds << " s ("
+                  << Megabytes(result.memory_bytes) << " MB)" << std::endl;
+  }
+  else
+  {
+    logger_.Error() << "[" << num_done << "/" << results_.size() << "] "
+                    << result.path << ": " << result.error << std::endl;
+  }
+}
+
+size_t BatchPlanner::FileSize(const std::string& path)
+{
+  size_t size = 0;
+  for (const char* name : { "/cameras.bin", "/images.bin", "/points3D.bin" })
+  {
+    struct stat st;
+    if (stat((path + name).c_str(), &st) == 0)
+    {
+      size += st.st_size;
+    }
+  }
+  return size;
+}
+
+} // namespace mercator
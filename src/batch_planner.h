@@ -0,0 +1,104 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_BATCH_PLANNER_H_
+#define MERCATOR_BATCH_PLANNER_H_
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "planner.h"
+#include "util/logger.h"
+#include "util/thread_pool.h"
+
+namespace mercator {
+
+// Plans many models in one process. Every model is planned by a task of a
+// shared thread pool, largest first so that small models fill the gaps at
+// the end, and each bundle adjustment runs on the threads that are idle at
+// the time. The process never runs more threads than the pool has, however
+// many models are planned at once.
+class BatchPlanner {
+ public:
+  struct Options {
+    // Size of the thread pool. If not positive, one per hardware thread.
+    int num_threads = 0;
+
+    // Size filter, in bytes: a model is not read if its files are larger,
+    // and is not planned if the model is once read. The memory used while
+    // planning, e.g. by the bundle adjustments, is neither counted nor
+    // limited. If 0, there is no limit.
+    size_t memory_limit = 0;
+  };
+
+  // Outcome of planning one model
+  struct ModelResult {
+    std::string path;
+    bool ok = false;
+    std::string error;
+
+    size_t num_points = 0;
+    size_t num_virtual_cameras = 0;
+    size_t memory_bytes = 0;
+    double seconds = 0.0;
+  };
+
+  BatchPlanner(const Options& options,
+               const Planner::Options& planner_options,
+               const Logger& logger);
+
+  // Plan every model directory in paths. Returns false if any model failed.
+  bool Run(const std::vector<std::string>& paths);
+
+  // Results in the order of the paths
+  const std::vector<ModelResult>& Results() const;
+
+  const std::string Summary() const;
+
+  // Read a list of model directories, one per line. Blank lines and lines
+  // starting with '#' are skipped.
+  static bool ReadList(const std::string& path,
+                       std::vector<std::string>* paths);
+
+ private:
+  void PlanModel(const size_t idx, ThreadPool* pool);
+
+  // Bytes of the COLMAP files of a model
+  static size_t FileSize(const std::string& path);
+
+  const Options options_;
+
+  const Planner::Options planner_options_;
+
+  const Logger& logger_;
+
+  std::vector<ModelResult> results_;
+
+  std::atomic<size_t> num_done_;
+
+  double seconds_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_BATCH_PLANNER_H_
@@ -20,15 +20,39 @@
 //
 // Author: Greg Anders
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 
 #include "bundle_adjustment.h"
+#include "util/memory.h"
+#include "util/trace.h"
 
 namespace mercator {
 
+namespace {
+
+// Records every solver iteration in the trace
+class TraceIterationCallback : public ceres::IterationCallback {
+ public:
+  ceres::CallbackReturnType operator()(
+      const ceres::IterationSummary& summary) override
+  {
+    Tracer& tracer = Tracer::Instance();
+    const uint64_t end_ns = tracer.Now();
+    const uint64_t duration_ns =
+      static_cast<uint64_t>(summary.iteration_time_in_seconds * 1e9);
+    tracer.Complete("ceres_iteration",
+                    end_ns - std::min(end_ns, duration_ns),
+                    end_ns);
+    return ceres::SOLVER_CONTINUE;
+  }
+};
+
+} // namespace
+
 BundleAdjustment::BundleAdjustment(const BundleAdjustment::Options& options)
-  : options_(options) {}
+  : options_(options), observations_(nullptr) {}
 
 void BundleAdjustment::AddCamera(const Camera& camera)
 {
@@ -45,6 +69,11 @@ void BundleAdjustment::AddPoint(const Point3d& point3d)
   points3d_.emplace(point3d.Point3dId(), point3d);
 }
 
+void BundleAdjustment::SetObservations(const ObservationStore* observations)
+{
+  observations_ = observations;
+}
+
 bool BundleAdjustment::HasCamera(const uint32_t camera_id) const
 {
   return cameras_.count(camera_id) > 0;
@@ -75,13 +104,43 @@ const std::unordered_map<uint64_t, Point3d>& BundleAdjustment::Points() const
   return points3d_;
 }
 
-void BundleAdjustment::Run()
+void BundleAdjustment::VisitObservations(
+    const ObservationVisitor& visitor) const
 {
-  problem_.reset(new ceres::Problem());
+  // Walk the track of every point that is part of the store and keep the
+  // observations made by images participating in the adjustment
+  if (observations_ != nullptr)
+  {
+    for (const auto& point3d : points3d_)
+    {
+      if (!observations_->HasPoint(point3d.first))
+      {
+        continue;
+      }
+
+      const Track track = observations_->TrackForPoint(point3d.first);
+      for (const auto& observation : track)
+      {
+        const auto image =
+          images_.find(observations_->ImageId(observation.image_idx));
+        if (image != images_.end())
+        {
+          visitor(image->second,
+                  Eigen::Vector2d(observation.x, observation.y),
+                  point3d.first);
+        }
+      }
+    }
+  }
 
+  // Images without tracks in the store are matched through their 2D points
   for (const auto& image : images_)
   {
-    const Camera& camera = cameras_.at(image.second.CameraId());
+    if (observations_ != nullptr && observations_->HasImage(image.first))
+    {
+      continue;
+    }
+
     for (const auto& point2d : image.second.Points2d())
     {
       if (!point2d.HasPoint3d())
@@ -89,22 +148,48 @@ void BundleAdjustment::Run()
         continue;
       }
 
-      try
+      const auto point3d = points3d_.find(point2d.Point3dId());
+      if (point3d != points3d_.end())
       {
-        Point3d& point3d = points3d_.at(point2d.Point3dId());
-        problem_->AddResidualBlock(
-            ReprojectionCostFunction::Create(
-              camera,
-              image.second.Rotation(),
-              image.second.Translation(),
-              point2d
-            ),
-            options_.loss_function,
-            point3d.Coords().data());
+        visitor(image.second, point2d.Coords(), point3d->first);
       }
-      catch (std::out_of_range& ignored) {}
     }
   }
+}
+
+void BundleAdjustment::SetNumThreads(const int num_threads)
+{
+  options_.solver_options.num_threads = num_threads;
+  options_.solver_options.num_linear_solver_threads = num_threads;
+  options_.covariance_options.num_threads = num_threads;
+}
+
+void BundleAdjustment::Run()
+{
+  ScopedTrace trace("bundle_adjustment");
+
+  // The loss function belongs to the options, which may be shared by many
+  // bundle adjustments
+  ceres::Problem::Options problem_options;
+  problem_options.loss_function_ownership = ceres::DO_NOT_TAKE_OWNERSHIP;
+  problem_.reset(new ceres::Problem(problem_options));
+
+  // Grouped cost function of every point, if observations are grouped
+  PointCostFunctions point_costs;
+
+  VisitObservations([this, &point_costs](const Image& image,
+                                         const Eigen::Vector2d& xy,
+                                         const uint64_t point3d_id)
+      {
+        AddResidual(image, xy, &points3d_.at(point3d_id), &point_costs);
+      });
+
+  for (const auto& point_cost : point_costs)
+  {
+    problem_->AddResidualBlock(point_cost.second,
+                               nullptr,
+                               points3d_.at(point_cost.first).Coords().data());
+  }
 
   if (problem_->NumResiduals() > 0)
   {
@@ -120,12 +205,50 @@ void BundleAdjustment::Run()
 #endif
     }
 
+    TraceIterationCallback trace_callback;
+    if (Tracer::IsEnabled())
+    {
+      solver_options.callbacks.push_back(&trace_callback);
+    }
+
     ceres::Solve(solver_options, problem_.get(), &summary_);
   }
 }
 
+void BundleAdjustment::AddResidual(const Image& image,
+                                   const Eigen::Vector2d& xy,
+                                   Point3d* point3d,
+                                   PointCostFunctions* point_costs)
+{
+  const Camera& camera = cameras_.at(image.CameraId());
+
+  if (options_.group_observations_by_point && !options_.loss_function)
+  {
+    auto& cost = (*point_costs)[point3d->Point3dId()];
+    if (cost == nullptr)
+    {
+      cost = new PointReprojectionCostFunction();
+    }
+    cost->AddObservation(camera, image.RotationMatrix(), image.Translation(),
+                         xy);
+    return;
+  }
+
+  problem_->AddResidualBlock(
+      ReprojectionCostFunction::Create(
+        camera,
+        image.Rotation(),
+        image.Translation(),
+        Point2d(xy(0), xy(1))
+      ),
+      options_.loss_function.get(),
+      point3d->Coords().data());
+}
+
 void BundleAdjustment::ComputeCovariance(const std::vector<uint64_t>& point3d_ids)
 {
+  ScopedTrace trace("covariance");
+
   ceres::Covariance::Options covariance_options = options_.covariance_options;
   if (covariance_options.num_threads == -1)
   {
@@ -154,7 +277,16 @@ void BundleAdjustment::ComputeCovariance(const std::vector<uint64_t>& point3d_id
   {
     auto& point = points3d_.at(point3d_id);
     const double* data = point.Coords().data();
-    covariance.GetCovarianceBlock(data, data, point.Covariance().data());
+    if (!problem_->HasParameterBlock(data))
+    {
+      continue;
+    }
+
+    // Set the covariance through the point so that its uncertainty is
+    // updated as well
+    Eigen::Matrix3d point_covariance;
+    covariance.GetCovarianceBlock(data, data, point_covariance.data());
+    point.SetCovariance(point_covariance);
   }
 }
 
@@ -177,6 +309,21 @@ void BundleAdjustment::PrintSummary(const bool print_full_report)
   std::cout << report << std::endl;
 }
 
+size_t BundleAdjustment::MemoryUsage() const
+{
+  size_t bytes = UnorderedMapBytes(cameras_) + UnorderedMapBytes(images_)
+    + UnorderedMapBytes(points3d_);
+  for (const auto& image : images_)
+  {
+    bytes += VectorBytes(image.second.Points2d());
+  }
+  for (const auto& point : points3d_)
+  {
+    bytes += VectorBytes(point.second.ImageIds());
+  }
+  return bytes;
+}
+
 const ceres::Solver::Summary& BundleAdjustment::Summary() const
 {
   return summary_;
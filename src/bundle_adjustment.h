@@ -23,6 +23,7 @@
 #ifndef MERCATOR_BUNDLE_ADJUSTMENT_H_
 #define MERCATOR_BUNDLE_ADJUSTMENT_H_
 
+#include <functional>
 #include <memory>
 #include <unordered_map>
 #include <vector>
@@ -33,6 +34,7 @@
 
 #include "cost_functions.h"
 #include "image.h"
+#include "observation_store.h"
 #include "point2d.h"
 #include "point3d.h"
 
@@ -41,15 +43,23 @@ namespace mercator {
 class BundleAdjustment {
  public:
   struct Options {
-    // Type of loss function to use. If NULL, ceres will default to a squared
+    // Type of loss function to use, shared by every bundle adjustment made
+    // with a copy of the options. If NULL, ceres will default to a squared
     // loss function
-    ceres::LossFunction* loss_function;
+    std::shared_ptr<ceres::LossFunction> loss_function;
 
     // Ceres specific options
     ceres::Solver::Options solver_options;
 
     ceres::Covariance::Options covariance_options;
 
+    // Whether to evaluate all observations of a point in a single residual
+    // block instead of one block per observation. This reduces the per-block
+    // overhead of Ceres for points with long tracks. A loss function would
+    // then weigh the whole track instead of each observation, so observations
+    // are only grouped if there is none.
+    bool group_observations_by_point = true;
+
     // Whether or not to print the summary of the bundle adjustment after
     // completion
     bool print_summary = false;
@@ -60,8 +70,6 @@ class BundleAdjustment {
 
     Options()
     {
-      loss_function = new ceres::TrivialLoss();
-
       solver_options.function_tolerance = 0.0;
       solver_options.gradient_tolerance = 0.0;
       solver_options.parameter_tolerance = 0.0;
@@ -88,6 +96,11 @@ class BundleAdjustment {
 
   void AddPoint(const Point3d& point3d);
 
+  // Use the tracks of the given store to find the observations of each
+  // point. Images that are not part of the store (e.g. virtual images) are
+  // still matched through their list of 2D points.
+  void SetObservations(const ObservationStore* observations);
+
   bool HasCamera(const uint32_t camera_id) const;
 
   bool HasImage(const uint32_t image_id) const;
@@ -100,6 +113,19 @@ class BundleAdjustment {
 
   const std::unordered_map<uint64_t, Point3d>& Points() const;
 
+  // Called with an image, the coordinates of a 2D point in it and the ID of
+  // the observed 3D point
+  typedef std::function<void(const Image&, const Eigen::Vector2d&,
+                             const uint64_t)> ObservationVisitor;
+
+  // Visit every observation of a point of the adjustment by one of its
+  // images, i.e. every residual added by Run()
+  void VisitObservations(const ObservationVisitor& visitor) const;
+
+  // Number of threads used by the solver and to compute the covariance,
+  // e.g. once threads are available after the problem was built
+  void SetNumThreads(const int num_threads);
+
   void Run();
 
   void ComputeCovariance();
@@ -110,6 +136,10 @@ class BundleAdjustment {
 
   const ceres::Solver::Summary& Summary() const;
 
+  // Estimated heap bytes of the cameras, images and points copied into the
+  // bundle adjustment. The memory of the Ceres problem is not included.
+  size_t MemoryUsage() const;
+
  private:
   // Smart pointer to the Ceres Problem object
   std::unique_ptr<ceres::Problem> problem_;
@@ -117,7 +147,7 @@ class BundleAdjustment {
   // Ceres summary
   ceres::Solver::Summary summary_;
 
-  const Options options_;
+  Options options_;
 
   // Map of cameras participating in the bundle adjustment
   std::unordered_map<uint32_t, Camera> cameras_;
@@ -128,6 +158,19 @@ class BundleAdjustment {
   // Map of 3D points participating in the bundle adjustment
   std::unordered_map<uint64_t, Point3d> points3d_;
 
+  // Observations of the reconstruction the points and images were taken
+  // from, if any
+  const ObservationStore* observations_;
+
+  typedef std::unordered_map<uint64_t, PointReprojectionCostFunction*>
+    PointCostFunctions;
+
+  // Add the residual of one observation of a point, either as its own
+  // residual block or to the grouped cost function of the point
+  void AddResidual(const Image& image,
+                   const Eigen::Vector2d& xy,
+                   Point3d* point3d,
+                   PointCostFunctions* point_costs);
 };
 
 } // namespace mercator
@@ -0,0 +1,121 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include "camera_models.h"
+
+namespace mercator {
+
+namespace {
+
+const CameraModel kCameraModels[] = {
+  // id, name, params, fx and fy, radial index, exact
+  { 0, "SIMPLE_PINHOLE", 3, false, -1, true },
+  { 1, "PINHOLE", 4, true, -1, false },
+  { 2, "SIMPLE_RADIAL", 4, false, 3, true },
+  { 3, "RADIAL", 5, false, 3, false },
+  { 4, "OPENCV", 8, true, 4, false },
+  { 5, "OPENCV_FISHEYE", 8, true, 4, false },
+  { 6, "FULL_OPENCV", 12, true, 4, false },
+  { 7, "FOV", 5, true, -1, false },
+  { 8, "SIMPLE_RADIAL_FISHEYE", 4, false, 3, false },
+  { 9, "RADIAL_FISHEYE", 5, false, 3, false },
+  { 10, "THIN_PRISM_FISHEYE", 12, true, 4, false },
+};
+
+} // namespace
+
+const CameraModel* FindCameraModel(const int model_id)
+{
+  for (const auto& model : kCameraModels)
+  {
+    if (model.model_id == model_id)
+    {
+      return &model;
+    }
+  }
+  return nullptr;
+}
+
+const CameraModel* FindCameraModel(const std::string& name)
+{
+  for (const auto& model : kCameraModels)
+  {
+    if (name == model.name)
+    {
+      return &model;
+    }
+  }
+  return nullptr;
+}
+
+std::vector<double> ToSimpleRadialParams(const CameraModel& model,
+                                         const std::vector<double>& params)
+{
+  std::vector<double> simple_radial(4, 0.0);
+  if (model.separate_focal_lengths)
+  {
+    simple_radial[0] = (params[0] + params[1]) / 2;
+    simple_radial[1] = params[2];
+    simple_radial[2] = params[3];
+  }
+  else
+  {
+    simple_radial[0] = params[0];
+    simple_radial[1] = params[1];
+    simple_radial[2] = params[2];
+  }
+
+  if (model.radial_idx >= 0)
+  {
+    simple_radial[3] = params[model.radial_idx];
+  }
+
+  return simple_radial;
+}
+
+std::vector<double> FromSimpleRadialParams(const CameraModel& model,
+                                           const std::vector<double>& params)
+{
+  std::vector<double> model_params(model.num_params, 0.0);
+  if (model.separate_focal_lengths)
+  {
+    model_params[0] = params[0];
+    model_params[1] = params[0];
+    model_params[2] = params[1];
+    model_params[3] = params[2];
+  }
+  else
+  {
+    model_params[0] = params[0];
+    model_params[1] = params[1];
+    model_params[2] = params[2];
+  }
+
+  if (model.radial_idx >= 0)
+  {
+    model_params[model.radial_idx] = params[3];
+  }
+
+  return model_params;
+}
+
+} // namespace mercator
@@ -0,0 +1,66 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_CAMERA_MODELS_H_
+#define MERCATOR_CAMERA_MODELS_H_
+
+#include <string>
+#include <vector>
+
+namespace mercator {
+
+// A camera model of COLMAP, identified by the model_id stored in
+// cameras.bin. Mercator projects with a single focal length, a principal
+// point and one radial distortion coefficient (COLMAP's SIMPLE_RADIAL), so
+// the parameters of every other model are converted to that form.
+struct CameraModel {
+  int model_id;
+  const char* name;
+  int num_params;
+
+  // Whether the model has separate x and y focal lengths, which come first
+  bool separate_focal_lengths;
+
+  // Index of the first radial distortion coefficient, or -1 if none
+  int radial_idx;
+
+  // Whether the conversion to SIMPLE_RADIAL loses no information
+  bool exact;
+};
+
+// The model with the given id or name, or nullptr if there is none
+const CameraModel* FindCameraModel(const int model_id);
+const CameraModel* FindCameraModel(const std::string& name);
+
+// Convert the parameters of a model to the focal length, principal point and
+// radial distortion used by Camera
+std::vector<double> ToSimpleRadialParams(const CameraModel& model,
+                                         const std::vector<double>& params);
+
+// Parameters of a model equivalent to the given SIMPLE_RADIAL parameters. The
+// distortion is dropped by models without radial distortion.
+std::vector<double> FromSimpleRadialParams(const CameraModel& model,
+                                           const std::vector<double>& params);
+
+} // namespace mercator
+
+#endif // MERCATOR_CAMERA_MODELS_H_
@@ -0,0 +1,104 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <limits>
+#include <unordered_map>
+
+#include "clustering.h"
+#include "voxel_grid.h"
+
+namespace mercator {
+
+PointRegion MakeRegion(const std::vector<const Point3d*>& points)
+{
+  PointRegion region;
+  region.point3d_ids.reserve(points.size());
+  region.min_num_cameras =
+    points.empty() ? 0 : std::numeric_limits<size_t>::max();
+
+  for (const auto point : points)
+  {
+    region.min_num_cameras =
+      std::min(region.min_num_cameras, point->ImageIds().size());
+    region.point3d_ids.push_back(point->Point3dId());
+    region.centroid += point->Coords();
+    region.covariance += point->Covariance();
+    region.uncertainty = std::max(region.uncertainty, point->Uncertainty());
+  }
+
+  if (!points.empty())
+  {
+    region.centroid /= points.size();
+    region.covariance /= points.size();
+  }
+
+  return region;
+}
+
+std::vector<PointRegion> ClusterPoints(
+    const std::vector<const Point3d*>& points,
+    const double voxel_size)
+{
+  std::vector<PointRegion> regions;
+
+  if (voxel_size <= 0)
+  {
+    regions.reserve(points.size());
+    for (const auto point : points)
+    {
+      regions.push_back(MakeRegion({ point }));
+    }
+  }
+  else
+  {
+    VoxelGrid grid(voxel_size);
+    std::unordered_map<uint64_t, const Point3d*> points_by_id;
+    for (const auto point : points)
+    {
+      grid.Insert(point->Point3dId(), point->Coords());
+      points_by_id.emplace(point->Point3dId(), point);
+    }
+
+    regions.reserve(grid.NumVoxels());
+    for (const auto& voxel : grid.Voxels())
+    {
+      std::vector<const Point3d*> members;
+      members.reserve(voxel.second.size());
+      for (const auto point3d_id : voxel.second)
+      {
+        members.push_back(points_by_id.at(point3d_id));
+      }
+      regions.push_back(MakeRegion(members));
+    }
+  }
+
+  std::sort(regions.begin(), regions.end(),
+      [](const PointRegion& a, const PointRegion& b)
+      {
+        return a.point3d_ids.front() < b.point3d_ids.front();
+      });
+
+  return regions;
+}
+
+} // namespace mercator
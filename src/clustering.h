@@ -0,0 +1,65 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_CLUSTERING_H_
+#define MERCATOR_CLUSTERING_H_
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "point3d.h"
+
+namespace mercator {
+
+// A group of nearby 3D points that are planned for together
+struct PointRegion {
+  // IDs of the points in this region
+  std::vector<uint64_t> point3d_ids;
+
+  // Mean position of the points
+  Eigen::Vector3d centroid = Eigen::Vector3d::Zero();
+
+  // Mean of the covariance matrices of the points
+  Eigen::Matrix3d covariance = Eigen::Matrix3d::Zero();
+
+  // Largest uncertainty of any point in the region
+  double uncertainty = 0.0;
+
+  // Smallest number of images that see any point in the region
+  size_t min_num_cameras = 0;
+};
+
+// Build a region containing the given points
+PointRegion MakeRegion(const std::vector<const Point3d*>& points);
+
+// Group points into regions by hashing them into cubic voxels with the given
+// edge length. Every occupied voxel becomes one region. If voxel_size is not
+// positive, every point is placed in its own region. Regions are returned in
+// order of their first point ID.
+std::vector<PointRegion> ClusterPoints(
+    const std::vector<const Point3d*>& points,
+    const double voxel_size);
+
+} // namespace mercator
+
+#endif // MERCATOR_CLUSTERING_H_
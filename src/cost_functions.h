@@ -70,7 +70,7 @@ class ReprojectionCostFunction {
 
     // Compute residuals
     residuals[0] = image[0] - T(x_);
-    residuals[1] = image[0] - T(y_);
+    residuals[1] = image[1] - T(y_);
 
     return true;
   }
@@ -98,6 +98,119 @@ class ReprojectionCostFunction {
   const std::vector<double> params_;
 };
 
+// Cost function that evaluates every observation of a single 3D point in one
+// residual block. Each observation contributes two residuals, so a point with
+// N observations has 2N residuals and a single 3 dimensional parameter block.
+// The Jacobian is computed analytically. The pose and intrinsics of every
+// observation are stored contiguously so that evaluation is a single pass
+// over one array.
+class PointReprojectionCostFunction : public ceres::CostFunction {
+ public:
+  PointReprojectionCostFunction()
+  {
+    mutable_parameter_block_sizes()->push_back(3);
+    set_num_residuals(0);
+  }
+
+  void AddObservation(const Camera& camera,
+                      const Eigen::Matrix3d& R,
+                      const Eigen::Vector3d& trans,
+                      const Eigen::Vector2d& xy)
+  {
+    const std::vector<double> params = camera.Params();
+
+    // Row-major rotation matrix
+    for (int r = 0; r < 3; ++r)
+    {
+      for (int c = 0; c < 3; ++c)
+      {
+        data_.push_back(R(r, c));
+      }
+    }
+    data_.insert(data_.end(), trans.data(), trans.data() + 3);
+    data_.insert(data_.end(), params.begin(), params.begin() + 4);
+    data_.push_back(xy(0));
+    data_.push_back(xy(1));
+
+    set_num_residuals(num_residuals() + 2);
+  }
+
+  size_t NumObservations() const { return data_.size() / kStride; }
+
+  bool Evaluate(double const* const* parameters,
+                double* residuals,
+                double** jacobians) const override
+  {
+    const double* const world = parameters[0];
+    double* jacobian = (jacobians != nullptr) ? jacobians[0] : nullptr;
+
+    const double* obs = data_.data();
+    const double* const end = obs + data_.size();
+    for (; obs != end; obs += kStride, residuals += 2)
+    {
+      const double* const R = obs;
+      const double* const t = obs + 9;
+      const double f = obs[12];
+      const double cx = obs[13];
+      const double cy = obs[14];
+      const double k = obs[15];
+
+      const double X = R[0] * world[0] + R[1] * world[1] + R[2] * world[2]
+        + t[0];
+      const double Y = R[3] * world[0] + R[4] * world[1] + R[5] * world[2]
+        + t[1];
+      const double Z = R[6] * world[0] + R[7] * world[1] + R[8] * world[2]
+        + t[2];
+
+      // Normalize to image plane and apply radial distortion, as in
+      // Camera::WorldToImage
+      const double inv_z = 1.0 / Z;
+      const double xp = X * inv_z;
+      const double yp = Y * inv_z;
+      const double r2 = xp * xp + yp * yp;
+      const double distortion = 1.0 + k * r2;
+
+      residuals[0] = f * distortion * xp + cx - obs[16];
+      residuals[1] = f * distortion * yp + cy - obs[17];
+
+      if (jacobian == nullptr)
+      {
+        continue;
+      }
+
+      // Derivative of the image point w.r.t. the normalized coordinates
+      const double du_dxp = f * (distortion + 2.0 * k * xp * xp);
+      const double du_dyp = f * 2.0 * k * xp * yp;
+      const double dv_dxp = du_dyp;
+      const double dv_dyp = f * (distortion + 2.0 * k * yp * yp);
+
+      // Derivative of the image point w.r.t. the point in the camera frame
+      const double du_dX = du_dxp * inv_z;
+      const double du_dY = du_dyp * inv_z;
+      const double du_dZ = -(du_dxp * xp + du_dyp * yp) * inv_z;
+      const double dv_dX = dv_dxp * inv_z;
+      const double dv_dY = dv_dyp * inv_z;
+      const double dv_dZ = -(dv_dxp * xp + dv_dyp * yp) * inv_z;
+
+      // Chain with the rotation to get the derivative w.r.t. the world point
+      for (int c = 0; c < 3; ++c)
+      {
+        jacobian[c] = du_dX * R[c] + du_dY * R[3 + c] + du_dZ * R[6 + c];
+        jacobian[3 + c] = dv_dX * R[c] + dv_dY * R[3 + c] + dv_dZ * R[6 + c];
+      }
+      jacobian += 6;
+    }
+
+    return true;
+  }
+
+ private:
+  // Rotation (9), translation (3), intrinsics (4) and observation (2)
+  static const size_t kStride = 18;
+
+  std::vector<double> data_;
+};
+
 } // namespace mercator
 
 #endif // MERCATOR_COST_FUNCTIONS_H_
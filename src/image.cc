@@ -21,12 +21,17 @@
 // Author: Greg Anders
 
 #include "image.h"
+#include "util/types.h"
 
 namespace mercator {
 
 Image::Image() : image_id_(-1),
                  camera_id_(-1),
-                 num_points3d_(0) {}
+                 num_points3d_(0),
+                 rotation_(Eigen::Quaterniond::Identity()),
+                 translation_(Eigen::Vector3d::Zero()),
+                 rotation_matrix_(Eigen::Matrix3d::Identity()),
+                 projection_center_(Eigen::Vector3d::Zero()) {}
 
 uint32_t Image::ImageId() const { return image_id_; }
 
@@ -52,15 +57,33 @@ void Image::SetNumPoints3d(const uint32_t num_points_3d) { num_points3d_ = num_p
 
 const Eigen::Quaterniond& Image::Rotation() const { return rotation_; }
 
-Eigen::Quaterniond& Image::Rotation() { return rotation_; }
-
-void Image::SetRotation(const Eigen::Quaterniond& rotation) { rotation_ = rotation; }
+void Image::SetRotation(const Eigen::Quaterniond& rotation)
+{
+  rotation_ = rotation;
+  UpdatePose();
+}
 
 const Eigen::Vector3d& Image::Translation() const { return translation_; }
 
-Eigen::Vector3d& Image::Translation() { return translation_; }
+void Image::SetTranslation(const Eigen::Vector3d& translation)
+{
+  translation_ = translation;
+  UpdatePose();
+}
+
+const Eigen::Matrix3d& Image::RotationMatrix() const { return rotation_matrix_; }
 
-void Image::SetTranslation(const Eigen::Vector3d& translation) { translation_ = translation; }
+const Eigen::Vector3d& Image::ProjectionCenter() const
+{
+  return projection_center_;
+}
+
+// Refresh the rotation matrix and projection center from the current pose
+void Image::UpdatePose()
+{
+  rotation_matrix_ = rotation_.toRotationMatrix();
+  projection_center_ = -rotation_matrix_.transpose() * translation_;
+}
 
 const std::vector<Point2d>& Image::Points2d() const { return points2d_; }
 
@@ -71,9 +94,18 @@ void Image::SetPoints2d(const std::vector<Point2d>& points2d) { points2d_ = poin
 uint32_t Image::NumPoints2d() const { return points2d_.size(); }
 
 // Transform a 3D world point into the reference frame of this image
-Eigen::Vector3d Image::Transform(const Eigen::Vector3d& point3d)
+Eigen::Vector3d Image::Transform(const Eigen::Vector3d& point3d) const
 {
-  return rotation_ * point3d + translation_;
+  return rotation_matrix_ * point3d + translation_;
+}
+
+// Transform a batch of 3D world points, stored as the columns of a matrix,
+// into the reference frame of this image
+void Image::Transform(const Eigen::Matrix3Xd& points3d,
+                      Eigen::Matrix3Xd* points3d_local) const
+{
+  points3d_local->noalias() = rotation_matrix_ * points3d;
+  points3d_local->colwise() += translation_;
 }
 
 // Match a 3D world point to a 2D image point
@@ -87,4 +119,15 @@ void Image::SetPoint3dForPoint2d(const uint32_t point2d_idx,
   point2d.SetPoint3dId(point3d_id);
 }
 
+// Remove the match of a 2D image point
+void Image::ResetPoint3dForPoint2d(const uint32_t point2d_idx)
+{
+  Point2d& point2d = points2d_.at(point2d_idx);
+  if (point2d.HasPoint3d())
+  {
+    num_points3d_ -= 1;
+  }
+  point2d.SetPoint3dId(kInvalidPoint3dId);
+}
+
 } // namespace mercator
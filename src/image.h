@@ -52,24 +52,32 @@ class Image {
   uint32_t& NumPoints3d();
   void SetNumPoints3d(const uint32_t num_points_3d);
 
+  // The pose is only changed through the setters, which refresh the cached
+  // rotation matrix and projection center
   const Eigen::Quaterniond& Rotation() const;
-  Eigen::Quaterniond& Rotation();
   void SetRotation(const Eigen::Quaterniond& rotation);
 
   const Eigen::Vector3d& Translation() const;
-  Eigen::Vector3d& Translation();
   void SetTranslation(const Eigen::Vector3d& translation);
 
+  const Eigen::Matrix3d& RotationMatrix() const;
+  const Eigen::Vector3d& ProjectionCenter() const;
+
   const std::vector<Point2d>& Points2d() const;
   std::vector<Point2d>& Points2d();
   void SetPoints2d(const std::vector<Point2d>& points2d);
   uint32_t NumPoints2d() const;
 
-  Eigen::Vector3d Transform(const Eigen::Vector3d& point3d);
+  Eigen::Vector3d Transform(const Eigen::Vector3d& point3d) const;
+  void Transform(const Eigen::Matrix3Xd& points3d,
+                 Eigen::Matrix3Xd* points3d_local) const;
   void SetPoint3dForPoint2d(const uint32_t point2d_idx,
                             const uint64_t point3d_id);
+  void ResetPoint3dForPoint2d(const uint32_t point2d_idx);
 
  private:
+  void UpdatePose();
+
   // The unique ID of this image
   uint32_t image_id_;
 
@@ -88,6 +96,12 @@ class Image {
   // Translation from the world frame to the image frame
   Eigen::Vector3d translation_;
 
+  // Rotation matrix equivalent to rotation_
+  Eigen::Matrix3d rotation_matrix_;
+
+  // Position of the camera center in the world frame
+  Eigen::Vector3d projection_center_;
+
   // List of image points
   std::vector<Point2d> points2d_;
 };
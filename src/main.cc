@@ -0,0 +1,500 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+#include "util/colmap.h"
+#include "util/config.h"
+#include "util/hash.h"
+#include "util/logger.h"
+#include "util/memory.h"
+#include "util/report.h"
+#include "util/trace.h"
+
+#include "batch_planner.h"
+#include "model_index.h"
+#include "pipeline.h"
+#include "planner.h"
+#include "planner_service.h"
+#include "redundancy_analysis.h"
+#include "threshold_sweep.h"
+#include "tiled_planner.h"
+
+using namespace mercator;
+
+namespace {
+
+// Levels of the hierarchy of an index when the configuration does not use one
+const int kDefaultIndexLevels = 8;
+
+// Images listed in the log by mercator redundancy, the others are only
+// written to the ranking file
+const size_t kRedundancySummaryImages = 20;
+
+bool IsModelIndex(const std::string& path)
+{
+  const std::string extension = ".mercidx";
+  return path.size() >= extension.size() &&
+    path.compare(path.size() - extension.size(), extension.size(),
+                 extension) == 0;
+}
+
+// mercator index: read a COLMAP model and write its index
+int WriteModelIndex(const ConfigManager& config, const Logger& logger)
+{
+  RunReport report;
+
+  ColmapReader reader;
+  {
+    ScopedTimer timer(&report, "read");
+    if (!reader.Read(config.model_path))
+    {
+      logger.Error("Something went wrong while trying to read COLMAP files");
+      return 1;
+    }
+  }
+
+  PointHierarchy hierarchy;
+  {
+    ScopedTimer timer(&report, "hierarchy");
+    hierarchy.Build(reader.Points(), config.lod_voxel_size,
+                    config.lod_levels > 0 ? config.lod_levels
+                                          : kDefaultIndexLevels);
+  }
+
+  {
+    ScopedTimer timer(&report, "write_index");
+    if (!ModelIndex::Write(reader, hierarchy, reader.ModelHash(),
+                           config.index_path))
+    {
+      logger.Error() << "Failed to write model index: " << config.index_path
+                     << std::endl;
+      return 1;
+    }
+  }
+
+  logger.Info() << "Indexed " << reader.Points().size() << " points and "
+                << reader.Images().size() << " images into "
+                << config.index_path << " (read "
+                << report.Timing("read").total << " s, hierarchy "
+                << report.Timing("hierarchy").total << " s, write "
+                << report.Timing("write_index").total << " s)" << std::endl;
+
+  return 0;
+}
+
+// mercator batch: plan every model of a list on one pool of threads
+int PlanBatch(const ConfigManager& config, const Logger& logger)
+{
+  std::vector<std::string> paths;
+  if (!BatchPlanner::ReadList(config.model_path, &paths))
+  {
+    return 1;
+  }
+
+  BatchPlanner::Options options;
+  options.num_threads = config.num_threads;
+  options.memory_limit =
+    static_cast<size_t>(config.memory_limit * 1024 * 1024);
+
+  BatchPlanner batch(options, Planner::Options(config), logger);
+  const bool ok = batch.Run(paths);
+
+  logger.Log(batch.Summary());
+
+  return ok ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  google::InitGoogleLogging(argv[0]);
+
+  ConfigManager config;
+
+  if (!config.ReadCommandLine(argc, argv))
+  {
+    return 1;
+  }
+
+  Logger logger;
+
+  if (!config.ReadConfigFile(config.config_path))
+  {
+    logger.Error() << "Failed to read config file: " << config.config_path
+                   << std::endl;
+    return 1;
+  }
+
+  logger.SetLogLevel(static_cast<Logger::LogLevel>(config.log_level));
+
+  logger.Debug(config.PrintOptions());
+
+  if (!config.trace_path.empty())
+  {
+    Tracer::Instance().Enable();
+    Tracer::Instance().SetThreadName("main");
+  }
+
+  if (config.command == "index")
+  {
+    return WriteModelIndex(config, logger);
+  }
+  else if (config.command == "batch")
+  {
+    return PlanBatch(config, logger);
+  }
+
+  // Only planning uses the pipeline and the result cache
+  const bool serve = config.command == "serve";
+  const bool sweep = config.command == "sweep";
+  const bool redundancy = config.command == "redundancy";
+  if (!config.command.empty() && config.pipeline)
+  {
+    logger.Error() << "The pipeline cannot be used by mercator "
+                   << config.command << std::endl;
+    return 1;
+  }
+
+  // Tiled planning runs this program again for every tile, with the tile
+  // given by --tile
+  const bool tiled = config.tile_size > 0;
+  const bool tile_worker = !config.tile.empty();
+  Tile tile;
+  if (tile_worker && !Tile::Parse(config.tile, &tile))
+  {
+    logger.Error() << "Invalid tile: " << config.tile << std::endl;
+    return 1;
+  }
+  if ((tiled || tile_worker) && config.pipeline)
+  {
+    logger.Error("The pipeline cannot be used to plan in tiles");
+    return 1;
+  }
+
+  // A model index replaces the COLMAP files, including their hash
+  ModelIndex index;
+  const bool use_index = IsModelIndex(config.model_path);
+  if (use_index)
+  {
+    if (config.pipeline)
+    {
+      logger.Error("The pipeline reads COLMAP files, not a model index");
+      return 1;
+    }
+
+    if (!index.Open(config.model_path))
+    {
+      return 1;
+    }
+  }
+
+  ColmapReader reader;
+  Planner planner(Planner::Options(config), logger, &reader);
+
+  // A worker only reads the images and points its tile needs
+  std::vector<uint32_t> tile_image_ids;
+  std::vector<uint64_t> tile_point3d_ids;
+  if (tile_worker)
+  {
+    if (!TiledPlanner::ReadSubset(config.tile_input, &tile_image_ids,
+                                  &tile_point3d_ids))
+    {
+      logger.Error() << "Failed to read tile subset: " << config.tile_input
+                     << std::endl;
+      return 1;
+    }
+
+    reader.SetFilter(
+        [&tile_image_ids](const uint32_t image_id)
+        {
+          return std::binary_search(tile_image_ids.begin(),
+                                    tile_image_ids.end(), image_id);
+        },
+        [&tile_point3d_ids](const uint64_t point3d_id)
+        {
+          return std::binary_search(tile_point3d_ids.begin(),
+                                    tile_point3d_ids.end(), point3d_id);
+        });
+  }
+
+  // Memory is only probed for the report
+  planner.Report().SetMemoryProbes(!config.report_path.empty());
+
+  ProblemCorpusWriter corpus_writer;
+  if (!config.capture_path.empty())
+  {
+    if (!corpus_writer.Open(config.capture_path))
+    {
+      logger.Error() << "Failed to create corpus: " << config.capture_path
+                     << std::endl;
+      return 1;
+    }
+    planner.SetCorpusWriter(&corpus_writer);
+  }
+
+  // The cache file is named after the configuration, and its contents are
+  // matched against the model
+  ResultCache result_cache;
+  const bool use_cache = !config.cache_dir.empty() && config.command.empty() &&
+    !config.pipeline && !tiled && !tile_worker;
+  if (!config.cache_dir.empty() && !use_cache)
+  {
+    logger.Warn(!config.command.empty()
+                ? "The result cache is only used to plan"
+                : config.pipeline
+                  ? "The result cache is not used by the pipeline"
+                  : "The result cache is not used to plan in tiles");
+  }
+  else if (use_cache)
+  {
+    const Planner::Options& options = planner.PlannerOptions();
+    const std::string cache_path = config.cache_dir + "/"
+      + HashToString(options.Hash()) + ".mercache";
+
+    if (!result_cache.Open(cache_path, options.Hash()))
+    {
+      logger.Error() << "Failed to read result cache: " << cache_path
+                     << std::endl;
+      return 1;
+    }
+
+    reader.SetComputeUncertainty(false);
+    planner.SetResultCache(&result_cache);
+  }
+
+  if (config.pipeline)
+  {
+    PlanningPipeline pipeline(PlanningPipeline::Options(), &planner, &reader,
+                              logger);
+    if (!pipeline.Run(config.model_path))
+    {
+      logger.Error("Something went wrong while trying to read COLMAP files");
+      return 1;
+    }
+
+    logger.Info(pipeline.MetricsSummary());
+  }
+  else
+  {
+    bool read_ok;
+    {
+      ScopedTimer timer(&planner.Report(), "read");
+      ScopedMemoryProbe memory(&planner.Report(), "read");
+      read_ok = use_index
+        ? reader.ReadIndex(index) : reader.Read(config.model_path);
+    }
+
+    if (!read_ok)
+    {
+      logger.Error("Something went wrong while trying to read COLMAP files");
+      return 1;
+    }
+
+    // The model is hashed while it is read
+    if (use_cache)
+    {
+      result_cache.SetModelHash(reader.ModelHash());
+      logger.Info() << "Result cache has " << result_cache.NumCachedPoints()
+                    << " points and " << result_cache.NumCachedRegions()
+                    << " regions"
+                    << (result_cache.ModelUnchanged() ? ", model unchanged"
+                                                      : "")
+                    << std::endl;
+    }
+
+    // A worker plans the regions of its tile
+    if (tile_worker)
+    {
+      TiledPlanner tiled_planner(TiledPlanner::Options(), &planner, &reader,
+                                 logger);
+      return tiled_planner.PlanTile(tile, config.tile_output) ? 0 : 1;
+    }
+
+    // Rank the images by what the points they observe would lose without
+    // them
+    if (redundancy)
+    {
+      RedundancyAnalysis::Options options;
+      options.uncertainty_threshold =
+        planner.PlannerOptions().uncertainty_threshold;
+      options.min_cameras = planner.PlannerOptions().min_cameras;
+      options.pixel_sigma = config.pixel_sigma;
+      options.num_threads = config.num_threads;
+
+      RedundancyAnalysis analysis(options, reader);
+      analysis.Run();
+      logger.Log(analysis.Summary(kRedundancySummaryImages));
+
+      if (analysis.NumInconsistent() > 0)
+      {
+        logger.Warn() << analysis.NumInconsistent() << " observations hold "
+                      << "more information than the covariance of their "
+                      << "point. The covariances may not have been estimated "
+                      << "with a pixel noise of " << config.pixel_sigma
+                      << " (--pixel-sigma)." << std::endl;
+      }
+
+      if (!config.ranking_path.empty() &&
+          !analysis.Write(config.ranking_path))
+      {
+        logger.Error() << "Failed to write redundancy ranking: "
+                       << config.ranking_path << std::endl;
+        return 1;
+      }
+      return 0;
+    }
+
+    // Plan with every combination of thresholds, sharing the candidates
+    if (sweep)
+    {
+      const Planner::Options& planner_options = planner.PlannerOptions();
+
+      ThresholdSweep::Options options;
+      options.uncertainty_thresholds = config.sweep_uncertainty_thresholds;
+      if (options.uncertainty_thresholds.empty())
+      {
+        options.uncertainty_thresholds.push_back(
+            planner_options.uncertainty_threshold);
+      }
+      options.min_cameras = config.sweep_min_cameras;
+      if (options.min_cameras.empty())
+      {
+        options.min_cameras.push_back(planner_options.min_cameras);
+      }
+      options.min_ground_sampling_distances =
+        config.sweep_min_ground_sampling_distances;
+      if (options.min_ground_sampling_distances.empty())
+      {
+        options.min_ground_sampling_distances.push_back(
+            planner_options.min_ground_sampling_distance);
+      }
+
+      ThresholdSweep threshold_sweep(options, planner_options, &reader,
+                                     logger);
+      threshold_sweep.Run();
+      logger.Log(threshold_sweep.Summary());
+      return 0;
+    }
+
+    // The hierarchy of the index is only used if it was built with the
+    // configured voxel size and number of levels
+    PointHierarchy hierarchy;
+    if (use_index && config.lod_levels > 0 &&
+        index.ReadHierarchy(&hierarchy) &&
+        hierarchy.NumLevels() == config.lod_levels &&
+        hierarchy.VoxelSize(0) == config.lod_voxel_size)
+    {
+      planner.SetPointHierarchy(std::move(hierarchy));
+    }
+
+    // Keep the model loaded and plan on request instead of once
+    if (serve)
+    {
+      PlannerService service(&planner, &reader, logger);
+      return service.Listen(config.socket_path) ? 0 : 1;
+    }
+
+    if (tiled)
+    {
+      TiledPlanner::Options options;
+      options.tile_size = config.tile_size;
+      options.num_workers = config.num_workers;
+
+      // Workers read the same model with the same configuration and time
+      // budget
+      std::vector<std::string> worker_args = {
+        argv[0], "--config", config.config_path,
+        "--time-budget", std::to_string(config.time_budget),
+        config.model_path };
+
+      TiledPlanner tiled_planner(options, &planner, &reader, logger);
+      if (!tiled_planner.Run(worker_args))
+      {
+        logger.Error("Planning in tiles failed");
+        return 1;
+      }
+    }
+    else
+    {
+      planner.Run();
+    }
+
+    if (use_cache && !result_cache.Save())
+    {
+      logger.Warn("Failed to save the result cache");
+    }
+  }
+
+  MERCATOR_DEBUG(logger) << "Successfully imported "
+    << reader.Points().size() << " points, "
+    << reader.Cameras().size() << " cameras, "
+    << reader.Images().size() << " images."
+    << std::endl;
+
+  logger.Info() << "Planned " << planner.VirtualCameras().size()
+                << " virtual cameras" << std::endl;
+
+  if (!config.capture_path.empty())
+  {
+    logger.Info() << "Captured " << corpus_writer.NumProblems()
+                  << " bundle adjustments to " << config.capture_path
+                  << std::endl;
+  }
+
+  if (planner.SolverStats().NumProblems() > 0)
+  {
+    logger.Info(planner.SolverStats().ToString());
+  }
+
+  if (!config.report_path.empty())
+  {
+    planner.SolverStats().AddToReport(&planner.Report());
+    AddMemoryToReport(&planner.Report());
+    for (const auto& usage : reader.MemoryUsage())
+    {
+      planner.Report().SetValue("memory/reader/" + usage.first + "_bytes",
+                                usage.second);
+    }
+    planner.Report().AddCount("virtual_cameras",
+                              planner.VirtualCameras().size());
+    if (!planner.Report().Write(config.report_path))
+    {
+      logger.Error() << "Failed to write report: " << config.report_path
+                     << std::endl;
+      return 1;
+    }
+  }
+
+  if (!config.trace_path.empty() &&
+      !Tracer::Instance().Write(config.trace_path))
+  {
+    logger.Error() << "Failed to write trace: " << config.trace_path
+                   << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
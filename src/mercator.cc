@@ -20,199 +20,16 @@
 //
 // Author: Greg Anders
 
-#include <algorithm>
 #include <cmath>
-#include <iostream>
 
 #include <Eigen/Core>
 #include <Eigen/Eigenvalues>
 
-#include "util/colmap.h"
-#include "util/config.h"
-#include "util/logger.h"
-
 #include "mercator.h"
-#include "bundle_adjustment.h"
+#include "point2d.h"
 
 using namespace mercator;
 
-int main(int argc, char* argv[])
-{
-  google::InitGoogleLogging(argv[0]);
-
-  if (argc != 2)
-  {
-    std::cerr << "Usage: " << argv[0] << " <path>" << std::endl;
-    return 1;
-  }
-
-  Logger logger;
-
-  const std::string config_file = "config.ini";
-
-  ConfigManager config;
-
-  if (!config.ReadConfigFile(config_file))
-  {
-    logger.Error() << "Failed to read config file: " << config_file
-                   << std::endl;
-    return 1;
-  }
-
-  logger.SetLogLevel(static_cast<Logger::LogLevel>(config.log_level));
-
-  logger.Debug(config.PrintOptions());
-
-  BundleAdjustment::Options ba_options;
-
-  ColmapReader reader;
-
-  if (reader.Read(argv[1]))
-  {
-    logger.Debug() << "Successfully imported "
-      << reader.Points().size() << " points, "
-      << reader.Cameras().size() << " cameras, "
-      << reader.Images().size() << " images."
-      << std::endl;
-
-    auto& cameras = reader.Cameras();
-    if (cameras.size() > 1)
-    {
-      logger.Warn("More than one camera found! Defaulting to the first.");
-    }
-
-    Camera& camera = cameras.begin()->second;
-
-    // This information is not provided by COLMAP so the user must supply it
-    camera.SetPixelSize(config.camera_pixel_size);
-
-    std::vector<Image> virt_cameras;
-
-    // Iterate over each point
-    for (auto& point : reader.Points())
-    {
-      const size_t num_cameras = point.second.ImageIds().size();
-
-      // If the maximum eigenvalue of the covariance matrix is less than the
-      // threshold specified by the user, skip this point
-      if (point.second.Uncertainty() < config.uncertainty_threshold &&
-          num_cameras >= config.min_cameras)
-      {
-        logger.Debug() << "Point " << point.second.Point3dId()
-                       << " is already covered, skipping..." << std::endl;
-        point.second.SetCovered(true);
-        continue;
-      }
-
-      const uint64_t point3d_id = point.second.Point3dId();
-      const Eigen::Vector3d& xyz = point.second.Coords();
-
-      logger.Debug() << "Using point " << point3d_id << std::endl;
-
-      // Otherwise, prepare for a new bundle adjustment
-      BundleAdjustment ba(ba_options);
-      ba.AddCamera(camera);
-      ba.AddPoint(point.second);
-
-      // Add every other image that sees this point
-      for (const auto image_id : point.second.ImageIds())
-      {
-        logger.Debug() << "Point " << point3d_id << " sees image " << image_id
-                       << ", adding to bundle adjustment..." << std::endl;
-
-        const Image& image = reader.Image(image_id);
-        ba.AddImage(image);
-      }
-
-      Image new_image;
-      new_image.SetCameraId(camera.CameraId());
-
-      CreateVirtualCameraForPoint(
-          point.second,
-          camera,
-          config.min_ground_sampling_distance,
-          0,
-          &new_image);
-
-      if (!ProjectPointOntoImage(point.second, camera, &new_image))
-      {
-        logger.Warn("Projecting point onto virtual image failed!");
-        continue;
-      }
-
-      for (const auto& other_point : reader.Points())
-      {
-        if (other_point.second.Point3dId() == point3d_id)
-        {
-          continue;
-        }
-
-        // If this point is visible in any of the images in the bundle
-        // adjustment, add it to the BA
-        const auto& image_ids = other_point.second.ImageIds();
-        if (std::any_of(image_ids.begin(), image_ids.end(),
-              [&ba](uint32_t image_id) { return ba.HasImage(image_id); }))
-        {
-          logger.Debug() << "Adding point " << other_point.second.Point3dId()
-                         << std::endl;
-          ba.AddPoint(other_point.second);
-        }
-        // Otherwise, if the projection of this point onto our virtual camera
-        // exists in the virtual camera's frame, add it to the BA
-        else if (ProjectPointOntoImage(other_point.second, camera, &new_image))
-        {
-          logger.Debug() << "Adding point " << other_point.second.Point3dId()
-                         << std::endl;
-          ba.AddPoint(other_point.second);
-        }
-      }
-
-      // Add our new virtual camera to the bundle adjustment
-      ba.AddImage(new_image);
-
-      // Start the bundle adjustment
-      logger.Info() << "Starting bundle adjustment with "
-                    << ba.Points().size() << " points and "
-                    << ba.Images().size() << " images" << std::endl;
-      ba.Run();
-
-      // Compute covariance
-      std::vector<uint64_t> point3d_ids = { point3d_id };
-      ba.ComputeCovariance();
-
-      const auto& post_ba_point = ba.Points().at(point3d_id);
-
-      std::cout << "Old uncertainty: " << point.second.Uncertainty() << std::endl;
-      std::cout << "New uncertainty: " << post_ba_point.Uncertainty() << std::endl;
-
-      if (post_ba_point.Uncertainty() < point.second.Uncertainty())
-      {
-        logger.Info("Adding new image to virtual cameras list");
-        virt_cameras.push_back(new_image);
-      }
-      else
-      {
-        logger.Debug("Virtual camera did not provide enough new information,"
-            " skipping...");
-      }
-
-      if (config.print_ba_summary > 0)
-      {
-        ba.PrintSummary(config.print_ba_summary == 2);
-      }
-
-      break;
-    }
-  }
-  else
-  {
-    logger.Error("Something went wrong while trying to read COLMAP files");
-    return 1;
-  }
-
-  return 0;
-}
-
 // Calculate the ground sampling distance of an image taken from a given
 // distance. Function inputs are the pixel size of the camera (in mm), the
 // camera focal length (in mm), and the camera's distance from the object
@@ -245,15 +62,34 @@ void CreateVirtualCameraForPoint(const Point3d& point3d,
                                  const double angle,
                                  Image* image)
 {
-  Eigen::EigenSolver<Eigen::Matrix3d> es(point3d.Covariance(), true);
+  CreateVirtualCameraForRegion(point3d.Coords(),
+                               point3d.Covariance(),
+                               camera,
+                               gsd,
+                               angle,
+                               image);
+}
+
+// Calculate the rotation and translation of an imaginary camera looking at a
+// region centered at the given position, located along the eigenvector
+// corresponding to the minimum eigenvalue of the region's covariance, with an
+// optional angle offset.
+void CreateVirtualCameraForRegion(const Eigen::Vector3d& center,
+                                  const Eigen::Matrix3d& covariance,
+                                  const Camera& camera,
+                                  const double gsd,
+                                  const double angle,
+                                  Image* image)
+{
+  Eigen::EigenSolver<Eigen::Matrix3d> es(covariance, true);
 
   // Find eigenvector corresponding to smallest eigenvalue
-  const auto& eigenvals = es.eigenvalues().real();
-  const auto& eigenvecs = es.eigenvectors().real();
+  const Eigen::Vector3d eigenvals = es.eigenvalues().real();
+  const Eigen::Matrix3d eigenvecs = es.eigenvectors().real();
 
   Eigen::Vector3d::Index idx;
   eigenvals.minCoeff(&idx);
-  const Eigen::Vector3d& min_eigenvec = eigenvecs.col(idx);
+  const Eigen::Vector3d min_eigenvec = eigenvecs.col(idx);
 
   // Calculate the maximum distance the camera can be from the point while
   // still meeting the ground sampling distance criteria
@@ -266,7 +102,7 @@ void CreateVirtualCameraForPoint(const Point3d& point3d,
 
   // If following this vector the requisite distance puts us below ground
   // level then move in the other direction
-  if ((point3d.Coords() + distance * v)(2) <= 0)
+  if ((center + distance * v)(2) <= 0)
   {
     v *= -1;
   }
@@ -281,7 +117,7 @@ void CreateVirtualCameraForPoint(const Point3d& point3d,
   Eigen::Quaterniond q(aa);
   q.normalize();
 
-  const Eigen::Vector3d T = q * (-point3d.Coords() + distance * v);
+  const Eigen::Vector3d T = q * (-center + distance * v);
 
   image->SetRotation(q);
   image->SetTranslation(T);
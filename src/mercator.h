@@ -23,6 +23,8 @@
 #ifndef MERCATOR_H_
 #define MERCATOR_H_
 
+#include <Eigen/Core>
+
 #include "image.h"
 #include "point3d.h"
 
@@ -40,6 +42,13 @@ void CreateVirtualCameraForPoint(const mercator::Point3d& point3d,
                                  const double angle,
                                  mercator::Image* image);
 
+void CreateVirtualCameraForRegion(const Eigen::Vector3d& center,
+                                  const Eigen::Matrix3d& covariance,
+                                  const mercator::Camera& camera,
+                                  const double gsd,
+                                  const double angle,
+                                  mercator::Image* image);
+
 bool ProjectPointOntoImage(const mercator::Point3d& point3d,
                            const mercator::Camera& camera,
                            mercator::Image* image);
@@ -0,0 +1,111 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include "model_delta.h"
+#include "util/colmap.h"
+
+namespace mercator {
+
+namespace {
+
+// Image ID and 2D point index of every observation of a point
+std::vector<std::pair<uint32_t, uint32_t>> TrackOf(const ColmapReader& reader,
+                                                   const uint64_t point3d_id)
+{
+  const ObservationStore& observations = reader.Observations();
+  std::vector<std::pair<uint32_t, uint32_t>> track;
+  for (const auto& observation : observations.TrackForPoint(point3d_id))
+  {
+    track.emplace_back(observations.ImageId(observation.image_idx),
+                       observation.point2d_idx);
+  }
+  return track;
+}
+
+bool SamePoints2d(const Image& a, const Image& b)
+{
+  if (a.NumPoints2d() != b.NumPoints2d())
+  {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < a.NumPoints2d(); ++i)
+  {
+    const Point2d& point_a = a.Points2d()[i];
+    const Point2d& point_b = b.Points2d()[i];
+    if (point_a.Coords() != point_b.Coords() ||
+        point_a.Point3dId() != point_b.Point3dId())
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+} // namespace
+
+bool ModelDelta::Empty() const
+{
+  return images.empty() && points.empty() && covariances.empty();
+}
+
+ModelDelta ModelDelta::Diff(const ColmapReader& current,
+                            const ColmapReader& updated)
+{
+  ModelDelta delta;
+
+  for (const auto& entry : updated.Images())
+  {
+    const Image& image = entry.second;
+    const auto it = current.Images().find(entry.first);
+    if (it == current.Images().end() ||
+        it->second.CameraId() != image.CameraId() ||
+        it->second.Rotation().coeffs() != image.Rotation().coeffs() ||
+        it->second.Translation() != image.Translation() ||
+        !SamePoints2d(it->second, image))
+    {
+      delta.images.push_back(image);
+    }
+  }
+
+  for (const auto& entry : updated.Points())
+  {
+    const Point3d& point = entry.second;
+    const auto it = current.Points().find(entry.first);
+    if (it == current.Points().end() ||
+        it->second.Coords() != point.Coords() ||
+        it->second.Color() != point.Color() ||
+        TrackOf(current, entry.first) != TrackOf(updated, entry.first))
+    {
+      delta.points.push_back({ point, TrackOf(updated, entry.first) });
+    }
+    else if (it->second.Covariance() != point.Covariance())
+    {
+      delta.covariances.push_back({ entry.first, point.Covariance() });
+    }
+  }
+
+  return delta;
+}
+
+} // namespace mercator
@@ -0,0 +1,76 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_MODEL_DELTA_H_
+#define MERCATOR_MODEL_DELTA_H_
+
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "image.h"
+#include "point3d.h"
+
+namespace mercator {
+
+class ColmapReader;
+
+// Changes to a reconstruction that has already been loaded, applied with
+// ColmapReader::ApplyDelta. Points and images cannot be removed.
+struct ModelDelta {
+  struct PointUpdate {
+    // Coordinates, color, covariance and image IDs of the point
+    Point3d point;
+
+    // Image ID and 2D point index of every observation of the point
+    std::vector<std::pair<uint32_t, uint32_t>> track;
+  };
+
+  struct CovarianceUpdate {
+    uint64_t point3d_id;
+    Eigen::Matrix3d covariance;
+  };
+
+  // New images, and images whose pose or 2D points changed. Their cameras
+  // must already be loaded.
+  std::vector<Image> images;
+
+  // New points, and points whose position, color or track changed
+  std::vector<PointUpdate> points;
+
+  // Points of which only the covariance changed
+  std::vector<CovarianceUpdate> covariances;
+
+  bool Empty() const;
+
+  // Everything in updated that is not in current or differs from it, e.g.
+  // after COLMAP was run again with new images. Images and points of current
+  // that are missing from updated are left as they are, so updated may hold
+  // only part of the model.
+  static ModelDelta Diff(const ColmapReader& current,
+                         const ColmapReader& updated);
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_MODEL_DELTA_H_
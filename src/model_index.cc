@@ -0,0 +1,582 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "model_index.h"
+#include "util/colmap.h"
+
+namespace mercator {
+
+namespace {
+
+// Identifies index files
+const char kIndexMagic[8] = { 'M', 'E', 'R', 'C', 'I', 'D', 'X', '\0' };
+
+// Written as a native integer to detect indexes of the other byte order
+const uint64_t kByteOrderMark = 0x0102030405060708ULL;
+
+// Alignment of the sections, one cache line
+const size_t kSectionAlignment = 64;
+
+// Writes the sections of an index one after the other and fills in the
+// section table at the end
+class IndexWriter {
+ public:
+  IndexWriter(const std::string& path, const size_t header_size)
+    : buffer_(1 << 20), offsets_(ModelIndex::NUM_SECTIONS),
+      sizes_(ModelIndex::NUM_SECTIONS)
+  {
+    file_.rdbuf()->pubsetbuf(buffer_.data(), buffer_.size());
+    file_.open(path, std::ios::binary | std::ios::trunc);
+    const std::vector<char> header(header_size, 0);
+    file_.write(header.data(), header.size());
+    position_ = header_size;
+  }
+
+  bool IsOpen() const { return file_.is_open(); }
+
+  void BeginSection(const ModelIndex::Section section)
+  {
+    const size_t padding =
+      (kSectionAlignment - position_ % kSectionAlignment) % kSectionAlignment;
+    const char zeros[kSectionAlignment] = {};
+    file_.write(zeros, padding);
+    position_ += padding;
+
+    section_ = section;
+    offsets_[section] = position_;
+  }
+
+  void Write(const void* data, const size_t size)
+  {
+    file_.write(static_cast<const char*>(data), size);
+    position_ += size;
+    sizes_[section_] = position_ - offsets_[section_];
+  }
+
+  template<typename T>
+  void Write(const T& value)
+  {
+    Write(&value, sizeof(T));
+  }
+
+  std::ofstream& File() { return file_; }
+  const std::vector<uint64_t>& Offsets() const { return offsets_; }
+  const std::vector<uint64_t>& Sizes() const { return sizes_; }
+
+ private:
+  std::vector<char> buffer_;
+  std::ofstream file_;
+  size_t position_ = 0;
+  ModelIndex::Section section_ = ModelIndex::CAMERAS;
+  std::vector<uint64_t> offsets_;
+  std::vector<uint64_t> sizes_;
+};
+
+} // namespace
+
+ModelIndex::ModelIndex()
+  : data_(nullptr), size_(0), header_(nullptr), sections_(nullptr) {}
+
+ModelIndex::~ModelIndex() { Close(); }
+
+bool ModelIndex::Write(const ColmapReader& reader,
+                       const PointHierarchy& hierarchy,
+                       const uint64_t model_hash,
+                       const std::string& path)
+{
+  const ObservationStore& observations = reader.Observations();
+  const size_t num_images = observations.NumImages();
+  const size_t num_points = observations.NumPoints();
+
+  // Points in the order of their tracks
+  std::vector<const Point3d*> points(num_points);
+  for (size_t i = 0; i < num_points; ++i)
+  {
+    points[i] = &reader.Points().at(observations.Point3dId(i));
+  }
+
+  IndexWriter writer(path,
+                     sizeof(Header) + NUM_SECTIONS * sizeof(SectionEntry));
+  if (!writer.IsOpen())
+  {
+    std::cerr << "Could not open file " << path << std::endl;
+    return false;
+  }
+
+  writer.BeginSection(CAMERAS);
+  for (const auto& camera : reader.Cameras())
+  {
+    CameraRecord record = {};
+    record.camera_id = camera.first;
+    record.width = camera.second.Width();
+    record.height = camera.second.Height();
+    const std::vector<double> params = camera.second.Params();
+    std::copy(params.begin(),
+              params.begin() + std::min<size_t>(params.size(), 4),
+              record.params);
+    writer.Write(record);
+  }
+
+  writer.BeginSection(IMAGES);
+  uint64_t name_offset = 0;
+  for (size_t i = 0; i < num_images; ++i)
+  {
+    const Image& image = reader.Images().at(observations.ImageId(i));
+    ImageRecord record = {};
+    record.image_id = image.ImageId();
+    record.camera_id = image.CameraId();
+    record.rotation[0] = image.Rotation().w();
+    record.rotation[1] = image.Rotation().x();
+    record.rotation[2] = image.Rotation().y();
+    record.rotation[3] = image.Rotation().z();
+    for (int j = 0; j < 3; ++j)
+    {
+      record.translation[j] = image.Translation()(j);
+    }
+    record.name_offset = name_offset;
+    record.name_size = image.Name().size();
+    name_offset += image.Name().size();
+    writer.Write(record);
+  }
+
+  writer.BeginSection(IMAGE_NAMES);
+  for (size_t i = 0; i < num_images; ++i)
+  {
+    const std::string& name = reader.Images().at(observations.ImageId(i)).Name();
+    writer.Write(name.data(), name.size());
+  }
+
+  writer.BeginSection(POINT_IDS);
+  for (const auto* point : points)
+  {
+    writer.Write(point->Point3dId());
+  }
+
+  writer.BeginSection(POINT_COORDS);
+  for (const auto* point : points)
+  {
+    writer.Write(point->Coords().data(), 3 * sizeof(double));
+  }
+
+  writer.BeginSection(POINT_COVARIANCES);
+  for (const auto* point : points)
+  {
+    const Eigen::Matrix3d covariance = point->Covariance();
+    writer.Write(covariance.data(), 9 * sizeof(double));
+  }
+
+  writer.BeginSection(POINT_UNCERTAINTIES);
+  for (const auto* point : points)
+  {
+    writer.Write(point->Uncertainty());
+  }
+
+  writer.BeginSection(POINT_COLORS);
+  for (const auto* point : points)
+  {
+    writer.Write(point->Color().data(), 3);
+  }
+
+  writer.BeginSection(TRACK_OFFSETS);
+  for (size_t i = 0; i <= num_points; ++i)
+  {
+    writer.Write<uint64_t>(observations.Offset(i));
+  }
+
+  writer.BeginSection(TRACK_OBSERVATIONS);
+  writer.Write(observations.Observations().begin(),
+               observations.NumObservations() * sizeof(Observation));
+
+  // Every 2D point of the images is kept, matched or not, so that the
+  // point2d_idx of the observations index into them as they do when the model
+  // is read from its files
+  std::vector<uint64_t> image_offsets(num_images + 1, 0);
+  for (size_t i = 0; i < num_images; ++i)
+  {
+    image_offsets[i + 1] = image_offsets[i] +
+      reader.Images().at(observations.ImageId(i)).NumPoints2d();
+  }
+
+  writer.BeginSection(IMAGE_POINT2D_OFFSETS);
+  writer.Write(image_offsets.data(), image_offsets.size() * sizeof(uint64_t));
+
+  writer.BeginSection(IMAGE_POINTS2D);
+  for (size_t i = 0; i < num_images; ++i)
+  {
+    const Image& image = reader.Images().at(observations.ImageId(i));
+    for (const auto& point2d : image.Points2d())
+    {
+      writer.Write(ImagePoint2d{ point2d.X(), point2d.Y(),
+                                 point2d.Point3dId() });
+    }
+  }
+
+  writer.BeginSection(HIERARCHY_LEVELS);
+  for (int level = 0; level < hierarchy.NumLevels(); ++level)
+  {
+    writer.Write(HierarchyLevel{ hierarchy.VoxelSize(level),
+                                 hierarchy.Level(level).size() });
+  }
+
+  writer.BeginSection(HIERARCHY_NODES);
+  for (int level = 0; level < hierarchy.NumLevels(); ++level)
+  {
+    writer.Write(hierarchy.Level(level).data(),
+                 hierarchy.Level(level).size() * sizeof(PointHierarchy::Node));
+  }
+
+  writer.BeginSection(HIERARCHY_POINT_IDS);
+  writer.Write(hierarchy.PointIds().data(),
+               hierarchy.PointIds().size() * sizeof(uint64_t));
+
+  // Fill in the header now that the sections are known
+  Header header = {};
+  std::memcpy(header.magic, kIndexMagic, sizeof(kIndexMagic));
+  header.version = kVersion;
+  header.num_sections = NUM_SECTIONS;
+  header.model_hash = model_hash;
+  header.byte_order = kByteOrderMark;
+
+  std::ofstream& file = writer.File();
+  file.seekp(0);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (size_t i = 0; i < NUM_SECTIONS; ++i)
+  {
+    const SectionEntry entry = { writer.Offsets()[i], writer.Sizes()[i] };
+    file.write(reinterpret_cast<const char*>(&entry), sizeof(entry));
+  }
+
+  file.flush();
+  if (!file.good())
+  {
+    std::cerr << "Could not write file " << path << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool ModelIndex::Open(const std::string& path)
+{
+  Close();
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    std::cerr << "Could not open file " << path << std::endl;
+    return false;
+  }
+
+  return Map(fd, path);
+}
+
+size_t ModelIndex::Size() const { return size_; }
+
+bool ModelIndex::Map(const int fd, const std::string& path)
+{
+  struct stat info;
+  if (fstat(fd, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < sizeof(Header))
+  {
+    std::cerr << path << " is not a model index" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  size_ = info.st_size;
+  data_ = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data_ == MAP_FAILED)
+  {
+    std::cerr << "Could not map file " << path << std::endl;
+    data_ = nullptr;
+    size_ = 0;
+    return false;
+  }
+
+  header_ = static_cast<const Header*>(data_);
+  sections_ = reinterpret_cast<const SectionEntry*>(header_ + 1);
+
+  if (std::memcmp(header_->magic, kIndexMagic, sizeof(kIndexMagic)) != 0)
+  {
+    std::cerr << path << " is not a model index" << std::endl;
+    Close();
+    return false;
+  }
+
+  if (header_->version != kVersion || header_->byte_order != kByteOrderMark ||
+      header_->num_sections != NUM_SECTIONS ||
+      size_ < sizeof(Header) + NUM_SECTIONS * sizeof(SectionEntry))
+  {
+    std::cerr << "Model index " << path << " was written by another version "
+              << "or on another platform, run mercator index again"
+              << std::endl;
+    Close();
+    return false;
+  }
+
+  for (size_t i = 0; i < NUM_SECTIONS; ++i)
+  {
+    if (sections_[i].offset % 8 != 0 || sections_[i].offset > size_ ||
+        sections_[i].size > size_ - sections_[i].offset)
+    {
+      std::cerr << "Model index " << path << " is truncated" << std::endl;
+      Close();
+      return false;
+    }
+  }
+
+  // The arrays of every point and image must agree on their number
+  const size_t num_points = NumPoints();
+  const size_t num_images = NumImages();
+  size_t num_track_offsets;
+  size_t num_image_offsets;
+  SectionData<uint64_t>(TRACK_OFFSETS, &num_track_offsets);
+  size_t num_points2d;
+  SectionData<uint64_t>(IMAGE_POINT2D_OFFSETS, &num_image_offsets);
+  SectionData<ImagePoint2d>(IMAGE_POINTS2D, &num_points2d);
+  const bool consistent =
+    sections_[POINT_COORDS].size == 3 * num_points * sizeof(double) &&
+    sections_[POINT_COVARIANCES].size == 9 * num_points * sizeof(double) &&
+    sections_[POINT_UNCERTAINTIES].size == num_points * sizeof(double) &&
+    sections_[POINT_COLORS].size == 3 * num_points &&
+    num_track_offsets == num_points + 1 &&
+    TrackOffsets()[num_points] == NumObservations() &&
+    num_image_offsets == num_images + 1 &&
+    ImagePoint2dOffsets()[num_images] == num_points2d;
+  if (!consistent || !Validate())
+  {
+    std::cerr << "Model index " << path << " is corrupt" << std::endl;
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+bool ModelIndex::Validate() const
+{
+  const size_t num_images = NumImages();
+  const uint64_t* track_offsets = TrackOffsets();
+  const uint64_t* image_offsets = ImagePoint2dOffsets();
+  size_t names_size;
+  SectionData<char>(IMAGE_NAMES, &names_size);
+
+  if (track_offsets[0] != 0 || image_offsets[0] != 0)
+  {
+    return false;
+  }
+  for (size_t i = 0; i < NumPoints(); ++i)
+  {
+    if (track_offsets[i + 1] < track_offsets[i])
+    {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < num_images; ++i)
+  {
+    const ImageRecord& record = Images()[i];
+    if (image_offsets[i + 1] < image_offsets[i] ||
+        record.name_offset > names_size ||
+        record.name_size > names_size - record.name_offset)
+    {
+      return false;
+    }
+  }
+
+  const Observation* observations = TrackObservations();
+  for (size_t i = 0; i < NumObservations(); ++i)
+  {
+    const Observation& observation = observations[i];
+    if (observation.image_idx >= num_images ||
+        observation.point2d_idx >= image_offsets[observation.image_idx + 1] -
+          image_offsets[observation.image_idx])
+    {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+uint64_t ModelIndex::ModelHash() const { return header_->model_hash; }
+
+size_t ModelIndex::NumCameras() const
+{
+  size_t count;
+  SectionData<CameraRecord>(CAMERAS, &count);
+  return count;
+}
+
+size_t ModelIndex::NumImages() const
+{
+  size_t count;
+  SectionData<ImageRecord>(IMAGES, &count);
+  return count;
+}
+
+size_t ModelIndex::NumPoints() const
+{
+  size_t count;
+  SectionData<uint64_t>(POINT_IDS, &count);
+  return count;
+}
+
+size_t ModelIndex::NumObservations() const
+{
+  size_t count;
+  SectionData<Observation>(TRACK_OBSERVATIONS, &count);
+  return count;
+}
+
+const ModelIndex::CameraRecord* ModelIndex::Cameras() const
+{
+  return SectionData<CameraRecord>(CAMERAS);
+}
+
+const ModelIndex::ImageRecord* ModelIndex::Images() const
+{
+  return SectionData<ImageRecord>(IMAGES);
+}
+
+const char* ModelIndex::ImageNames() const
+{
+  return SectionData<char>(IMAGE_NAMES);
+}
+
+const uint64_t* ModelIndex::PointIds() const
+{
+  return SectionData<uint64_t>(POINT_IDS);
+}
+
+const double* ModelIndex::Coords() const
+{
+  return SectionData<double>(POINT_COORDS);
+}
+
+const double* ModelIndex::Covariances() const
+{
+  return SectionData<double>(POINT_COVARIANCES);
+}
+
+const double* ModelIndex::Uncertainties() const
+{
+  return SectionData<double>(POINT_UNCERTAINTIES);
+}
+
+const uint8_t* ModelIndex::Colors() const
+{
+  return SectionData<uint8_t>(POINT_COLORS);
+}
+
+const uint64_t* ModelIndex::TrackOffsets() const
+{
+  return SectionData<uint64_t>(TRACK_OFFSETS);
+}
+
+const Observation* ModelIndex::TrackObservations() const
+{
+  return SectionData<Observation>(TRACK_OBSERVATIONS);
+}
+
+const uint64_t* ModelIndex::ImagePoint2dOffsets() const
+{
+  return SectionData<uint64_t>(IMAGE_POINT2D_OFFSETS);
+}
+
+const ModelIndex::ImagePoint2d* ModelIndex::ImagePoints2d() const
+{
+  return SectionData<ImagePoint2d>(IMAGE_POINTS2D);
+}
+
+bool ModelIndex::ReadHierarchy(PointHierarchy* hierarchy) const
+{
+  size_t num_levels;
+  const HierarchyLevel* levels =
+    SectionData<HierarchyLevel>(HIERARCHY_LEVELS, &num_levels);
+  if (num_levels == 0)
+  {
+    return false;
+  }
+
+  size_t num_nodes;
+  const PointHierarchy::Node* nodes =
+    SectionData<PointHierarchy::Node>(HIERARCHY_NODES, &num_nodes);
+  size_t num_point_ids;
+  const uint64_t* point3d_ids =
+    SectionData<uint64_t>(HIERARCHY_POINT_IDS, &num_point_ids);
+
+  std::vector<std::vector<PointHierarchy::Node>> level_nodes(num_levels);
+  size_t offset = 0;
+  for (size_t level = 0; level < num_levels; ++level)
+  {
+    if (offset + levels[level].num_nodes > num_nodes)
+    {
+      return false;
+    }
+    level_nodes[level].assign(nodes + offset,
+                              nodes + offset + levels[level].num_nodes);
+    offset += levels[level].num_nodes;
+  }
+
+  hierarchy->Assign(levels[0].voxel_size, std::move(level_nodes),
+                    std::vector<uint64_t>(point3d_ids,
+                                          point3d_ids + num_point_ids));
+  return true;
+}
+
+template<typename T>
+const T* ModelIndex::SectionData(const Section section, size_t* count) const
+{
+  const SectionEntry& entry = sections_[section];
+  if (count != nullptr)
+  {
+    *count = entry.size / sizeof(T);
+  }
+  return reinterpret_cast<const T*>(
+      static_cast<const char*>(data_) + entry.offset);
+}
+
+void ModelIndex::Close()
+{
+  if (data_ != nullptr)
+  {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  sections_ = nullptr;
+}
+
+} // namespace mercator
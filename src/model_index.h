@@ -0,0 +1,206 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_MODEL_INDEX_H_
+#define MERCATOR_MODEL_INDEX_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "observation_store.h"
+#include "point_hierarchy.h"
+
+namespace mercator {
+
+class ColmapReader;
+
+// Prebuilt binary form of a reconstruction, written by `mercator index` and
+// mapped read-only instead of parsing the COLMAP files. Besides the model it
+// holds what is otherwise derived on every run: the uncertainty of each
+// covariance, the tracks in compressed sparse row form and the point
+// hierarchy. Covariances and 2D points are stored in full, so that a model
+// read from its index is identical to one read from the COLMAP files.
+//
+// The file starts with a header and a table of sections, each an array of
+// fixed size records aligned to 64 bytes. Points are stored as a structure of
+// arrays, in the order of the tracks of the ObservationStore, and images in
+// the order of its dense image indices. Values are stored in the byte order
+// of the machine that wrote the index; a reader on a machine of the other
+// byte order rejects it.
+//
+// The tracks are used in place by the observation store, so planners that
+// map the same index share them through the page cache. The points and
+// images are copied into each process by ColmapReader::ReadIndex.
+class ModelIndex {
+ public:
+  static const uint32_t kVersion = 3;
+
+  enum Section : uint32_t {
+    CAMERAS,
+    IMAGES,
+    IMAGE_NAMES,
+    POINT_IDS,
+    POINT_COORDS,
+    POINT_COVARIANCES,
+    POINT_UNCERTAINTIES,
+    POINT_COLORS,
+    TRACK_OFFSETS,
+    TRACK_OBSERVATIONS,
+    IMAGE_POINT2D_OFFSETS,
+    IMAGE_POINTS2D,
+    HIERARCHY_LEVELS,
+    HIERARCHY_NODES,
+    HIERARCHY_POINT_IDS,
+    NUM_SECTIONS
+  };
+
+  struct CameraRecord {
+    uint32_t camera_id;
+    uint32_t reserved;
+    uint64_t width;
+    uint64_t height;
+    double params[4];
+  };
+
+  struct ImageRecord {
+    uint32_t image_id;
+    uint32_t camera_id;
+    double rotation[4];
+    double translation[3];
+
+    // Range of the name in IMAGE_NAMES
+    uint64_t name_offset;
+    uint64_t name_size;
+  };
+
+  // 2D point of an image, matched or not, listed per image in the order of
+  // Image::Points2d()
+  struct ImagePoint2d {
+    double x;
+    double y;
+
+    // kInvalidPoint3dId if the 2D point has no 3D point
+    uint64_t point3d_id;
+  };
+
+  // Level of the point hierarchy, whose nodes follow those of the previous
+  // levels in HIERARCHY_NODES
+  struct HierarchyLevel {
+    double voxel_size;
+    uint64_t num_nodes;
+  };
+
+  ModelIndex();
+  ~ModelIndex();
+
+  ModelIndex(const ModelIndex&) = delete;
+  ModelIndex& operator=(const ModelIndex&) = delete;
+
+  // Write the index of a reconstruction. model_hash identifies the COLMAP
+  // files it was built from.
+  static bool Write(const ColmapReader& reader,
+                    const PointHierarchy& hierarchy,
+                    const uint64_t model_hash,
+                    const std::string& path);
+
+  // Map an index and check its header and sections
+  bool Open(const std::string& path);
+
+  // Bytes of the mapped index
+  size_t Size() const;
+
+  uint64_t ModelHash() const;
+
+  size_t NumCameras() const;
+  size_t NumImages() const;
+  size_t NumPoints() const;
+  size_t NumObservations() const;
+
+  const CameraRecord* Cameras() const;
+  const ImageRecord* Images() const;
+  const char* ImageNames() const;
+
+  const uint64_t* PointIds() const;
+
+  // 3 values per point
+  const double* Coords() const;
+
+  // 9 values per point, a column major 3x3 matrix
+  const double* Covariances() const;
+
+  const double* Uncertainties() const;
+
+  // 3 values per point
+  const uint8_t* Colors() const;
+
+  // Observations of point i are TrackObservations()[TrackOffsets()[i],
+  // TrackOffsets()[i + 1])
+  const uint64_t* TrackOffsets() const;
+  const Observation* TrackObservations() const;
+
+  // 2D points of image i are ImagePoints2d()[ImagePoint2dOffsets()[i],
+  // ImagePoint2dOffsets()[i + 1])
+  const uint64_t* ImagePoint2dOffsets() const;
+  const ImagePoint2d* ImagePoints2d() const;
+
+  // Copy the point hierarchy out of the index. Returns false if the index
+  // has none.
+  bool ReadHierarchy(PointHierarchy* hierarchy) const;
+
+ private:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_sections;
+    uint64_t model_hash;
+    uint64_t byte_order;
+  };
+
+  struct SectionEntry {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  // Start of a section and its number of records of type T
+  template<typename T>
+  const T* SectionData(const Section section, size_t* count = nullptr) const;
+
+  // Map the index open as fd, which is closed. path names the index in error
+  // messages.
+  bool Map(const int fd, const std::string& path);
+
+  // Whether every offset and index in the arrays is within range, so that
+  // reading the model cannot read outside the mapping
+  bool Validate() const;
+
+  void Close();
+
+  void* data_;
+  size_t size_;
+  const Header* header_;
+  const SectionEntry* sections_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_MODEL_INDEX_H_
@@ -0,0 +1,276 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <utility>
+
+#include "observation_store.h"
+#include "util/memory.h"
+
+namespace mercator {
+
+ObservationStore::ObservationStore()
+  : offsets_(1, 0), mapped_offsets_(nullptr), mapped_observations_(nullptr) {}
+
+void ObservationStore::Clear()
+{
+  mapped_offsets_ = nullptr;
+  mapped_observations_ = nullptr;
+  image_ids_.clear();
+  image_idxs_.clear();
+  point3d_ids_.clear();
+  point_idxs_.clear();
+  offsets_.assign(1, 0);
+  observations_.clear();
+}
+
+uint32_t ObservationStore::AddImage(const uint32_t image_id)
+{
+  const auto result = image_idxs_.emplace(image_id, image_ids_.size());
+  if (result.second)
+  {
+    image_ids_.push_back(image_id);
+  }
+  return result.first->second;
+}
+
+void ObservationStore::AddPoint(const uint64_t point3d_id)
+{
+  Unmap();
+  point_idxs_.emplace(point3d_id, point3d_ids_.size());
+  point3d_ids_.push_back(point3d_id);
+  offsets_.push_back(observations_.size());
+}
+
+void ObservationStore::AddObservation(const uint32_t image_idx,
+                                      const uint32_t point2d_idx,
+                                      const Eigen::Vector2d& xy)
+{
+  Unmap();
+  observations_.push_back({ image_idx, point2d_idx, xy(0), xy(1) });
+  offsets_.back() = observations_.size();
+}
+
+void ObservationStore::Map(std::vector<uint32_t> image_ids,
+                           std::vector<uint64_t> point3d_ids,
+                           const uint64_t* offsets,
+                           const Observation* observations)
+{
+  image_ids_ = std::move(image_ids);
+  point3d_ids_ = std::move(point3d_ids);
+  offsets_.clear();
+  observations_.clear();
+  mapped_offsets_ = offsets;
+  mapped_observations_ = observations;
+
+  image_idxs_.clear();
+  image_idxs_.reserve(image_ids_.size());
+  for (uint32_t idx = 0; idx < image_ids_.size(); ++idx)
+  {
+    image_idxs_.emplace(image_ids_[idx], idx);
+  }
+
+  point_idxs_.clear();
+  point_idxs_.reserve(point3d_ids_.size());
+  for (size_t idx = 0; idx < point3d_ids_.size(); ++idx)
+  {
+    point_idxs_.emplace(point3d_ids_[idx], idx);
+  }
+}
+
+bool ObservationStore::IsMapped() const { return mapped_offsets_ != nullptr; }
+
+void ObservationStore::Unmap()
+{
+  if (!IsMapped())
+  {
+    return;
+  }
+
+  offsets_.assign(mapped_offsets_, mapped_offsets_ + point3d_ids_.size() + 1);
+  observations_.assign(mapped_observations_,
+                       mapped_observations_ + offsets_.back());
+  mapped_offsets_ = nullptr;
+  mapped_observations_ = nullptr;
+}
+
+void ObservationStore::UpdateTracks(
+    const std::vector<std::pair<uint64_t, std::vector<Observation>>>& tracks)
+{
+  Unmap();
+
+  // Tracks of existing points that change length, by point index
+  std::unordered_map<size_t, const std::vector<Observation>*> resized;
+  for (const auto& track : tracks)
+  {
+    const auto it = point_idxs_.find(track.first);
+    if (it == point_idxs_.end())
+    {
+      continue;
+    }
+
+    const size_t idx = it->second;
+    if (track.second.size() == offsets_[idx + 1] - offsets_[idx])
+    {
+      std::copy(track.second.begin(), track.second.end(),
+                observations_.begin() + offsets_[idx]);
+    }
+    else
+    {
+      resized.emplace(idx, &track.second);
+    }
+  }
+
+  if (!resized.empty())
+  {
+    std::vector<Observation> observations;
+    observations.reserve(observations_.size());
+    std::vector<size_t> offsets(1, 0);
+    offsets.reserve(offsets_.size());
+    for (size_t idx = 0; idx < point3d_ids_.size(); ++idx)
+    {
+      const auto it = resized.find(idx);
+      if (it != resized.end())
+      {
+        observations.insert(observations.end(), it->second->begin(),
+                            it->second->end());
+      }
+      else
+      {
+        observations.insert(observations.end(),
+                            observations_.begin() + offsets_[idx],
+                            observations_.begin() + offsets_[idx + 1]);
+      }
+      offsets.push_back(observations.size());
+    }
+    observations_.swap(observations);
+    offsets_.swap(offsets);
+  }
+
+  for (const auto& track : tracks)
+  {
+    if (HasPoint(track.first))
+    {
+      continue;
+    }
+
+    AddPoint(track.first);
+    observations_.insert(observations_.end(), track.second.begin(),
+                         track.second.end());
+    offsets_.back() = observations_.size();
+  }
+}
+
+void ObservationStore::UpdateCoords(
+    const std::unordered_map<uint32_t, const std::vector<Point2d>*>& points2d)
+{
+  if (points2d.empty())
+  {
+    return;
+  }
+
+  Unmap();
+
+  for (auto& observation : observations_)
+  {
+    const auto it = points2d.find(observation.image_idx);
+    if (it != points2d.end() && observation.point2d_idx < it->second->size())
+    {
+      const Eigen::Vector2d& xy =
+        (*it->second)[observation.point2d_idx].Coords();
+      observation.x = xy(0);
+      observation.y = xy(1);
+    }
+  }
+}
+
+size_t ObservationStore::NumImages() const { return image_ids_.size(); }
+
+size_t ObservationStore::NumPoints() const { return point3d_ids_.size(); }
+
+size_t ObservationStore::NumObservations() const
+{
+  return Offset(point3d_ids_.size());
+}
+
+bool ObservationStore::HasImage(const uint32_t image_id) const
+{
+  return image_idxs_.count(image_id) > 0;
+}
+
+uint32_t ObservationStore::ImageIdx(const uint32_t image_id) const
+{
+  return image_idxs_.at(image_id);
+}
+
+uint32_t ObservationStore::ImageId(const uint32_t image_idx) const
+{
+  return image_ids_[image_idx];
+}
+
+bool ObservationStore::HasPoint(const uint64_t point3d_id) const
+{
+  return point_idxs_.count(point3d_id) > 0;
+}
+
+size_t ObservationStore::PointIdx(const uint64_t point3d_id) const
+{
+  return point_idxs_.at(point3d_id);
+}
+
+uint64_t ObservationStore::Point3dId(const size_t point_idx) const
+{
+  return point3d_ids_[point_idx];
+}
+
+Track ObservationStore::TrackForIdx(const size_t point_idx) const
+{
+  const Observation* data =
+    IsMapped() ? mapped_observations_ : observations_.data();
+  return Track(data + Offset(point_idx), data + Offset(point_idx + 1));
+}
+
+Track ObservationStore::TrackForPoint(const uint64_t point3d_id) const
+{
+  return TrackForIdx(PointIdx(point3d_id));
+}
+
+size_t ObservationStore::MemoryUsage() const
+{
+  return VectorBytes(image_ids_) + UnorderedMapBytes(image_idxs_)
+    + VectorBytes(point3d_ids_) + UnorderedMapBytes(point_idxs_)
+    + VectorBytes(offsets_) + VectorBytes(observations_);
+}
+
+size_t ObservationStore::Offset(const size_t point_idx) const
+{
+  return IsMapped() ? mapped_offsets_[point_idx] : offsets_[point_idx];
+}
+
+Track ObservationStore::Observations() const
+{
+  const Observation* data =
+    IsMapped() ? mapped_observations_ : observations_.data();
+  return Track(data, data + NumObservations());
+}
+
+} // namespace mercator
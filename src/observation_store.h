@@ -0,0 +1,160 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_OBSERVATION_STORE_H_
+#define MERCATOR_OBSERVATION_STORE_H_
+
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "point2d.h"
+
+namespace mercator {
+
+// A single observation of a 3D point in an image
+struct Observation {
+  // Dense index of the observing image in the ObservationStore
+  uint32_t image_idx;
+
+  // Index of the observation in the list of 2D points of the image
+  uint32_t point2d_idx;
+
+  // Pixel coordinates of the observation
+  double x;
+  double y;
+};
+
+// Range over the observations of a single 3D point
+class Track {
+ public:
+  Track(const Observation* begin, const Observation* end)
+    : begin_(begin), end_(end) {}
+
+  const Observation* begin() const { return begin_; }
+  const Observation* end() const { return end_; }
+  size_t size() const { return end_ - begin_; }
+  bool empty() const { return begin_ == end_; }
+
+ private:
+  const Observation* begin_;
+  const Observation* end_;
+};
+
+// Compressed sparse row table of the observations of every 3D point. The
+// observations of each point are stored contiguously, in the order they
+// appear in the point's track, so that residual assembly can walk a track
+// without searching through the images.
+class ObservationStore {
+ public:
+  ObservationStore();
+
+  void Clear();
+
+  // Register an image and return its dense index
+  uint32_t AddImage(const uint32_t image_id);
+
+  // Start the track of a new point. Observations added afterwards belong to
+  // this point until the next call.
+  void AddPoint(const uint64_t point3d_id);
+
+  void AddObservation(const uint32_t image_idx,
+                      const uint32_t point2d_idx,
+                      const Eigen::Vector2d& xy);
+
+  // Replace the table with the tracks of a mapped model index, which are
+  // used in place. offsets holds point3d_ids.size() + 1 entries starting at
+  // 0. The arrays must stay mapped until the store is cleared or changed,
+  // which copies them first.
+  void Map(std::vector<uint32_t> image_ids,
+           std::vector<uint64_t> point3d_ids,
+           const uint64_t* offsets,
+           const Observation* observations);
+
+  // Whether the tracks are those of a mapped model index
+  bool IsMapped() const;
+
+  size_t NumImages() const;
+  size_t NumPoints() const;
+  size_t NumObservations() const;
+
+  // Estimated heap bytes of the table, excluding mapped tracks
+  size_t MemoryUsage() const;
+
+  bool HasImage(const uint32_t image_id) const;
+  uint32_t ImageIdx(const uint32_t image_id) const;
+  uint32_t ImageId(const uint32_t image_idx) const;
+
+  bool HasPoint(const uint64_t point3d_id) const;
+  size_t PointIdx(const uint64_t point3d_id) const;
+  uint64_t Point3dId(const size_t point_idx) const;
+
+  // Observations of the point with the given dense index
+  Track TrackForIdx(const size_t point_idx) const;
+
+  // Observations of the point with the given ID. The point must exist.
+  Track TrackForPoint(const uint64_t point3d_id) const;
+
+  // Replace the tracks of existing points and append those of new points,
+  // given as pairs of point ID and observations. Tracks that keep their
+  // length are overwritten in place, otherwise the table is rebuilt once.
+  void UpdateTracks(
+      const std::vector<std::pair<uint64_t, std::vector<Observation>>>&
+        tracks);
+
+  // Update the pixel coordinates of the observations in images whose 2D
+  // points moved, given the new 2D points of each image by its index
+  void UpdateCoords(
+      const std::unordered_map<uint32_t, const std::vector<Point2d>*>&
+        points2d);
+
+  // Index of the first observation of the point with the given dense index.
+  // Offset(NumPoints()) is NumObservations().
+  size_t Offset(const size_t point_idx) const;
+
+  // Observations of every point, in the order of their dense index
+  Track Observations() const;
+
+ private:
+  // Copy mapped tracks before they are changed
+  void Unmap();
+
+  std::vector<uint32_t> image_ids_;
+  std::unordered_map<uint32_t, uint32_t> image_idxs_;
+
+  std::vector<uint64_t> point3d_ids_;
+  std::unordered_map<uint64_t, size_t> point_idxs_;
+
+  // Observations of point i are observations_[offsets_[i], offsets_[i + 1])
+  std::vector<size_t> offsets_;
+  std::vector<Observation> observations_;
+
+  // Tracks of a model index used instead of offsets_ and observations_
+  const uint64_t* mapped_offsets_;
+  const Observation* mapped_observations_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_OBSERVATION_STORE_H_
@@ -0,0 +1,369 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <chrono>
+#include <sstream>
+#include <thread>
+
+#include "pipeline.h"
+
+namespace mercator {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+double SecondsSince(const Clock::time_point& start)
+{
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+} // namespace
+
+PlanningPipeline::PlanningPipeline(const Options& options,
+                                   Planner* planner,
+                                   ColmapReader* reader,
+                                   const Logger& logger)
+  : options_(options),
+    planner_(planner),
+    reader_(reader),
+    logger_(logger),
+    loaded_(options.queue_capacity),
+    regions_queue_(options.queue_capacity),
+    built_(options.problem_queue_capacity),
+    solved_(options.problem_queue_capacity),
+    read_ok_(false),
+    metrics_(NUM_STAGES)
+{
+  metrics_[LOAD].name = "load";
+  metrics_[CLASSIFY].name = "classify";
+  metrics_[CANDIDATE].name = "candidate";
+  metrics_[SOLVE].name = "solve";
+  metrics_[COVARIANCE].name = "covariance";
+}
+
+bool PlanningPipeline::Run(const std::string& path)
+{
+  start_ = Clock::now();
+
+  std::thread load(&PlanningPipeline::LoadStage, this, path);
+  std::thread classify(&PlanningPipeline::ClassifyStage, this);
+  std::thread candidate(&PlanningPipeline::CandidateStage, this);
+  std::thread solve(&PlanningPipeline::SolveStage, this);
+  std::thread covariance(&PlanningPipeline::CovarianceStage, this);
+
+  load.join();
+  classify.join();
+  candidate.join();
+  solve.join();
+  covariance.join();
+
+  metrics_[CLASSIFY].queue_capacity = loaded_.Capacity();
+  metrics_[CLASSIFY].max_queue_depth = loaded_.MaxSize();
+  metrics_[CLASSIFY].mean_queue_depth = loaded_.MeanSize();
+  metrics_[CANDIDATE].queue_capacity = regions_queue_.Capacity();
+  metrics_[CANDIDATE].max_queue_depth = regions_queue_.MaxSize();
+  metrics_[CANDIDATE].mean_queue_depth = regions_queue_.MeanSize();
+  metrics_[SOLVE].queue_capacity = built_.Capacity();
+  metrics_[SOLVE].max_queue_depth = built_.MaxSize();
+  metrics_[SOLVE].mean_queue_depth = built_.MeanSize();
+  metrics_[COVARIANCE].queue_capacity = solved_.Capacity();
+  metrics_[COVARIANCE].max_queue_depth = solved_.MaxSize();
+  metrics_[COVARIANCE].mean_queue_depth = solved_.MeanSize();
+
+  for (size_t i = 0; i < regions_.size(); ++i)
+  {
+    if (planned_[i])
+    {
+      planner_->AddVirtualCamera(best_images_[i], best_uncertainties_[i]);
+    }
+  }
+
+  return read_ok_;
+}
+
+void PlanningPipeline::LoadStage(const std::string& path)
+{
+  if (Tracer::IsEnabled())
+  {
+    Tracer::Instance().SetThreadName("load");
+  }
+
+  StageMetrics& metrics = metrics_[LOAD];
+
+  ScopedMemoryProbe memory(&planner_->Report(), "read");
+  read_ok_ = reader_->Read(path, [this, &metrics](Point3d* point3d)
+      {
+        loaded_.Push(point3d);
+        ++metrics.num_items;
+      });
+  loaded_.Close();
+
+  metrics.wall_seconds = metrics.busy_seconds = Elapsed();
+  planner_->Report().AddTiming("read", metrics.busy_seconds);
+}
+
+void PlanningPipeline::ClassifyStage()
+{
+  if (Tracer::IsEnabled())
+  {
+    Tracer::Instance().SetThreadName("classify");
+  }
+
+  StageMetrics& metrics = metrics_[CLASSIFY];
+
+  std::vector<const Point3d*> uncovered;
+  Point3d* point3d;
+  while (loaded_.Pop(&point3d))
+  {
+    const auto start = Clock::now();
+    if (planner_->IsCovered(*point3d))
+    {
+      point3d->SetCovered(true);
+    }
+    else
+    {
+      uncovered.push_back(point3d);
+    }
+    metrics.busy_seconds += SecondsSince(start);
+    ++metrics.num_items;
+  }
+
+  planner_->Report().AddTiming("classify", metrics.busy_seconds);
+  planner_->Report().AddCount("points_classified", metrics.num_items);
+  planner_->Report().AddCount("points_uncovered", uncovered.size());
+
+  if (read_ok_)
+  {
+    const auto start = Clock::now();
+
+    regions_ = planner_->MakeRegions(uncovered);
+    angles_.resize(regions_.size());
+    satisfied_.reset(new std::atomic<bool>[regions_.size()]());
+    best_images_.resize(regions_.size());
+    best_uncertainties_.resize(regions_.size());
+    planned_.assign(regions_.size(), false);
+    for (size_t i = 0; i < regions_.size(); ++i)
+    {
+      best_uncertainties_[i] = regions_[i].uncertainty;
+    }
+
+    metrics.busy_seconds += SecondsSince(start);
+
+    logger_.Info() << uncovered.size() << " points are not covered, "
+                   << "planning for " << regions_.size() << " regions"
+                   << std::endl;
+
+    for (size_t i = 0; i < regions_.size(); ++i)
+    {
+      regions_queue_.Push(i);
+    }
+  }
+  regions_queue_.Close();
+
+  metrics.wall_seconds = Elapsed();
+}
+
+void PlanningPipeline::CandidateStage()
+{
+  if (Tracer::IsEnabled())
+  {
+    Tracer::Instance().SetThreadName("candidate");
+  }
+
+  StageMetrics& metrics = metrics_[CANDIDATE];
+
+  // The first candidate of every region is built as soon as the region is
+  // known. The regions are queued in order of priority.
+  std::vector<size_t> order;
+  size_t region_idx;
+  while (regions_queue_.Pop(&region_idx))
+  {
+    // Loading is complete once the first region arrives
+    if (order.empty())
+    {
+      planner_->Start();
+    }
+
+    // Ranking the candidates needs the camera selected by Start()
+    angles_[region_idx] = planner_->CandidateAngles(regions_[region_idx]);
+
+    order.push_back(region_idx);
+
+    if (planner_->RemainingTime() > 0)
+    {
+      const auto start = Clock::now();
+      BuildJob(region_idx, 0);
+      metrics.busy_seconds += SecondsSince(start);
+      ++metrics.num_items;
+    }
+  }
+
+  // Further candidates are built round robin for the regions that do not
+  // meet the threshold yet
+  const int max_candidates =
+    planner_->PlannerOptions().max_candidates_per_region;
+  for (int candidate = 1; candidate < max_candidates; ++candidate)
+  {
+    for (const auto idx : order)
+    {
+      if (planner_->RemainingTime() <= 0)
+      {
+        break;
+      }
+
+      if (satisfied_[idx] ||
+          candidate >= static_cast<int>(angles_[idx].size()))
+      {
+        continue;
+      }
+
+      const auto start = Clock::now();
+      BuildJob(idx, candidate);
+      metrics.busy_seconds += SecondsSince(start);
+      ++metrics.num_items;
+    }
+  }
+  built_.Close();
+
+  metrics.wall_seconds = Elapsed();
+}
+
+void PlanningPipeline::BuildJob(const size_t region_idx, const int candidate)
+{
+  std::unique_ptr<Job> job(new Job);
+  job->region_idx = region_idx;
+  job->ba.reset(new BundleAdjustment(planner_->BundleAdjustmentOptions()));
+
+  if (planner_->BuildProblem(regions_[region_idx],
+                             angles_[region_idx][candidate],
+                             &job->virtual_image,
+                             job->ba.get()))
+  {
+    built_.Push(std::move(job));
+  }
+}
+
+void PlanningPipeline::SolveStage()
+{
+  if (Tracer::IsEnabled())
+  {
+    Tracer::Instance().SetThreadName("solve");
+  }
+
+  StageMetrics& metrics = metrics_[SOLVE];
+
+  std::unique_ptr<Job> job;
+  while (built_.Pop(&job))
+  {
+    // Drop the remaining problems once the time budget is exhausted
+    if (planner_->RemainingTime() <= 0)
+    {
+      continue;
+    }
+
+    const auto start = Clock::now();
+    planner_->SolveProblem(job->ba.get());
+    metrics.busy_seconds += SecondsSince(start);
+    ++metrics.num_items;
+
+    solved_.Push(std::move(job));
+  }
+  solved_.Close();
+
+  metrics.wall_seconds = Elapsed();
+}
+
+void PlanningPipeline::CovarianceStage()
+{
+  if (Tracer::IsEnabled())
+  {
+    Tracer::Instance().SetThreadName("covariance");
+  }
+
+  StageMetrics& metrics = metrics_[COVARIANCE];
+  const double threshold = planner_->PlannerOptions().uncertainty_threshold;
+
+  // Problems that were solved are evaluated even once the time budget is
+  // exhausted, since their camera is as good as any other
+  std::unique_ptr<Job> job;
+  while (solved_.Pop(&job))
+  {
+    const auto start = Clock::now();
+    ScopedTrace trace("evaluate_problem");
+
+    const size_t idx = job->region_idx;
+    const double uncertainty =
+      planner_->EvaluateProblem(regions_[idx], job->ba.get());
+    if (uncertainty < best_uncertainties_[idx])
+    {
+      best_images_[idx] = job->virtual_image;
+      best_uncertainties_[idx] = uncertainty;
+      planned_[idx] = true;
+    }
+
+    if (best_uncertainties_[idx] < threshold)
+    {
+      satisfied_[idx] = true;
+    }
+
+    // Release the problem in this thread rather than in the next Pop
+    job.reset();
+
+    metrics.busy_seconds += SecondsSince(start);
+    ++metrics.num_items;
+  }
+
+  metrics.wall_seconds = Elapsed();
+}
+
+double PlanningPipeline::Elapsed() const { return SecondsSince(start_); }
+
+const std::vector<StageMetrics>& PlanningPipeline::Metrics() const
+{
+  return metrics_;
+}
+
+const std::string PlanningPipeline::MetricsSummary() const
+{
+  std::ostringstream ss;
+  ss << "Pipeline stages:";
+  for (const auto& stage : metrics_)
+  {
+    ss << "\n  " << stage.name << ": " << stage.num_items << " items in "
+       << stage.wall_seconds << " s ("
+       << (stage.wall_seconds > 0 ? stage.num_items / stage.wall_seconds : 0)
+       << " items/s, "
+       << (stage.wall_seconds > 0
+           ? 100.0 * stage.busy_seconds / stage.wall_seconds : 0)
+       << "% busy)";
+    if (stage.queue_capacity > 0)
+    {
+      ss << ", input queue depth max " << stage.max_queue_depth
+         << " mean " << stage.mean_queue_depth
+         << " of " << stage.queue_capacity;
+    }
+  }
+  return ss.str();
+}
+
+} // namespace mercator
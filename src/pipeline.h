@@ -0,0 +1,156 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_PIPELINE_H_
+#define MERCATOR_PIPELINE_H_
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bundle_adjustment.h"
+#include "clustering.h"
+#include "image.h"
+#include "planner.h"
+#include "point3d.h"
+#include "util/colmap.h"
+#include "util/logger.h"
+#include "util/spsc_queue.h"
+#include "util/trace.h"
+
+namespace mercator {
+
+// Throughput and queue statistics of one pipeline stage
+struct StageMetrics {
+  std::string name;
+
+  // Number of items the stage processed
+  size_t num_items = 0;
+
+  // Time spent processing items, excluding waits on the queues
+  double busy_seconds = 0.0;
+
+  // Time from the start of the pipeline until the stage finished
+  double wall_seconds = 0.0;
+
+  // Statistics of the queue feeding the stage, if any
+  size_t queue_capacity = 0;
+  size_t max_queue_depth = 0;
+  double mean_queue_depth = 0.0;
+};
+
+// Runs the planner as a pipeline of stages, each in its own thread, connected
+// by bounded lock-free queues:
+//
+//   load -> classify -> candidate -> solve -> covariance
+//
+// Points are classified while the rest of the points file is still being
+// decoded, and the problem for the next candidate camera is built while the
+// previous one is being solved.
+class PlanningPipeline {
+ public:
+  struct Options {
+    // Capacity of the queues carrying points and regions
+    size_t queue_capacity = 4096;
+
+    // Capacity of the queues carrying bundle adjustment problems, which
+    // bounds the number of problems held in memory
+    size_t problem_queue_capacity = 2;
+  };
+
+  PlanningPipeline(const Options& options,
+                   Planner* planner,
+                   ColmapReader* reader,
+                   const Logger& logger);
+
+  // Read the reconstruction at path and plan virtual cameras for it. The
+  // cameras are added to the planner. Returns false if reading failed.
+  bool Run(const std::string& path);
+
+  const std::vector<StageMetrics>& Metrics() const;
+
+  const std::string MetricsSummary() const;
+
+ private:
+  // A candidate camera for a region and its bundle adjustment
+  struct Job {
+    size_t region_idx;
+    Image virtual_image;
+    std::unique_ptr<BundleAdjustment> ba;
+  };
+
+  enum Stage { LOAD, CLASSIFY, CANDIDATE, SOLVE, COVARIANCE, NUM_STAGES };
+
+  void LoadStage(const std::string& path);
+  void ClassifyStage();
+  void CandidateStage();
+  void SolveStage();
+  void CovarianceStage();
+
+  // Build the problem for one candidate camera of a region and queue it
+  void BuildJob(const size_t region_idx, const int candidate);
+
+  // Seconds since the pipeline started
+  double Elapsed() const;
+
+  const Options options_;
+
+  Planner* planner_;
+
+  ColmapReader* reader_;
+
+  const Logger& logger_;
+
+  SpscQueue<Point3d*> loaded_;
+  SpscQueue<size_t> regions_queue_;
+  SpscQueue<std::unique_ptr<Job>> built_;
+  SpscQueue<std::unique_ptr<Job>> solved_;
+
+  std::atomic<bool> read_ok_;
+
+  // Regions to plan for, written by the classify stage before their indices
+  // are queued
+  std::vector<PointRegion> regions_;
+
+  // Candidate angles of each region, best first
+  std::vector<std::vector<double>> angles_;
+
+  // Set by the covariance stage once a region meets the threshold, so that
+  // no further candidates are built for it
+  std::unique_ptr<std::atomic<bool>[]> satisfied_;
+
+  // Best camera found for each region and the uncertainty it yields, owned
+  // by the covariance stage
+  std::vector<Image> best_images_;
+  std::vector<double> best_uncertainties_;
+  std::vector<bool> planned_;
+
+  std::vector<StageMetrics> metrics_;
+
+  std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_PIPELINE_H_
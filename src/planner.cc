@@ -0,0 +1,1031 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+#include <Eigen/LU>
+
+#include "mercator.h"
+#include "planner.h"
+#include "util/hash.h"
+
+namespace mercator {
+
+namespace {
+
+// Fraction of the points that may be missing from the point hierarchy after
+// model updates before it is rebuilt
+const double kMaxUnindexedFraction = 0.05;
+
+} // namespace
+
+Planner::Options::Options(const ConfigManager& config)
+  : uncertainty_threshold(config.uncertainty_threshold),
+    min_cameras(config.min_cameras),
+    camera_pixel_size(config.camera_pixel_size),
+    min_ground_sampling_distance(config.min_ground_sampling_distance),
+    region_voxel_size(config.region_voxel_size),
+    print_ba_summary(config.print_ba_summary),
+    max_candidates_per_region(config.max_candidates_per_region),
+    candidate_angle_step(config.candidate_angle_step),
+    time_budget(config.time_budget),
+    lod_levels(config.lod_levels),
+    lod_voxel_size(config.lod_voxel_size) {}
+
+uint64_t Planner::Options::Hash() const
+{
+  uint64_t hash = HashValue(uncertainty_threshold);
+  hash = HashValue(min_cameras, hash);
+  hash = HashValue(camera_pixel_size, hash);
+  hash = HashValue(min_ground_sampling_distance, hash);
+  hash = HashValue(region_voxel_size, hash);
+  hash = HashValue(max_candidates_per_region, hash);
+  hash = HashValue(candidate_angle_step, hash);
+  hash = HashValue(lod_levels, hash);
+  hash = HashValue(lod_voxel_size, hash);
+  hash = HashValue(ba_options.group_observations_by_point, hash);
+  return HashValue(ba_options.solver_options.max_num_iterations, hash);
+}
+
+Planner::Planner(const Options& options,
+                 const Logger& logger,
+                 ColmapReader* reader)
+  : options_(options),
+    deadline_(Clock::now()),
+    logger_(logger),
+    reader_(reader),
+    camera_(nullptr),
+    corpus_writer_(nullptr),
+    result_cache_(nullptr),
+    thread_pool_(nullptr),
+    candidate_cache_(nullptr) {}
+
+void Planner::Start()
+{
+  SetTimeBudget(options_.time_budget);
+
+  auto& cameras = reader_->Cameras();
+  if (cameras.size() > 1)
+  {
+    logger_.Warn("More than one camera found! Defaulting to the first.");
+  }
+
+  Camera& camera = cameras.begin()->second;
+
+  // This information is not provided by COLMAP so the user must supply it
+  camera.SetPixelSize(options_.camera_pixel_size);
+
+  camera_ = &camera;
+
+  if (options_.lod_levels > 0 && hierarchy_.NumLevels() == 0)
+  {
+    hierarchy_.Build(reader_->Points(), options_.lod_voxel_size,
+                     options_.lod_levels);
+
+    logger_.Info() << "Built point hierarchy with " << hierarchy_.NumLevels()
+                   << " levels, " << hierarchy_.Level(0).size()
+                   << " voxels at the finest and "
+                   << hierarchy_.Level(hierarchy_.NumLevels() - 1).size()
+                   << " at the coarsest" << std::endl;
+  }
+}
+
+void Planner::SetPointHierarchy(PointHierarchy hierarchy)
+{
+  hierarchy_ = std::move(hierarchy);
+}
+
+bool Planner::ApplyDelta(const ModelDelta& delta, UpdateResult* result)
+{
+  ScopedTimer timer(&report_, "apply_delta");
+  ScopedTrace trace("apply_delta");
+
+  // Coverage of the points before the update
+  std::unordered_map<uint64_t, bool> was_covered;
+  for (const auto& update : delta.points)
+  {
+    const auto it = reader_->Points().find(update.point.Point3dId());
+    if (it != reader_->Points().end())
+    {
+      was_covered.emplace(it->first, it->second.Covered());
+    }
+  }
+  for (const auto& update : delta.covariances)
+  {
+    const auto it = reader_->Points().find(update.point3d_id);
+    if (it != reader_->Points().end())
+    {
+      was_covered.emplace(it->first, it->second.Covered());
+    }
+  }
+
+  result->point3d_ids.clear();
+  result->covered_point3d_ids.clear();
+  result->uncovered_point3d_ids.clear();
+  if (!reader_->ApplyDelta(delta, &result->point3d_ids))
+  {
+    return false;
+  }
+
+  for (const auto point3d_id : result->point3d_ids)
+  {
+    Point3d& point3d = reader_->Point(point3d_id);
+    point3d.Uncertainty();
+    const bool covered = IsCovered(point3d);
+    point3d.SetCovered(covered);
+
+    const auto it = was_covered.find(point3d_id);
+    if (it == was_covered.end() || it->second != covered)
+    {
+      (covered ? result->covered_point3d_ids
+               : result->uncovered_point3d_ids).push_back(point3d_id);
+    }
+  }
+
+  if (hierarchy_.NumLevels() > 0)
+  {
+    std::vector<uint64_t> point3d_ids;
+    for (const auto& update : delta.points)
+    {
+      point3d_ids.push_back(update.point.Point3dId());
+    }
+    hierarchy_.AddUnindexed(point3d_ids);
+
+    // Points outside the hierarchy are projected by every problem
+    if (hierarchy_.NumUnindexed() >
+        kMaxUnindexedFraction * reader_->Points().size())
+    {
+      hierarchy_.Build(reader_->Points(), options_.lod_voxel_size,
+                       options_.lod_levels);
+      logger_.Info("Rebuilt point hierarchy after model updates");
+    }
+  }
+
+  report_.AddCount("delta_images", delta.images.size());
+  report_.AddCount("delta_points", result->point3d_ids.size());
+  report_.AddCount("delta_coverage_changes",
+                   result->covered_point3d_ids.size() +
+                   result->uncovered_point3d_ids.size());
+
+  return true;
+}
+
+void Planner::Run()
+{
+  Start();
+
+  const std::vector<const Point3d*> uncovered = Classify();
+  std::vector<PointRegion> regions = MakeRegions(uncovered);
+
+  if (region_filter_)
+  {
+    regions.erase(std::remove_if(regions.begin(), regions.end(),
+                                 [this](const PointRegion& region)
+                                 {
+                                   return !region_filter_(region);
+                                 }),
+                  regions.end());
+  }
+
+  report_.AddCount("regions", regions.size());
+  logger_.Info() << uncovered.size() << " points are not covered, planning for "
+                 << regions.size() << " regions" << std::endl;
+
+  // Next candidate to try for a region
+  struct Candidate {
+    double priority;
+    size_t region_idx;
+    int candidate;
+
+    bool operator<(const Candidate& other) const
+    {
+      return priority < other.priority;
+    }
+  };
+
+  // Best camera found so far for each region, and the uncertainty it yields
+  std::vector<Image> best_images(regions.size());
+  std::vector<double> best_uncertainties(regions.size());
+  std::vector<bool> planned(regions.size(), false);
+  for (size_t i = 0; i < regions.size(); ++i)
+  {
+    best_uncertainties[i] = regions[i].uncertainty;
+  }
+
+  // Regions whose points are unchanged since the previous run keep its
+  // result without being planned again
+  std::vector<uint64_t> region_hashes(regions.size());
+  size_t num_cached = 0;
+
+  std::unordered_map<uint32_t, uint64_t> image_hashes;
+
+  std::priority_queue<Candidate> queue;
+  std::vector<std::vector<double>> angles(regions.size());
+  for (size_t i = 0; i < regions.size(); ++i)
+  {
+    angles[i] = CandidateAngles(regions[i]);
+
+    if (result_cache_ != nullptr)
+    {
+      region_hashes[i] = RegionHash(regions[i], angles[i], &image_hashes);
+      const ResultCache::RegionResult* cached =
+        result_cache_->FindRegion(region_hashes[i]);
+      if (cached != nullptr)
+      {
+        if (cached->flags & ResultCache::REGION_PLANNED)
+        {
+          best_images[i] = ResultCache::VirtualImage(*cached);
+          best_uncertainties[i] = cached->uncertainty;
+          planned[i] = true;
+        }
+        result_cache_->AddRegion(*cached);
+        ++num_cached;
+        continue;
+      }
+    }
+
+    queue.push({ Priority(regions[i], regions[i].uncertainty), i, 0 });
+  }
+
+  if (result_cache_ != nullptr)
+  {
+    report_.AddCount("regions_cached", num_cached);
+    logger_.Info() << num_cached << " regions were planned by a previous run"
+                   << std::endl;
+  }
+
+  while (!queue.empty())
+  {
+    if (RemainingTime() <= 0)
+    {
+      logger_.Info() << "Time budget exhausted with " << queue.size()
+                     << " candidates left" << std::endl;
+      break;
+    }
+
+    const Candidate candidate = queue.top();
+    queue.pop();
+
+    const size_t idx = candidate.region_idx;
+    const PointRegion& region = regions[idx];
+
+    Image virtual_image;
+    double uncertainty;
+    if (PlanRegion(region, angles[idx][candidate.candidate],
+                   &virtual_image, &uncertainty) &&
+        uncertainty < best_uncertainties[idx])
+    {
+      best_images[idx] = virtual_image;
+      best_uncertainties[idx] = uncertainty;
+      planned[idx] = true;
+    }
+
+    // Try the next candidate once every other region had its turn, unless
+    // the region already meets the threshold
+    if (candidate.candidate + 1 < static_cast<int>(angles[idx].size()) &&
+        best_uncertainties[idx] >= options_.uncertainty_threshold)
+    {
+      queue.push({ Priority(region, best_uncertainties[idx])
+                     / (candidate.candidate + 2),
+                   idx,
+                   candidate.candidate + 1 });
+    }
+    else if (result_cache_ != nullptr)
+    {
+      // Only regions that are done are cached, not those cut short by the
+      // time budget
+      result_cache_->AddRegion(ResultCache::MakeRegionResult(
+            region_hashes[idx], best_uncertainties[idx],
+            planned[idx] ? &best_images[idx] : nullptr));
+    }
+  }
+
+  for (size_t i = 0; i < regions.size(); ++i)
+  {
+    if (planned[i])
+    {
+      AddVirtualCamera(best_images[i], best_uncertainties[i]);
+    }
+    else
+    {
+      logger_.Debug("Virtual camera did not provide enough new information,"
+          " skipping...");
+    }
+  }
+}
+
+bool Planner::IsCovered(const Point3d& point3d) const
+{
+  // The maximum eigenvalue of the covariance matrix must be less than the
+  // threshold specified by the user, and enough images must see the point
+  return point3d.Uncertainty() < options_.uncertainty_threshold &&
+    point3d.ImageIds().size() >= options_.min_cameras;
+}
+
+std::vector<const Point3d*> Planner::Classify()
+{
+  ScopedTimer timer(&report_, "classify");
+  ScopedMemoryProbe memory(&report_, "classify");
+  ScopedTrace trace("classify");
+
+  std::vector<const Point3d*> uncovered;
+  size_t num_cached = 0;
+
+  for (auto& point : reader_->Points())
+  {
+    Point3d& point3d = point.second;
+
+    // Points whose attributes did not change since the previous run keep
+    // its classification. The hashes of an unchanged model are not computed
+    // again.
+    const ResultCache::PointResult* cached = nullptr;
+    uint64_t hash = 0;
+    if (result_cache_ != nullptr)
+    {
+      cached = result_cache_->FindPoint(point.first);
+      hash = (cached != nullptr && result_cache_->ModelUnchanged())
+        ? cached->hash : ResultCache::HashPoint(point3d);
+      if (cached != nullptr && cached->hash != hash)
+      {
+        cached = nullptr;
+      }
+    }
+
+    bool covered;
+    if (cached != nullptr)
+    {
+      point3d.SetUncertainty(cached->uncertainty);
+      covered = (cached->flags & ResultCache::POINT_COVERED) != 0;
+      ++num_cached;
+    }
+    else
+    {
+      // The non-const accessor computes and keeps the uncertainty if the
+      // reader left it to be computed
+      point3d.Uncertainty();
+      covered = IsCovered(point3d);
+    }
+
+    if (result_cache_ != nullptr)
+    {
+      result_cache_->AddPoint({ point.first, hash, point3d.Uncertainty(),
+                                covered ? ResultCache::POINT_COVERED : 0u,
+                                0 });
+    }
+
+    if (covered)
+    {
+      MERCATOR_DEBUG(logger_) << "Point " << point3d.Point3dId()
+                              << " is already covered, skipping...";
+      point3d.SetCovered(true);
+      continue;
+    }
+
+    // A point may have been covered under other thresholds
+    point3d.SetCovered(false);
+    uncovered.push_back(&point3d);
+  }
+
+  report_.AddCount("points_classified", reader_->Points().size());
+  report_.AddCount("points_uncovered", uncovered.size());
+  if (result_cache_ != nullptr)
+  {
+    report_.AddCount("points_cached", num_cached);
+  }
+
+  return uncovered;
+}
+
+std::vector<PointRegion> Planner::MakeRegions(
+    const std::vector<const Point3d*>& uncovered) const
+{
+  std::vector<PointRegion> regions =
+    ClusterPoints(uncovered, options_.region_voxel_size);
+
+  std::stable_sort(regions.begin(), regions.end(),
+      [this](const PointRegion& a, const PointRegion& b)
+      {
+        return Priority(a, a.uncertainty) > Priority(b, b.uncertainty);
+      });
+
+  return regions;
+}
+
+bool Planner::BuildProblem(const PointRegion& region,
+                           const double angle,
+                           Image* virtual_image,
+                           BundleAdjustment* ba) const
+{
+  CreateVirtualCameraForRegion(
+      region.centroid,
+      region.covariance,
+      *camera_,
+      options_.min_ground_sampling_distance,
+      angle,
+      virtual_image);
+
+  return BuildProblem(region, virtual_image, ba);
+}
+
+bool Planner::BuildProblem(const PointRegion& region,
+                           Image* virtual_image,
+                           BundleAdjustment* ba) const
+{
+  ScopedTimer timer(&report_, "candidate");
+  ScopedMemoryProbe memory(&report_, "candidate");
+  ScopedTrace trace("build_problem");
+  report_.AddCount("candidates");
+
+  const Camera& camera = *camera_;
+
+  virtual_image->SetCameraId(camera.CameraId());
+
+  // Prepare a new bundle adjustment with the points of the region
+  ba->SetObservations(&reader_->Observations());
+  ba->AddCamera(camera);
+
+  for (const auto point3d_id : region.point3d_ids)
+  {
+    const Point3d& point = reader_->Point(point3d_id);
+    MERCATOR_DEBUG(logger_) << "Using point " << point3d_id;
+    ba->AddPoint(point);
+
+    // Add every other image that sees this point
+    for (const auto image_id : point.ImageIds())
+    {
+      if (ba->HasImage(image_id))
+      {
+        continue;
+      }
+
+      MERCATOR_DEBUG(logger_) << "Point " << point3d_id << " sees image "
+                              << image_id << ", adding to bundle adjustment...";
+      ba->AddImage(reader_->Image(image_id));
+    }
+  }
+
+  size_t num_visible = 0;
+  for (const auto point3d_id : region.point3d_ids)
+  {
+    if (ProjectPointOntoImage(reader_->Point(point3d_id), camera,
+                              virtual_image))
+    {
+      ++num_visible;
+    }
+  }
+
+  if (num_visible == 0)
+  {
+    logger_.Warn("Projecting region onto virtual image failed!");
+    report_.AddCount("candidates_rejected");
+    return false;
+  }
+
+  size_t num_scanned = 0;
+
+  if (hierarchy_.NumLevels() > 0)
+  {
+    // Add the points seen by the images of the bundle adjustment
+    for (const auto& image : ba->Images())
+    {
+      for (const auto& point2d : image.second.Points2d())
+      {
+        ++num_scanned;
+        if (!point2d.HasPoint3d() || ba->HasPoint(point2d.Point3dId()))
+        {
+          continue;
+        }
+
+        const auto it = reader_->Points().find(point2d.Point3dId());
+        if (it != reader_->Points().end())
+        {
+          MERCATOR_DEBUG(logger_) << "Adding point " << it->first;
+          ba->AddPoint(it->second);
+        }
+      }
+    }
+
+    // Add the other points whose projection exists in the virtual camera's
+    // frame, only testing those in voxels that may be visible
+    std::vector<uint64_t> point3d_ids;
+    hierarchy_.FindVisible(camera, *virtual_image, &point3d_ids);
+    num_scanned += point3d_ids.size();
+    for (const auto point3d_id : point3d_ids)
+    {
+      if (ba->HasPoint(point3d_id))
+      {
+        continue;
+      }
+
+      const Point3d& point = reader_->Point(point3d_id);
+      if (ProjectPointOntoImage(point, camera, virtual_image))
+      {
+        MERCATOR_DEBUG(logger_) << "Adding point " << point3d_id;
+        ba->AddPoint(point);
+      }
+    }
+  }
+  else
+  {
+    num_scanned += reader_->Points().size();
+    for (const auto& other_point : reader_->Points())
+    {
+      if (ba->HasPoint(other_point.first))
+      {
+        continue;
+      }
+
+      // If this point is visible in any of the images in the bundle
+      // adjustment, add it to the BA
+      const auto& image_ids = other_point.second.ImageIds();
+      if (std::any_of(image_ids.begin(), image_ids.end(),
+            [ba](uint32_t image_id) { return ba->HasImage(image_id); }))
+      {
+        MERCATOR_DEBUG(logger_) << "Adding point " << other_point.first;
+        ba->AddPoint(other_point.second);
+      }
+      // Otherwise, if the projection of this point onto our virtual camera
+      // exists in the virtual camera's frame, add it to the BA
+      else if (ProjectPointOntoImage(other_point.second, camera, virtual_image))
+      {
+        MERCATOR_DEBUG(logger_) << "Adding point " << other_point.first;
+        ba->AddPoint(other_point.second);
+      }
+    }
+  }
+
+  // Add our new virtual camera to the bundle adjustment
+  ba->AddImage(*virtual_image);
+
+  report_.AddCount("points_scanned", num_scanned);
+  report_.AddSample("points_per_ba", ba->Points().size());
+  report_.AddSample("images_per_ba", ba->Images().size());
+  if (report_.MemoryProbes())
+  {
+    report_.AddSample("memory/ba_bytes", ba->MemoryUsage());
+  }
+
+  if (corpus_writer_ != nullptr &&
+      !corpus_writer_->Write(
+        CapturedProblem::FromBundleAdjustment(*ba, region, *virtual_image)))
+  {
+    logger_.Warn("Failed to capture bundle adjustment");
+  }
+
+  return true;
+}
+
+void Planner::SolveProblem(BundleAdjustment* ba) const
+{
+  logger_.Info() << "Starting bundle adjustment with "
+                 << ba->Points().size() << " points and "
+                 << ba->Images().size() << " images" << std::endl;
+
+  {
+    ScopedTimer timer(&report_, "bundle_adjustment");
+    ScopedMemoryProbe memory(&report_, "bundle_adjustment");
+    ba->Run();
+  }
+
+  const ceres::Solver::Summary& summary = ba->Summary();
+  solver_statistics_.Add(summary);
+  report_.AddCount("residual_blocks", summary.num_residual_blocks);
+  report_.AddCount("solver_iterations",
+                   summary.num_successful_steps +
+                   summary.num_unsuccessful_steps);
+}
+
+double Planner::EvaluateProblem(const PointRegion& region,
+                                BundleAdjustment* ba) const
+{
+  // Compute covariance of the points in the region
+  {
+    ScopedTimer timer(&report_, "covariance");
+    ScopedMemoryProbe memory(&report_, "covariance");
+    ba->ComputeCovariance(region.point3d_ids);
+  }
+
+  double uncertainty = 0.0;
+  for (const auto point3d_id : region.point3d_ids)
+  {
+    uncertainty = std::max(uncertainty,
+                           ba->Points().at(point3d_id).Uncertainty());
+  }
+
+  logger_.Info() << "Old uncertainty: " << region.uncertainty << std::endl;
+  logger_.Info() << "New uncertainty: " << uncertainty << std::endl;
+
+  if (uncertainty >= region.uncertainty)
+  {
+    report_.AddCount("candidates_not_improving");
+  }
+
+  if (options_.print_ba_summary > 0)
+  {
+    ba->PrintSummary(options_.print_ba_summary == 2);
+  }
+
+  return uncertainty;
+}
+
+bool Planner::PlanRegion(const PointRegion& region,
+                         const double angle,
+                         Image* virtual_image,
+                         double* uncertainty)
+{
+  // Candidates depend only on the points of the region, the angle and the
+  // ground sampling distance
+  uint64_t key = 0;
+  std::vector<uint64_t> point3d_ids;
+  if (candidate_cache_ != nullptr)
+  {
+    point3d_ids = region.point3d_ids;
+    std::sort(point3d_ids.begin(), point3d_ids.end());
+    for (const auto point3d_id : point3d_ids)
+    {
+      key = HashValue(point3d_id, key);
+    }
+    key = HashValue(angle, key);
+    key = HashValue(options_.min_ground_sampling_distance, key);
+
+    const auto range = candidate_cache_->equal_range(key);
+    for (auto cached = range.first; cached != range.second; ++cached)
+    {
+      const CandidateResult& candidate = cached->second;
+      if (candidate.angle == angle &&
+          candidate.min_ground_sampling_distance ==
+            options_.min_ground_sampling_distance &&
+          candidate.point3d_ids == point3d_ids)
+      {
+        report_.AddCount("candidates_reused");
+        *virtual_image = candidate.virtual_image;
+        *uncertainty = candidate.uncertainty;
+        return candidate.improves;
+      }
+    }
+  }
+
+  const bool improves =
+    SolveCandidate(region, angle, virtual_image, uncertainty);
+
+  if (candidate_cache_ != nullptr)
+  {
+    candidate_cache_->emplace(
+        key, CandidateResult{ std::move(point3d_ids), angle,
+                              options_.min_ground_sampling_distance,
+                              *virtual_image, *uncertainty, improves });
+  }
+
+  return improves;
+}
+
+bool Planner::SolveCandidate(const PointRegion& region,
+                             const double angle,
+                             Image* virtual_image,
+                             double* uncertainty)
+{
+  BundleAdjustment ba(BundleAdjustmentOptions());
+  if (!BuildProblem(region, angle, virtual_image, &ba))
+  {
+    *uncertainty = region.uncertainty;
+    return false;
+  }
+
+  // Building the problem runs on this thread alone, so the idle threads of
+  // the pool are only borrowed from here until the covariance is computed
+  const ThreadLease lease(thread_pool_, thread_pool_ != nullptr
+                                          ? thread_pool_->NumThreads() - 1 : 0);
+  if (thread_pool_ != nullptr)
+  {
+    ba.SetNumThreads(lease.NumThreads());
+  }
+
+  SolveProblem(&ba);
+
+  *uncertainty = EvaluateProblem(region, &ba);
+
+  return *uncertainty < region.uncertainty;
+}
+
+double Planner::Priority(const PointRegion& region,
+                         const double uncertainty) const
+{
+  const double num_cameras = static_cast<double>(region.min_num_cameras);
+  const double min_cameras = static_cast<double>(options_.min_cameras);
+  const double camera_deficit = min_cameras > 0
+    ? std::max(0.0, min_cameras - num_cameras) / min_cameras : 0.0;
+
+  // With a threshold of 0 no region is ever covered, and the uncertainty
+  // alone orders them
+  const double relative_uncertainty = options_.uncertainty_threshold > 0
+    ? uncertainty / options_.uncertainty_threshold : uncertainty;
+
+  return relative_uncertainty + camera_deficit;
+}
+
+double Planner::CandidateAngle(const int candidate) const
+{
+  // 0, +step, -step, +2 step, -2 step, ...
+  const int multiple = (candidate + 1) / 2;
+  const double sign = (candidate % 2 == 1) ? 1.0 : -1.0;
+  return sign * multiple * options_.candidate_angle_step;
+}
+
+std::vector<double> Planner::CandidateAngles(const PointRegion& region) const
+{
+  const int num_candidates = std::max(options_.max_candidates_per_region, 1);
+
+  std::vector<double> angles;
+  if (hierarchy_.NumLevels() == 0)
+  {
+    for (int k = 0; k < num_candidates; ++k)
+    {
+      angles.push_back(CandidateAngle(k));
+    }
+    return angles;
+  }
+
+  Image virtual_image;
+  const auto predict = [&](const double angle)
+  {
+    CreateVirtualCameraForRegion(region.centroid,
+                                 region.covariance,
+                                 *camera_,
+                                 options_.min_ground_sampling_distance,
+                                 angle,
+                                 &virtual_image);
+    return PredictUncertainty(region, virtual_image);
+  };
+
+  // Score a coarse grid twice as wide as the number of candidates
+  std::vector<std::pair<double, double>> scored;
+  for (int k = 0; k < 2 * num_candidates + 1; ++k)
+  {
+    const double angle = CandidateAngle(k);
+    scored.emplace_back(predict(angle), angle);
+  }
+  std::stable_sort(scored.begin(), scored.end(),
+      [](const std::pair<double, double>& a, const std::pair<double, double>& b)
+      {
+        return a.first < b.first;
+      });
+
+  // Refine the best angle by halving the step around it
+  double best_uncertainty = scored[0].first;
+  double best_angle = scored[0].second;
+  for (double step = options_.candidate_angle_step / 2;
+       step > options_.candidate_angle_step / 8;
+       step /= 2)
+  {
+    const double center = best_angle;
+    for (const double angle : { center - step, center + step })
+    {
+      const double uncertainty = predict(angle);
+      if (uncertainty < best_uncertainty)
+      {
+        best_uncertainty = uncertainty;
+        best_angle = angle;
+      }
+    }
+  }
+
+  // The refined angle replaces the best coarse one
+  angles.push_back(best_angle);
+  for (size_t i = 1; i < scored.size() &&
+       angles.size() < static_cast<size_t>(num_candidates); ++i)
+  {
+    angles.push_back(scored[i].second);
+  }
+
+  return angles;
+}
+
+void Planner::FindVisiblePoints(Image* virtual_image,
+                                std::vector<uint64_t>* point3d_ids) const
+{
+  if (hierarchy_.NumLevels() > 0)
+  {
+    std::vector<uint64_t> candidate_ids;
+    hierarchy_.FindVisible(*camera_, *virtual_image, &candidate_ids);
+    for (const auto point3d_id : candidate_ids)
+    {
+      if (ProjectPointOntoImage(reader_->Point(point3d_id), *camera_,
+                                virtual_image))
+      {
+        point3d_ids->push_back(point3d_id);
+      }
+    }
+  }
+  else
+  {
+    for (const auto& point : reader_->Points())
+    {
+      if (ProjectPointOntoImage(point.second, *camera_, virtual_image))
+      {
+        point3d_ids->push_back(point.first);
+      }
+    }
+  }
+}
+
+uint64_t Planner::RegionHash(
+    const PointRegion& region,
+    const std::vector<double>& angles,
+    std::unordered_map<uint32_t, uint64_t>* image_hashes) const
+{
+  uint64_t hash = result_cache_->RegionHash(region);
+  hash = ResultCache::HashCamera(*camera_, hash);
+
+  std::set<uint32_t> image_ids;
+  for (const auto point3d_id : region.point3d_ids)
+  {
+    const auto& ids = reader_->Point(point3d_id).ImageIds();
+    image_ids.insert(ids.begin(), ids.end());
+  }
+
+  std::vector<uint64_t> neighbour_ids;
+  for (const auto image_id : image_ids)
+  {
+    const Image& image = reader_->Image(image_id);
+    auto it = image_hashes->find(image_id);
+    if (it == image_hashes->end())
+    {
+      it = image_hashes->emplace(
+          image_id,
+          ResultCache::HashImage(image,
+                                 reader_->Camera(image.CameraId()))).first;
+    }
+    hash = HashValue(it->second, hash);
+
+    for (const auto& point2d : image.Points2d())
+    {
+      if (point2d.HasPoint3d())
+      {
+        neighbour_ids.push_back(point2d.Point3dId());
+      }
+    }
+  }
+
+  for (const double angle : angles)
+  {
+    Image virtual_image;
+    CreateVirtualCameraForRegion(region.centroid,
+                                 region.covariance,
+                                 *camera_,
+                                 options_.min_ground_sampling_distance,
+                                 angle,
+                                 &virtual_image);
+    FindVisiblePoints(&virtual_image, &neighbour_ids);
+  }
+
+  std::sort(neighbour_ids.begin(), neighbour_ids.end());
+  neighbour_ids.erase(std::unique(neighbour_ids.begin(), neighbour_ids.end()),
+                      neighbour_ids.end());
+  for (const auto point3d_id : neighbour_ids)
+  {
+    hash = HashValue(point3d_id, hash);
+    hash = HashValue(result_cache_->PointHash(point3d_id), hash);
+  }
+
+  return hash;
+}
+
+double Planner::PredictUncertainty(const PointRegion& region,
+                                   const Image& virtual_image) const
+{
+  Eigen::Matrix3d information;
+  bool invertible;
+  region.covariance.computeInverseWithCheck(information, invertible);
+  if (!invertible)
+  {
+    return region.uncertainty;
+  }
+
+  // An observation constrains the directions perpendicular to the viewing
+  // ray, scaled by the focal length over the depth
+  const Eigen::Vector3d ray =
+    region.centroid - virtual_image.ProjectionCenter();
+  const double depth = ray.norm();
+  if (depth == 0)
+  {
+    return region.uncertainty;
+  }
+
+  const Eigen::Vector3d direction = ray / depth;
+  const double scale = camera_->Params()[0] / depth;
+  information += scale * scale *
+    (Eigen::Matrix3d::Identity() - direction * direction.transpose());
+
+  return MaxEigenvalue(information.inverse());
+}
+
+double Planner::RemainingTime() const
+{
+  if (options_.time_budget <= 0)
+  {
+    return std::numeric_limits<double>::infinity();
+  }
+
+  return std::chrono::duration<double>(deadline_ - Clock::now()).count();
+}
+
+BundleAdjustment::Options Planner::BundleAdjustmentOptions() const
+{
+  // Do not let the solver run past the deadline
+  BundleAdjustment::Options ba_options = options_.ba_options;
+  ba_options.solver_options.max_solver_time_in_seconds = std::min(
+      ba_options.solver_options.max_solver_time_in_seconds,
+      std::max(RemainingTime(), 0.0));
+  return ba_options;
+}
+
+const Planner::Options& Planner::PlannerOptions() const { return options_; }
+
+void Planner::SetThresholds(const double uncertainty_threshold,
+                            const uint64_t min_cameras)
+{
+  options_.uncertainty_threshold = uncertainty_threshold;
+  options_.min_cameras = min_cameras;
+}
+
+void Planner::SetTimeBudget(const double time_budget)
+{
+  options_.time_budget = time_budget;
+  deadline_ = Clock::now() + std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(time_budget));
+}
+
+void Planner::AddVirtualCamera(const Image& image, const double uncertainty)
+{
+  logger_.Info("Adding new image to virtual cameras list");
+  virtual_cameras_.push_back(image);
+  virtual_camera_uncertainties_.push_back(uncertainty);
+}
+
+const std::vector<Image>& Planner::VirtualCameras() const
+{
+  return virtual_cameras_;
+}
+
+const std::vector<double>& Planner::VirtualCameraUncertainties() const
+{
+  return virtual_camera_uncertainties_;
+}
+
+void Planner::SetRegionFilter(RegionFilter filter)
+{
+  region_filter_ = std::move(filter);
+}
+
+RunReport& Planner::Report() const { return report_; }
+
+const SolverStatistics& Planner::SolverStats() const
+{
+  return solver_statistics_;
+}
+
+void Planner::SetCorpusWriter(ProblemCorpusWriter* writer)
+{
+  corpus_writer_ = writer;
+}
+
+void Planner::SetResultCache(ResultCache* cache)
+{
+  result_cache_ = cache;
+}
+
+void Planner::SetCandidateCache(CandidateCache* cache)
+{
+  candidate_cache_ = cache;
+}
+
+void Planner::SetThreadPool(ThreadPool* pool)
+{
+  thread_pool_ = pool;
+}
+
+} // namespace mercator
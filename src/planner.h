@@ -0,0 +1,336 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_PLANNER_H_
+#define MERCATOR_PLANNER_H_
+
+#include <chrono>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+#include "bundle_adjustment.h"
+#include "camera.h"
+#include "clustering.h"
+#include "image.h"
+#include "model_delta.h"
+#include "point3d.h"
+#include "point_hierarchy.h"
+#include "problem_corpus.h"
+#include "result_cache.h"
+#include "solver_statistics.h"
+#include "util/colmap.h"
+#include "util/config.h"
+#include "util/logger.h"
+#include "util/memory.h"
+#include "util/report.h"
+#include "util/thread_pool.h"
+#include "util/trace.h"
+
+namespace mercator {
+
+// Finds the points of a reconstruction that do not meet the coverage
+// criteria and plans virtual cameras that improve them
+class Planner {
+ public:
+  struct Options {
+    // Points with an uncertainty below this value and seen by at least
+    // min_cameras images are considered covered
+    double uncertainty_threshold = 0.01;
+    uint64_t min_cameras = 3;
+
+    // Size (in mm) of each pixel of the camera
+    double camera_pixel_size = 0.00224;
+
+    // Ground sampling distance constraint, in cm
+    double min_ground_sampling_distance = 0.0001;
+
+    // Edge length of the voxels used to group uncovered points into regions.
+    // If not positive, every point is its own region.
+    double region_voxel_size = 1.0;
+
+    // 0 - don't print, 1 - brief summary, 2 - full summary
+    int print_ba_summary = 0;
+
+    // Number of candidate cameras tried for each region. Candidates after
+    // the first are rotated away from the minimum eigenvector by multiples
+    // of candidate_angle_step (in radians).
+    int max_candidates_per_region = 4;
+    double candidate_angle_step = 0.26;
+
+    // Wall clock time (in seconds) after which planning stops and the best
+    // cameras found so far are kept. If not positive, there is no limit.
+    double time_budget = 0.0;
+
+    // Levels of the point hierarchy built after loading, the finest with
+    // voxels of lod_voxel_size. With a hierarchy, the neighbourhood of a
+    // region is found by culling whole voxels outside the virtual frame and
+    // candidate angles are ranked by a predicted uncertainty before any
+    // bundle adjustment is run. If not positive, every point is tested and
+    // candidates are tried in a fixed order.
+    int lod_levels = 0;
+    double lod_voxel_size = 0.5;
+
+    BundleAdjustment::Options ba_options;
+
+    Options() {}
+    explicit Options(const ConfigManager& config);
+
+    // Hash of the options that affect the results of planning, i.e. all but
+    // the time budget and the printing options
+    uint64_t Hash() const;
+  };
+
+  // The reader may still be loading when the planner is created, but the
+  // cameras must have been read before Start() is called
+  Planner(const Options& options, const Logger& logger, ColmapReader* reader);
+
+  // Start the time budget, select the camera used for the virtual images and
+  // build the point hierarchy, unless one was set. Called by Run().
+  void Start();
+
+  // Use a hierarchy built beforehand, e.g. read from a model index, instead
+  // of building one in Start()
+  void SetPointHierarchy(PointHierarchy hierarchy);
+
+  // Points affected by an update of the model
+  struct UpdateResult {
+    // Points that were added or changed
+    std::vector<uint64_t> point3d_ids;
+
+    // Points of the update that meet the coverage criteria and did not
+    // before, and the reverse. New points are listed by their coverage.
+    std::vector<uint64_t> covered_point3d_ids;
+    std::vector<uint64_t> uncovered_point3d_ids;
+  };
+
+  // Apply changes to the model without reloading it and classify the points
+  // they touch again. The points that were added or changed are returned
+  // by the point hierarchy without culling, until so many accumulate that
+  // the hierarchy is rebuilt. The points must have been classified before.
+  // Returns false if the delta is invalid.
+  bool ApplyDelta(const ModelDelta& delta, UpdateResult* result);
+
+  // Classify every point, group the uncovered points into regions and plan
+  // virtual cameras for them. Regions are visited worst first; a region is
+  // revisited with other candidate cameras after every other region had its
+  // turn, until the candidates or the time budget are exhausted.
+  void Run();
+
+  // Whether a point meets the coverage criteria
+  bool IsCovered(const Point3d& point3d) const;
+
+  // Mark the points that meet the coverage criteria as covered and return
+  // the others
+  std::vector<const Point3d*> Classify();
+
+  // Group uncovered points into regions, sorted from the highest to the
+  // lowest priority
+  std::vector<PointRegion> MakeRegions(
+      const std::vector<const Point3d*>& uncovered) const;
+
+  // Create a virtual camera for a region, rotated by the given angle, and add
+  // it to a bundle adjustment together with the region, the images that see
+  // it and the neighbouring points. Returns false if the virtual camera does
+  // not see the region.
+  bool BuildProblem(const PointRegion& region,
+                    const double angle,
+                    Image* virtual_image,
+                    BundleAdjustment* ba) const;
+
+  // Same as above for a virtual camera whose pose is already set
+  bool BuildProblem(const PointRegion& region,
+                    Image* virtual_image,
+                    BundleAdjustment* ba) const;
+
+  // Run the bundle adjustment of a candidate camera
+  void SolveProblem(BundleAdjustment* ba) const;
+
+  // Compute the covariance of the points of a region after the bundle
+  // adjustment has been run and return the largest uncertainty
+  double EvaluateProblem(const PointRegion& region,
+                         BundleAdjustment* ba) const;
+
+  // Build, solve and evaluate the problem for one candidate camera of a
+  // region, unless the candidate cache has it. Returns true if the camera
+  // lowers the uncertainty of the region, which is returned in uncertainty.
+  bool PlanRegion(const PointRegion& region,
+                  const double angle,
+                  Image* virtual_image,
+                  double* uncertainty);
+
+  // How urgently a region needs a new view, given its current uncertainty.
+  // Combines the uncertainty relative to the threshold, or the uncertainty
+  // itself if the threshold is not positive, with the fraction of missing
+  // cameras.
+  double Priority(const PointRegion& region, const double uncertainty) const;
+
+  // Angle offset of the nth candidate camera of a region on the coarse grid
+  // of candidate_angle_step: 0, +step, -step, +2 step, ...
+  double CandidateAngle(const int candidate) const;
+
+  // Angle offsets of the candidate cameras of a region, in the order they
+  // should be tried. Without a point hierarchy this is the coarse grid.
+  // Otherwise the coarse grid is scored with PredictUncertainty, the best
+  // angle is refined with finer steps, and the best max_candidates_per_region
+  // angles are returned, best first.
+  std::vector<double> CandidateAngles(const PointRegion& region) const;
+
+  // Cheap estimate of the uncertainty of a region after adding a view from
+  // the virtual image, treating the region as a single point that gains the
+  // information of one observation with a noise of one pixel
+  double PredictUncertainty(const PointRegion& region,
+                            const Image& virtual_image) const;
+
+  // Append the IDs of the points whose projection lies in the frame of the
+  // virtual image, which gains their 2D points. Uses the point hierarchy if
+  // there is one.
+  void FindVisiblePoints(Image* virtual_image,
+                         std::vector<uint64_t>* point3d_ids) const;
+
+  // Seconds left before the deadline, or infinity if there is no budget
+  double RemainingTime() const;
+
+  // Bundle adjustment options with the solver limited to the remaining time
+  BundleAdjustment::Options BundleAdjustmentOptions() const;
+
+  const Options& PlannerOptions() const;
+
+  // Change the coverage criteria. Points must be classified again.
+  void SetThresholds(const double uncertainty_threshold,
+                     const uint64_t min_cameras);
+
+  // Restart the time budget with the given number of seconds. If not
+  // positive, there is no limit.
+  void SetTimeBudget(const double time_budget);
+
+  // Add a virtual camera together with the uncertainty of the region it was
+  // planned for
+  void AddVirtualCamera(const Image& image, const double uncertainty);
+
+  // Virtual cameras that were found to improve the reconstruction
+  const std::vector<Image>& VirtualCameras() const;
+
+  // Uncertainty of the region of each virtual camera, once it is added
+  const std::vector<double>& VirtualCameraUncertainties() const;
+
+  // Only plan for the regions accepted by the filter, e.g. those of one
+  // tile of the scene. The other points are still classified and used as
+  // neighbours. An empty filter accepts every region.
+  typedef std::function<bool(const PointRegion&)> RegionFilter;
+  void SetRegionFilter(RegionFilter filter);
+
+  // Timings and counters of the planning stages
+  RunReport& Report() const;
+
+  // Ceres timing breakdown of every bundle adjustment that was solved
+  const SolverStatistics& SolverStats() const;
+
+  // Capture the inputs of every bundle adjustment that is built, for
+  // replaying with mercator_replay. The writer must outlive the planner.
+  void SetCorpusWriter(ProblemCorpusWriter* writer);
+
+  // Reuse the classification of the points and the cameras of the regions
+  // found by a previous run, and record the results of this run. Only used
+  // by Run(). The cache must outlive the planner.
+  void SetResultCache(ResultCache* cache);
+
+  // Outcome of PlanRegion() for one candidate camera of a region, which does
+  // not depend on the coverage criteria. The sorted point IDs, the angle and
+  // the ground sampling distance identify the candidate, as different
+  // candidates may have the same hash.
+  struct CandidateResult {
+    std::vector<uint64_t> point3d_ids;
+    double angle;
+    double min_ground_sampling_distance;
+
+    Image virtual_image;
+    double uncertainty;
+    bool improves;
+  };
+  typedef std::unordered_multimap<uint64_t, CandidateResult> CandidateCache;
+
+  // Reuse the outcome of the candidates evaluated before, keyed by the points
+  // of the region, the angle and the ground sampling distance, and record
+  // those evaluated now. Meant to be shared by planners of the same model
+  // that differ only in their coverage criteria. The cache must outlive the
+  // planner.
+  void SetCandidateCache(CandidateCache* cache);
+
+  // Run each bundle adjustment of PlanRegion() on the calling thread and the
+  // threads of the pool that are idle at the time, instead of the number of
+  // threads in the options. The pool must outlive the planner.
+  void SetThreadPool(ThreadPool* pool);
+
+ private:
+  typedef std::chrono::steady_clock Clock;
+
+  // Hash of a region for the result cache, covering what its bundle
+  // adjustments depend on: its points, the images that see them and their
+  // cameras, the points of those images, the points its candidate cameras see
+  // and the camera of the virtual images. The hashes of the images are kept
+  // in image_hashes for the other regions.
+  uint64_t RegionHash(
+      const PointRegion& region,
+      const std::vector<double>& angles,
+      std::unordered_map<uint32_t, uint64_t>* image_hashes) const;
+
+  // PlanRegion() without the candidate cache
+  bool SolveCandidate(const PointRegion& region,
+                      const double angle,
+                      Image* virtual_image,
+                      double* uncertainty);
+
+  Options options_;
+
+  Clock::time_point deadline_;
+
+  const Logger& logger_;
+
+  ColmapReader* reader_;
+
+  // Camera used to take the virtual images
+  const Camera* camera_;
+
+  PointHierarchy hierarchy_;
+
+  std::vector<Image> virtual_cameras_;
+  std::vector<double> virtual_camera_uncertainties_;
+
+  RegionFilter region_filter_;
+
+  ProblemCorpusWriter* corpus_writer_;
+
+  ResultCache* result_cache_;
+
+  ThreadPool* thread_pool_;
+
+  CandidateCache* candidate_cache_;
+
+  // Instrumentation, also recorded by the const stages
+  mutable RunReport report_;
+  mutable SolverStatistics solver_statistics_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_PLANNER_H_
@@ -0,0 +1,749 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <type_traits>
+
+#include <boost/property_tree/json_parser.hpp>
+
+#include "planner_service.h"
+#include "util/json.h"
+
+namespace mercator {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Requests longer than this are rejected and the client is disconnected
+const size_t kMaxRequestSize = 1 << 24;
+
+// Time budget, in seconds, of the requests that run bundle adjustments when
+// neither the request nor the --time-budget option sets one. Requests are
+// served one at a time, so an unlimited budget would hold up every client.
+const double kDefaultTimeBudget = 10.0;
+
+// Set by SIGINT and SIGTERM
+volatile sig_atomic_t stop_requested = 0;
+
+void RequestStop(int) { stop_requested = 1; }
+
+template<typename Vector>
+void WriteArray(std::ostream& os, const Vector& values)
+{
+  os << '[';
+  for (size_t i = 0; i < static_cast<size_t>(values.size()); ++i)
+  {
+    os << (i > 0 ? ", " : "") << values[i];
+  }
+  os << ']';
+}
+
+// Elements of the JSON array of a request. Returns false if there is none.
+template<typename T>
+bool ReadArray(const boost::property_tree::ptree& tree,
+               const std::string& key,
+               std::vector<T>* values)
+{
+  const auto child = tree.get_child_optional(key);
+  if (!child)
+  {
+    return false;
+  }
+
+  values->clear();
+  for (const auto& element : *child)
+  {
+    values->push_back(element.second.get_value<T>());
+  }
+  return true;
+}
+
+// Number given by key in a request, or default_value if the key is missing.
+// Returns false with an error message if the value is not a number of type
+// T, which ptree::get would silently replace by the default.
+template<typename T>
+bool ReadNumber(const boost::property_tree::ptree& tree,
+                const std::string& key,
+                const T default_value,
+                T* value,
+                std::string* error)
+{
+  const auto child = tree.get_child_optional(key);
+  if (!child)
+  {
+    *value = default_value;
+    return true;
+  }
+
+  // JSON values are kept as text, while objects and arrays have children
+  const std::string& text = child->data();
+  std::istringstream ss(text);
+  ss >> *value;
+  if (!child->empty() || text.empty() || ss.fail() || !ss.eof() ||
+      (std::is_unsigned<T>::value && text.find('-') != std::string::npos))
+  {
+    *error = "\"" + key + "\" must be " +
+      (std::is_unsigned<T>::value ? "a non-negative integer"
+       : std::is_integral<T>::value ? "an integer" : "a number");
+    return false;
+  }
+
+  return true;
+}
+
+void WriteCamera(std::ostream& os, const Image& image)
+{
+  const Eigen::Quaterniond& q = image.Rotation();
+  os << "{\"camera_id\": " << image.CameraId() << ", \"qvec\": ";
+  WriteArray(os, Eigen::Vector4d(q.w(), q.x(), q.y(), q.z()));
+  os << ", \"tvec\": ";
+  WriteArray(os, image.Translation());
+  os << '}';
+}
+
+bool SendAll(const int fd, const std::string& data)
+{
+  size_t sent = 0;
+  while (sent < data.size())
+  {
+    const ssize_t n =
+      send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR)
+    {
+      continue;
+    }
+    if (n <= 0)
+    {
+      return false;
+    }
+    sent += n;
+  }
+  return true;
+}
+
+} // namespace
+
+PlannerService::PlannerService(Planner* planner,
+                               ColmapReader* reader,
+                               const Logger& logger)
+  : planner_(planner),
+    reader_(reader),
+    logger_(logger),
+    num_uncovered_(0),
+    default_time_budget_(planner->PlannerOptions().time_budget > 0
+                           ? planner->PlannerOptions().time_budget
+                           : kDefaultTimeBudget),
+    num_requests_(0),
+    shutdown_(false)
+{
+  planner_->Start();
+  Classify();
+}
+
+bool PlannerService::Listen(const std::string& socket_path)
+{
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path))
+  {
+    std::cerr << "Socket path is too long: " << socket_path << std::endl;
+    return false;
+  }
+  std::strcpy(address.sun_path, socket_path.c_str());
+
+  // Replace the socket of a previous instance, but nothing else
+  struct stat info;
+  if (stat(socket_path.c_str(), &info) == 0)
+  {
+    if (!S_ISSOCK(info.st_mode))
+    {
+      std::cerr << socket_path << " exists and is not a socket" << std::endl;
+      return false;
+    }
+    unlink(socket_path.c_str());
+  }
+
+  const int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0)
+  {
+    std::cerr << "Could not create socket: " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+
+  if (bind(fd, reinterpret_cast<const sockaddr*>(&address),
+           sizeof(address)) != 0 ||
+      listen(fd, 16) != 0)
+  {
+    std::cerr << "Could not listen on " << socket_path << ": "
+              << std::strerror(errno) << std::endl;
+    close(fd);
+    return false;
+  }
+
+  // Without SA_RESTART, a signal interrupts the blocking calls below
+  struct sigaction action;
+  std::memset(&action, 0, sizeof(action));
+  action.sa_handler = RequestStop;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGINT, &action, nullptr);
+  sigaction(SIGTERM, &action, nullptr);
+
+  logger_.Info() << "Listening on " << socket_path << std::endl;
+
+  // Every client stays connected while the others are served, and their
+  // requests are answered one at a time as they arrive
+  std::vector<int> clients;
+  std::vector<std::string> buffers;
+  std::vector<pollfd> fds;
+  while (!shutdown_ && !stop_requested)
+  {
+    fds.assign(1, pollfd{ fd, POLLIN, 0 });
+    for (const int client : clients)
+    {
+      fds.push_back(pollfd{ client, POLLIN, 0 });
+    }
+
+    if (poll(fds.data(), fds.size(), -1) < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      std::cerr << "Could not wait for requests: " << std::strerror(errno)
+                << std::endl;
+      break;
+    }
+
+    for (size_t i = fds.size() - 1; i > 0 && !shutdown_; --i)
+    {
+      if (fds[i].revents != 0 && !Serve(clients[i - 1], &buffers[i - 1]))
+      {
+        close(clients[i - 1]);
+        clients.erase(clients.begin() + (i - 1));
+        buffers.erase(buffers.begin() + (i - 1));
+      }
+    }
+
+    if (fds[0].revents != 0)
+    {
+      const int client = accept(fd, nullptr, nullptr);
+      if (client >= 0)
+      {
+        clients.push_back(client);
+        buffers.emplace_back();
+      }
+      else if (errno != EINTR && errno != ECONNABORTED)
+      {
+        std::cerr << "Could not accept connection: " << std::strerror(errno)
+                  << std::endl;
+        break;
+      }
+    }
+  }
+
+  for (const int client : clients)
+  {
+    close(client);
+  }
+  close(fd);
+  unlink(socket_path.c_str());
+
+  logger_.Info() << "Served " << num_requests_ << " requests" << std::endl;
+
+  return true;
+}
+
+bool PlannerService::Serve(const int client, std::string* buffer)
+{
+  char chunk[4096];
+  ssize_t n;
+  do
+  {
+    n = read(client, chunk, sizeof(chunk));
+  } while (n < 0 && errno == EINTR);
+  if (n <= 0)
+  {
+    return false;
+  }
+  buffer->append(chunk, n);
+
+  size_t begin = 0;
+  size_t end;
+  while (!shutdown_ && (end = buffer->find('\n', begin)) != std::string::npos)
+  {
+    const std::string request = buffer->substr(begin, end - begin);
+    begin = end + 1;
+    if (request.find_first_not_of(" \t\r") == std::string::npos)
+    {
+      continue;
+    }
+
+    if (!SendAll(client, HandleRequest(request) + "\n"))
+    {
+      return false;
+    }
+  }
+  buffer->erase(0, begin);
+
+  if (buffer->size() > kMaxRequestSize)
+  {
+    SendAll(client, "{\"ok\": false, \"error\": \"request too large\"}\n");
+    return false;
+  }
+
+  return true;
+}
+
+std::string PlannerService::HandleRequest(const std::string& request)
+{
+  const auto start = Clock::now();
+  ++num_requests_;
+
+  std::ostringstream response;
+  response << std::setprecision(17);
+
+  std::string method;
+  std::string error;
+  bool ok = false;
+  try
+  {
+    Tree tree;
+    std::istringstream ss(request);
+    boost::property_tree::read_json(ss, tree);
+
+    const auto id = tree.get_optional<std::string>("id");
+    if (id)
+    {
+      response << "\"id\": ";
+      WriteJsonString(response, *id);
+      response << ", ";
+    }
+    response << "\"ok\": ";
+
+    std::ostringstream results;
+    results << std::setprecision(17);
+
+    method = tree.get<std::string>("method", "");
+    if (method == "status")
+    {
+      ok = Status(tree, results, &error);
+    }
+    else if (method == "regions")
+    {
+      ok = ListRegions(tree, results, &error);
+    }
+    else if (method == "plan_region")
+    {
+      ok = PlanRegion(tree, results, &error);
+    }
+    else if (method == "score_pose")
+    {
+      ok = ScorePose(tree, results, &error);
+    }
+    else if (method == "set_thresholds")
+    {
+      ok = SetThresholds(tree, results, &error);
+    }
+    else if (method == "update")
+    {
+      ok = Update(tree, results, &error);
+    }
+    else if (method == "shutdown")
+    {
+      shutdown_ = true;
+      ok = true;
+    }
+    else
+    {
+      error = "unknown method \"" + method + "\"";
+    }
+
+    response << (ok ? "true" : "false");
+    if (ok)
+    {
+      response << results.str();
+    }
+  }
+  catch (const boost::property_tree::ptree_error& e)
+  {
+    response.str("");
+    response << "\"ok\": false";
+    error = std::string("invalid request: ") + e.what();
+  }
+  catch (const std::exception& e)
+  {
+    response.str("");
+    response << "\"ok\": false";
+    error = std::string("request failed: ") + e.what();
+  }
+
+  if (!ok)
+  {
+    response << ", \"error\": ";
+    WriteJsonString(response, error);
+  }
+
+  const double seconds =
+    std::chrono::duration<double>(Clock::now() - start).count();
+  response << ", \"seconds\": " << std::setprecision(6) << seconds;
+
+  MERCATOR_DEBUG(logger_) << "Answered " << (method.empty() ? "?" : method)
+                          << " in " << seconds << " s" << std::endl;
+
+  return "{" + response.str() + "}";
+}
+
+const std::vector<PointRegion>& PlannerService::Regions() const
+{
+  return regions_;
+}
+
+void PlannerService::Classify()
+{
+  const std::vector<const Point3d*> uncovered = planner_->Classify();
+  regions_ = planner_->MakeRegions(uncovered);
+  num_uncovered_ = uncovered.size();
+
+  logger_.Info() << num_uncovered_ << " points are not covered, "
+                 << regions_.size() << " regions" << std::endl;
+}
+
+void PlannerService::MakeRegions()
+{
+  std::vector<const Point3d*> uncovered;
+  for (const auto& point : reader_->Points())
+  {
+    if (!point.second.Covered())
+    {
+      uncovered.push_back(&point.second);
+    }
+  }
+  regions_ = planner_->MakeRegions(uncovered);
+  num_uncovered_ = uncovered.size();
+}
+
+bool PlannerService::RequestRegion(const Tree& request,
+                                   PointRegion* region,
+                                   std::string* error) const
+{
+  if (request.get_child_optional("region"))
+  {
+    uint64_t region_idx;
+    if (!ReadNumber<uint64_t>(request, "region", 0, &region_idx, error))
+    {
+      return false;
+    }
+    if (region_idx >= regions_.size())
+    {
+      *error = "no region " + std::to_string(region_idx);
+      return false;
+    }
+    *region = regions_[region_idx];
+    return true;
+  }
+
+  std::vector<uint64_t> point3d_ids;
+  if (!ReadArray(request, "point3d_ids", &point3d_ids) || point3d_ids.empty())
+  {
+    *error = "either \"region\" or \"point3d_ids\" is required";
+    return false;
+  }
+
+  std::vector<const Point3d*> points;
+  for (const auto point3d_id : point3d_ids)
+  {
+    const auto it = reader_->Points().find(point3d_id);
+    if (it == reader_->Points().end())
+    {
+      *error = "no point " + std::to_string(point3d_id);
+      return false;
+    }
+    points.push_back(&it->second);
+  }
+
+  *region = MakeRegion(points);
+  return true;
+}
+
+bool PlannerService::Status(const Tree&,
+                            std::ostream& response,
+                            std::string*)
+{
+  const Planner::Options& options = planner_->PlannerOptions();
+  response << ", \"num_points\": " << reader_->Points().size()
+           << ", \"num_images\": " << reader_->Images().size()
+           << ", \"num_uncovered\": " << num_uncovered_
+           << ", \"num_regions\": " << regions_.size()
+           << ", \"uncertainty_threshold\": " << options.uncertainty_threshold
+           << ", \"min_cameras\": " << options.min_cameras
+           << ", \"num_requests\": " << num_requests_;
+  return true;
+}
+
+bool PlannerService::ListRegions(const Tree& request,
+                                 std::ostream& response,
+                                 std::string* error)
+{
+  int64_t requested_limit;
+  if (!ReadNumber<int64_t>(request, "limit", regions_.size(),
+                           &requested_limit, error))
+  {
+    return false;
+  }
+  if (requested_limit < 0)
+  {
+    *error = "limit must not be negative";
+    return false;
+  }
+  const size_t limit =
+    std::min(static_cast<size_t>(requested_limit), regions_.size());
+
+  response << ", \"regions\": [";
+  for (size_t i = 0; i < limit; ++i)
+  {
+    const PointRegion& region = regions_[i];
+    response << (i > 0 ? ", " : "") << "{\"region\": " << i
+             << ", \"num_points\": " << region.point3d_ids.size()
+             << ", \"centroid\": ";
+    WriteArray(response, region.centroid);
+    response << ", \"uncertainty\": " << region.uncertainty
+             << ", \"min_num_cameras\": " << region.min_num_cameras
+             << ", \"priority\": "
+             << planner_->Priority(region, region.uncertainty) << '}';
+  }
+  response << ']';
+  return true;
+}
+
+bool PlannerService::PlanRegion(const Tree& request,
+                                std::ostream& response,
+                                std::string* error)
+{
+  PointRegion region;
+  if (!RequestRegion(request, &region, error))
+  {
+    return false;
+  }
+
+  const Planner::Options& options = planner_->PlannerOptions();
+  int max_candidates;
+  double time_budget;
+  if (!ReadNumber(request, "max_candidates",
+                  options.max_candidates_per_region, &max_candidates,
+                  error) ||
+      !ReadNumber(request, "time_budget", default_time_budget_,
+                  &time_budget, error))
+  {
+    return false;
+  }
+  planner_->SetTimeBudget(time_budget);
+
+  // Candidates are tried best first until the region meets the threshold or
+  // the time budget is exhausted
+  const std::vector<double> angles = planner_->CandidateAngles(region);
+  Image best_image;
+  double best_uncertainty = region.uncertainty;
+  bool planned = false;
+  int num_candidates = 0;
+  for (int i = 0; i < std::min<int>(max_candidates, angles.size()); ++i)
+  {
+    if (planner_->RemainingTime() <= 0)
+    {
+      break;
+    }
+
+    Image virtual_image;
+    double uncertainty;
+    ++num_candidates;
+    if (planner_->PlanRegion(region, angles[i], &virtual_image,
+                             &uncertainty) &&
+        uncertainty < best_uncertainty)
+    {
+      best_image = virtual_image;
+      best_uncertainty = uncertainty;
+      planned = true;
+    }
+
+    if (best_uncertainty < options.uncertainty_threshold)
+    {
+      break;
+    }
+  }
+
+  response << ", \"planned\": " << (planned ? "true" : "false")
+           << ", \"num_candidates\": " << num_candidates
+           << ", \"old_uncertainty\": " << region.uncertainty
+           << ", \"uncertainty\": " << best_uncertainty;
+  if (planned)
+  {
+    response << ", \"camera\": ";
+    WriteCamera(response, best_image);
+  }
+  return true;
+}
+
+bool PlannerService::ScorePose(const Tree& request,
+                               std::ostream& response,
+                               std::string* error)
+{
+  PointRegion region;
+  if (!RequestRegion(request, &region, error))
+  {
+    return false;
+  }
+
+  std::vector<double> qvec;
+  std::vector<double> tvec;
+  if (!ReadArray(request, "qvec", &qvec) || qvec.size() != 4 ||
+      !ReadArray(request, "tvec", &tvec) || tvec.size() != 3)
+  {
+    *error = "\"qvec\" with 4 and \"tvec\" with 3 elements are required";
+    return false;
+  }
+
+  double time_budget;
+  if (!ReadNumber(request, "time_budget", default_time_budget_, &time_budget,
+                  error))
+  {
+    return false;
+  }
+
+  Image virtual_image;
+  virtual_image.SetRotation(
+      Eigen::Quaterniond(qvec[0], qvec[1], qvec[2], qvec[3]).normalized());
+  virtual_image.SetTranslation(Eigen::Vector3d(tvec[0], tvec[1], tvec[2]));
+
+  planner_->SetTimeBudget(time_budget);
+
+  BundleAdjustment ba(planner_->BundleAdjustmentOptions());
+  const bool visible = planner_->BuildProblem(region, &virtual_image, &ba);
+
+  double uncertainty = region.uncertainty;
+  if (visible)
+  {
+    planner_->SolveProblem(&ba);
+    uncertainty = planner_->EvaluateProblem(region, &ba);
+  }
+
+  response << ", \"visible\": " << (visible ? "true" : "false")
+           << ", \"old_uncertainty\": " << region.uncertainty
+           << ", \"uncertainty\": " << uncertainty;
+  if (visible)
+  {
+    response << ", \"num_points\": " << ba.Points().size()
+             << ", \"num_images\": " << ba.Images().size();
+  }
+  return true;
+}
+
+bool PlannerService::SetThresholds(const Tree& request,
+                                   std::ostream& response,
+                                   std::string* error)
+{
+  const Planner::Options& options = planner_->PlannerOptions();
+  double uncertainty_threshold;
+  uint64_t min_cameras;
+  if (!ReadNumber(request, "uncertainty_threshold",
+                  options.uncertainty_threshold, &uncertainty_threshold,
+                  error) ||
+      !ReadNumber(request, "min_cameras", options.min_cameras, &min_cameras,
+                  error))
+  {
+    return false;
+  }
+  if (uncertainty_threshold <= 0)
+  {
+    *error = "\"uncertainty_threshold\" must be positive";
+    return false;
+  }
+
+  planner_->SetThresholds(uncertainty_threshold, min_cameras);
+  Classify();
+
+  return Status(request, response, error);
+}
+
+bool PlannerService::Update(const Tree& request,
+                            std::ostream& response,
+                            std::string* error)
+{
+  const std::string path = request.get<std::string>("path", "");
+  if (path.empty())
+  {
+    *error = "\"path\" is required";
+    return false;
+  }
+
+  ModelDelta delta;
+  {
+    ColmapReader updated;
+    updated.SetComputeUncertainty(false);
+    if (!updated.Read(path))
+    {
+      *error = "could not read model " + path;
+      return false;
+    }
+    delta = ModelDelta::Diff(*reader_, updated);
+  }
+
+  Planner::UpdateResult result;
+  if (!planner_->ApplyDelta(delta, &result))
+  {
+    *error = "model " + path + " does not match the loaded model";
+    return false;
+  }
+  MakeRegions();
+
+  logger_.Info() << "Applied update with " << delta.images.size()
+                 << " images and " << result.point3d_ids.size()
+                 << " points, " << result.covered_point3d_ids.size()
+                 << " points became covered and "
+                 << result.uncovered_point3d_ids.size() << " uncovered"
+                 << std::endl;
+
+  response << ", \"num_images\": " << delta.images.size()
+           << ", \"num_points\": " << result.point3d_ids.size()
+           << ", \"covered_point3d_ids\": ";
+  WriteArray(response, result.covered_point3d_ids);
+  response << ", \"uncovered_point3d_ids\": ";
+  WriteArray(response, result.uncovered_point3d_ids);
+  response << ", \"num_regions\": " << regions_.size();
+  return true;
+}
+
+} // namespace mercator
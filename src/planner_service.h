@@ -0,0 +1,136 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_PLANNER_SERVICE_H_
+#define MERCATOR_PLANNER_SERVICE_H_
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <boost/property_tree/ptree.hpp>
+
+#include "clustering.h"
+#include "planner.h"
+#include "util/colmap.h"
+#include "util/logger.h"
+
+namespace mercator {
+
+// Keeps a reconstruction loaded and answers planning requests over a Unix
+// domain socket. Requests and responses are JSON objects, one per line. Every
+// request has a "method" and may have an "id", which is echoed back as a
+// string:
+//
+//   {"method": "status"}
+//   {"method": "regions", "limit": 10}
+//   {"method": "plan_region", "region": 0, "time_budget": 0.05}
+//   {"method": "plan_region", "point3d_ids": [12, 13], "max_candidates": 2}
+//   {"method": "score_pose", "region": 0,
+//    "qvec": [1, 0, 0, 0], "tvec": [0, 0, 5]}
+//   {"method": "set_thresholds", "uncertainty_threshold": 0.005,
+//    "min_cameras": 4}
+//   {"method": "update", "path": "/path/to/new/model"}
+//   {"method": "shutdown"}
+//
+// Responses have "ok": true and the results, or "ok": false and an "error",
+// and the time taken in "seconds". Any number of clients may be connected at
+// once, and their requests are served one at a time, in the order they
+// arrive. The time budget of plan_region and score_pose bounds the
+// bundle adjustments they run and defaults to the --time-budget option, or
+// to 10 seconds without one. A time budget of 0 lifts the limit, and the
+// other clients wait until the request is done.
+// update reads a COLMAP model, which may hold only part of the
+// reconstruction, and applies what differs from the loaded one.
+class PlannerService {
+ public:
+  // The reader must have read the model. Starts the planner and classifies
+  // the points.
+  PlannerService(Planner* planner, ColmapReader* reader, const Logger& logger);
+
+  // Accept connections on the socket until a shutdown request or a signal
+  // arrives. Returns false if the socket cannot be created.
+  bool Listen(const std::string& socket_path);
+
+  // Answer one request
+  std::string HandleRequest(const std::string& request);
+
+  // Uncovered regions of the current classification, highest priority first
+  const std::vector<PointRegion>& Regions() const;
+
+ private:
+  typedef boost::property_tree::ptree Tree;
+
+  void Classify();
+
+  // Group the points that are not covered into regions again
+  void MakeRegions();
+
+  // The region of a request, given by "region" or by "point3d_ids". Returns
+  // false with an error message if neither is valid.
+  bool RequestRegion(const Tree& request,
+                     PointRegion* region,
+                     std::string* error) const;
+
+  // Each method appends its results to the response, or returns false with
+  // an error message
+  bool Status(const Tree& request, std::ostream& response, std::string* error);
+  bool ListRegions(const Tree& request,
+                   std::ostream& response,
+                   std::string* error);
+  bool PlanRegion(const Tree& request,
+                  std::ostream& response,
+                  std::string* error);
+  bool ScorePose(const Tree& request,
+                 std::ostream& response,
+                 std::string* error);
+  bool SetThresholds(const Tree& request,
+                     std::ostream& response,
+                     std::string* error);
+  bool Update(const Tree& request, std::ostream& response, std::string* error);
+
+  // Read what a client sent and answer its complete requests, keeping the
+  // rest in buffer. Returns false once the client has disconnected or must
+  // be disconnected.
+  bool Serve(const int client, std::string* buffer);
+
+  Planner* planner_;
+
+  ColmapReader* reader_;
+
+  const Logger& logger_;
+
+  std::vector<PointRegion> regions_;
+  size_t num_uncovered_;
+
+  // Time budget of a request that does not set one, which is never
+  // unlimited
+  double default_time_budget_;
+
+  size_t num_requests_;
+
+  bool shutdown_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_PLANNER_SERVICE_H_
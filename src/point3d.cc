@@ -20,16 +20,47 @@
 //
 // Author: Greg Anders
 
+#include <algorithm>
+
 #include <Eigen/Eigenvalues>
 
 #include "point3d.h"
 
 namespace mercator {
 
+void PackCovariance(const Eigen::Matrix3d& covariance, double* packed)
+{
+  packed[0] = covariance(0, 0);
+  packed[1] = covariance(1, 0);
+  packed[2] = covariance(2, 0);
+  packed[3] = covariance(1, 1);
+  packed[4] = covariance(2, 1);
+  packed[5] = covariance(2, 2);
+}
+
+Eigen::Matrix3d UnpackCovariance(const double* const packed)
+{
+  Eigen::Matrix3d covariance;
+  covariance(0, 0) = packed[0];
+  covariance(0, 1) = covariance(1, 0) = packed[1];
+  covariance(0, 2) = covariance(2, 0) = packed[2];
+  covariance(1, 1) = packed[3];
+  covariance(1, 2) = covariance(2, 1) = packed[4];
+  covariance(2, 2) = packed[5];
+  return covariance;
+}
+
+double MaxEigenvalue(const Eigen::Matrix3d& covariance)
+{
+  Eigen::SelfAdjointEigenSolver<Eigen::Matrix3d> es;
+  es.computeDirect(covariance, Eigen::EigenvaluesOnly);
+  return es.eigenvalues().maxCoeff();
+}
+
 Point3d::Point3d() : point3d_id_(-1),
                      coords_(Eigen::Vector3d::Zero()),
                      color_(Eigen::Vector3ub::Zero()),
-                     covariance_(Eigen::Matrix3d::Zero()),
+                     covariance_{},
                      uncertainty_(-1.0),
                      covered_(false) {}
 
@@ -72,29 +103,45 @@ uint8_t Point3d::Color(const size_t idx) const { return color_(idx); }
 
 void Point3d::SetColor(const Eigen::Vector3ub& color) { color_ = color; }
 
-const Eigen::Matrix3d& Point3d::Covariance() const { return covariance_; }
+Eigen::Matrix3d Point3d::Covariance() const
+{
+  return UnpackCovariance(covariance_);
+}
+
+const double* Point3d::PackedCovariance() const { return covariance_; }
 
-Eigen::Matrix3d& Point3d::Covariance() { return covariance_; }
+bool Point3d::HasCovariance() const
+{
+  return std::any_of(covariance_, covariance_ + kPackedCovarianceSize,
+                     [](const double value) { return value != 0.0; });
+}
 
 void Point3d::SetCovariance(const Eigen::Matrix3d& covariance)
 {
-  covariance_ = covariance;
-  uncertainty_ = covariance.eigenvalues().real().maxCoeff();
+  PackCovariance(covariance, covariance_);
+  uncertainty_ = Covariance().eigenvalues().real().maxCoeff();
+}
+
+void Point3d::SetCovariance(const Eigen::Matrix3d& covariance,
+                            const double uncertainty)
+{
+  PackCovariance(covariance, covariance_);
+  uncertainty_ = uncertainty;
 }
 
 double Point3d::Uncertainty() const
 {
-  return (uncertainty_ == -1.0 && !covariance_.isZero()) ?
-    covariance_.eigenvalues().real().maxCoeff()
+  return (uncertainty_ == -1.0 && HasCovariance()) ?
+    Covariance().eigenvalues().real().maxCoeff()
     :
     uncertainty_;
 }
 
 double& Point3d::Uncertainty()
 {
-  if (uncertainty_ == -1.0 && !covariance_.isZero())
+  if (uncertainty_ == -1.0 && HasCovariance())
   {
-    uncertainty_ = covariance_.eigenvalues().real().maxCoeff();
+    uncertainty_ = Covariance().eigenvalues().real().maxCoeff();
   }
   return uncertainty_;
 }
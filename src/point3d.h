@@ -31,6 +31,21 @@
 
 namespace mercator {
 
+// Number of unique values in a symmetric 3x3 covariance matrix
+const size_t kPackedCovarianceSize = 6;
+
+// Pack the unique values of a symmetric 3x3 matrix in the order
+// (xx, xy, xz, yy, yz, zz). They are read from the lower triangle, the one
+// that the self-adjoint solvers of Eigen use.
+void PackCovariance(const Eigen::Matrix3d& covariance, double* packed);
+
+// Expand a packed covariance back into a full symmetric 3x3 matrix
+Eigen::Matrix3d UnpackCovariance(const double* const packed);
+
+// Maximum eigenvalue of a symmetric 3x3 matrix, computed with the closed form
+// solver
+double MaxEigenvalue(const Eigen::Matrix3d& covariance);
+
 class Point3d {
  public:
   Point3d();
@@ -57,10 +72,20 @@ class Point3d {
   uint8_t Color(const size_t idx) const;
   void SetColor(const Eigen::Vector3ub& color);
 
-  const Eigen::Matrix3d& Covariance() const;
-  Eigen::Matrix3d& Covariance();
+  // The covariance is stored packed, so it is returned by value and only
+  // changed through the setters
+  Eigen::Matrix3d Covariance() const;
+  const double* PackedCovariance() const;
+  bool HasCovariance() const;
+
+  // Set the covariance and compute the uncertainty from it
   void SetCovariance(const Eigen::Matrix3d& covariance);
 
+  // Set the covariance with a known uncertainty, or with -1 to compute the
+  // uncertainty when it is first read
+  void SetCovariance(const Eigen::Matrix3d& covariance,
+                     const double uncertainty);
+
   double Uncertainty() const;
   double& Uncertainty();
   void SetUncertainty(const double uncertainty);
@@ -82,8 +107,9 @@ class Point3d {
   // (R, G, B) color value of this point
   Eigen::Vector3ub color_;
 
-  // 3x3 uncertainty covariance matrix of this point's 3D position
-  Eigen::Matrix3d covariance_;
+  // Unique values of the 3x3 uncertainty covariance matrix of this point's
+  // 3D position, packed by PackCovariance
+  double covariance_[kPackedCovarianceSize];
 
   // Scalar uncertainty value, equal to the maximum eigenvalue of the
   // covariance matrix
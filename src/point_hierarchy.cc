@@ -0,0 +1,386 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "point_hierarchy.h"
+#include "voxel_grid.h"
+
+namespace mercator {
+
+namespace {
+
+// Floor division by 2^shift
+inline int64_t ShiftDown(const int64_t v, const int shift)
+{
+  return v >= 0 ? v >> shift : -((-v - 1) >> shift) - 1;
+}
+
+inline VoxelKey ParentKey(const VoxelKey& key, const int shift)
+{
+  return { ShiftDown(key.x, shift),
+           ShiftDown(key.y, shift),
+           ShiftDown(key.z, shift) };
+}
+
+inline bool KeyLess(const VoxelKey& a, const VoxelKey& b)
+{
+  if (a.x != b.x) return a.x < b.x;
+  if (a.y != b.y) return a.y < b.y;
+  return a.z < b.z;
+}
+
+// Closed interval, used to bound the projection of a node
+struct Interval {
+  double lo;
+  double hi;
+
+  Interval operator+(const Interval& other) const
+  {
+    return { lo + other.lo, hi + other.hi };
+  }
+
+  Interval operator+(const double v) const { return { lo + v, hi + v }; }
+
+  Interval operator*(const Interval& other) const
+  {
+    const double a = lo * other.lo;
+    const double b = lo * other.hi;
+    const double c = hi * other.lo;
+    const double d = hi * other.hi;
+    return { std::min(std::min(a, b), std::min(c, d)),
+             std::max(std::max(a, b), std::max(c, d)) };
+  }
+
+  Interval operator*(const double v) const
+  {
+    return v >= 0 ? Interval{ lo * v, hi * v } : Interval{ hi * v, lo * v };
+  }
+
+  Interval Square() const
+  {
+    if (lo <= 0 && hi >= 0)
+    {
+      return { 0.0, std::max(lo * lo, hi * hi) };
+    }
+    return { std::min(lo * lo, hi * hi), std::max(lo * lo, hi * hi) };
+  }
+};
+
+// Whether a sphere may project inside the frame of the camera. Mirrors the
+// projection of Camera::WorldToImage, so that a point is never rejected here
+// if ProjectPointOntoImage accepts it.
+bool MayBeVisible(const std::vector<double>& params,
+                  const double width,
+                  const double height,
+                  const Eigen::Vector3d& local,
+                  const double radius)
+{
+  const double abs_z = std::abs(local(2));
+
+  // The sphere crosses the image plane, so its projection is unbounded
+  if (abs_z <= radius)
+  {
+    return true;
+  }
+
+  // Bound the normalized coordinates of every point of the sphere
+  const double xp = local(0) / local(2);
+  const double yp = local(1) / local(2);
+  const double ex = radius * (1.0 + std::abs(xp)) / (abs_z - radius);
+  const double ey = radius * (1.0 + std::abs(yp)) / (abs_z - radius);
+  const Interval x = { xp - ex, xp + ex };
+  const Interval y = { yp - ey, yp + ey };
+
+  const double focal_length = params[0];
+  const double cx = params[1];
+  const double cy = params[2];
+  const double radial_distortion = params[3];
+
+  const Interval distortion =
+    (x.Square() + y.Square()) * radial_distortion + 1.0;
+  const Interval u = (x * distortion) * focal_length + cx;
+  const Interval v = (y * distortion) * focal_length + cy;
+
+  return u.hi >= 0 && u.lo <= width && v.hi >= 0 && v.lo <= height;
+}
+
+} // namespace
+
+PointHierarchy::PointHierarchy() : voxel_size_(0.0) {}
+
+void PointHierarchy::Build(const std::map<uint64_t, Point3d>& points,
+                           const double voxel_size,
+                           const int num_levels)
+{
+  Clear();
+
+  if (points.empty() || voxel_size <= 0 || num_levels <= 0)
+  {
+    return;
+  }
+
+  voxel_size_ = voxel_size;
+
+  const VoxelGrid grid(voxel_size);
+
+  struct Entry {
+    VoxelKey key;
+    const Point3d* point3d;
+  };
+
+  std::vector<Entry> entries;
+  entries.reserve(points.size());
+  for (const auto& point : points)
+  {
+    entries.push_back({ grid.Key(point.second.Coords()), &point.second });
+  }
+
+  // Order the points by their voxel at every level, coarsest first, so that
+  // the points and children below any node are contiguous
+  const int top = num_levels - 1;
+  std::sort(entries.begin(), entries.end(),
+      [top](const Entry& a, const Entry& b)
+      {
+        for (int shift = top; shift >= 0; --shift)
+        {
+          const VoxelKey ka = ParentKey(a.key, shift);
+          const VoxelKey kb = ParentKey(b.key, shift);
+          if (!(ka == kb))
+          {
+            return KeyLess(ka, kb);
+          }
+        }
+        return a.point3d->Point3dId() < b.point3d->Point3dId();
+      });
+
+  point3d_ids_.reserve(entries.size());
+  for (const auto& entry : entries)
+  {
+    point3d_ids_.push_back(entry.point3d->Point3dId());
+  }
+
+  levels_.resize(num_levels);
+
+  // Level 0 aggregates the points of each voxel
+  std::vector<VoxelKey> keys;
+  for (size_t begin = 0; begin < entries.size(); )
+  {
+    size_t end = begin + 1;
+    while (end < entries.size() && entries[end].key == entries[begin].key)
+    {
+      ++end;
+    }
+
+    Node node;
+    node.centroid.setZero();
+    node.radius = 0.0;
+    node.num_points = end - begin;
+    node.begin = static_cast<uint32_t>(begin);
+    node.end = static_cast<uint32_t>(end);
+
+    for (size_t i = begin; i < end; ++i)
+    {
+      node.centroid += entries[i].point3d->Coords();
+    }
+    node.centroid /= node.num_points;
+
+    for (size_t i = begin; i < end; ++i)
+    {
+      node.radius = std::max(node.radius,
+          (entries[i].point3d->Coords() - node.centroid).norm());
+    }
+
+    levels_[0].push_back(node);
+    keys.push_back(entries[begin].key);
+    begin = end;
+  }
+
+  // Every level above aggregates the nodes of the level below
+  for (int level = 1; level < num_levels; ++level)
+  {
+    const std::vector<Node>& children = levels_[level - 1];
+    std::vector<VoxelKey> parent_keys;
+
+    for (size_t begin = 0; begin < children.size(); )
+    {
+      const VoxelKey key = ParentKey(keys[begin], 1);
+      size_t end = begin + 1;
+      while (end < children.size() && ParentKey(keys[end], 1) == key)
+      {
+        ++end;
+      }
+
+      Node node;
+      node.centroid.setZero();
+      node.radius = 0.0;
+      node.num_points = 0;
+      node.begin = static_cast<uint32_t>(begin);
+      node.end = static_cast<uint32_t>(end);
+
+      for (size_t i = begin; i < end; ++i)
+      {
+        const Node& child = children[i];
+        node.centroid += child.num_points * child.centroid;
+        node.num_points += child.num_points;
+      }
+      node.centroid /= node.num_points;
+
+      for (size_t i = begin; i < end; ++i)
+      {
+        const Node& child = children[i];
+        node.radius = std::max(node.radius,
+            child.radius + (child.centroid - node.centroid).norm());
+      }
+
+      levels_[level].push_back(node);
+      parent_keys.push_back(key);
+      begin = end;
+    }
+
+    keys.swap(parent_keys);
+  }
+}
+
+void PointHierarchy::Assign(const double voxel_size,
+                            std::vector<std::vector<Node>> levels,
+                            std::vector<uint64_t> point3d_ids)
+{
+  voxel_size_ = voxel_size;
+  levels_ = std::move(levels);
+  point3d_ids_ = std::move(point3d_ids);
+  unindexed_ids_.clear();
+}
+
+void PointHierarchy::Clear()
+{
+  voxel_size_ = 0.0;
+  levels_.clear();
+  point3d_ids_.clear();
+  unindexed_ids_.clear();
+}
+
+void PointHierarchy::AddUnindexed(const std::vector<uint64_t>& point3d_ids)
+{
+  unindexed_ids_.insert(unindexed_ids_.end(), point3d_ids.begin(),
+                        point3d_ids.end());
+  std::sort(unindexed_ids_.begin(), unindexed_ids_.end());
+  unindexed_ids_.erase(
+      std::unique(unindexed_ids_.begin(), unindexed_ids_.end()),
+      unindexed_ids_.end());
+}
+
+size_t PointHierarchy::NumUnindexed() const { return unindexed_ids_.size(); }
+
+int PointHierarchy::NumLevels() const
+{
+  return static_cast<int>(levels_.size());
+}
+
+double PointHierarchy::VoxelSize(const int level) const
+{
+  return std::ldexp(voxel_size_, level);
+}
+
+const std::vector<PointHierarchy::Node>& PointHierarchy::Level(
+    const int level) const
+{
+  return levels_[level];
+}
+
+const std::vector<uint64_t>& PointHierarchy::PointIds() const
+{
+  return point3d_ids_;
+}
+
+size_t PointHierarchy::FindVisible(const Camera& camera,
+                                   const Image& image,
+                                   std::vector<uint64_t>* point3d_ids) const
+{
+  if (levels_.empty())
+  {
+    return 0;
+  }
+
+  const std::vector<double> params = camera.Params();
+  const double width = static_cast<double>(camera.Width());
+  const double height = static_cast<double>(camera.Height());
+
+  // Push the nodes of a range of a level that may be visible, transforming
+  // their centroids into the image frame in one product
+  std::vector<std::pair<int, uint32_t>> stack;
+  Eigen::Matrix3Xd centroids;
+  Eigen::Matrix3Xd local_centroids;
+  size_t num_visited = 0;
+  const auto push_visible =
+    [&](const int level, const uint32_t begin, const uint32_t end)
+    {
+      const std::vector<Node>& nodes = levels_[level];
+      centroids.resize(3, end - begin);
+      for (uint32_t i = begin; i < end; ++i)
+      {
+        centroids.col(i - begin) = nodes[i].centroid;
+      }
+      image.Transform(centroids, &local_centroids);
+
+      for (uint32_t i = begin; i < end; ++i)
+      {
+        if (MayBeVisible(params, width, height, local_centroids.col(i - begin),
+                         nodes[i].radius))
+        {
+          stack.emplace_back(level, i);
+        }
+      }
+      num_visited += end - begin;
+    };
+
+  // Depth first, starting from every node of the coarsest level
+  const int top = NumLevels() - 1;
+  push_visible(top, 0, levels_[top].size());
+
+  while (!stack.empty())
+  {
+    const int level = stack.back().first;
+    const Node& node = levels_[level][stack.back().second];
+    stack.pop_back();
+
+    if (level == 0)
+    {
+      point3d_ids->insert(point3d_ids->end(),
+                          point3d_ids_.begin() + node.begin,
+                          point3d_ids_.begin() + node.end);
+    }
+    else
+    {
+      push_visible(level - 1, node.begin, node.end);
+    }
+  }
+
+  point3d_ids->insert(point3d_ids->end(), unindexed_ids_.begin(),
+                      unindexed_ids_.end());
+
+  return num_visited;
+}
+
+} // namespace mercator
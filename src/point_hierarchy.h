@@ -0,0 +1,114 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_POINT_HIERARCHY_H_
+#define MERCATOR_POINT_HIERARCHY_H_
+
+#include <map>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "camera.h"
+#include "image.h"
+#include "point3d.h"
+
+namespace mercator {
+
+// Multi-resolution representation of a point cloud. Level 0 groups the points
+// into voxels of the given size and every level above doubles the voxel size,
+// so that each node is the union of its children in the level below. Each
+// node carries the centroid and a bounding sphere of the points below it,
+// which lets queries be answered on coarse levels and refined only where
+// needed.
+class PointHierarchy {
+ public:
+  struct Node {
+    // Mean position of the points below the node
+    Eigen::Vector3d centroid;
+
+    // Radius of a sphere around the centroid that contains every point
+    // below the node
+    double radius;
+
+    size_t num_points;
+
+    // Range of children in the level below or, for level 0, of PointIds()
+    uint32_t begin;
+    uint32_t end;
+  };
+
+  PointHierarchy();
+
+  // Build num_levels levels over the points, the finest with voxels of
+  // voxel_size
+  void Build(const std::map<uint64_t, Point3d>& points,
+             const double voxel_size,
+             const int num_levels);
+
+  // Replace the hierarchy with one built beforehand, e.g. by a model index
+  void Assign(const double voxel_size,
+              std::vector<std::vector<Node>> levels,
+              std::vector<uint64_t> point3d_ids);
+
+  void Clear();
+
+  int NumLevels() const;
+
+  double VoxelSize(const int level) const;
+
+  const std::vector<Node>& Level(const int level) const;
+
+  // IDs of the points, ordered so that the points below any node are
+  // contiguous
+  const std::vector<uint64_t>& PointIds() const;
+
+  // Track points that were added or moved after the hierarchy was built.
+  // They are returned by every FindVisible call until the next Build, and
+  // the bounding spheres of the nodes do not include them.
+  void AddUnindexed(const std::vector<uint64_t>& point3d_ids);
+
+  size_t NumUnindexed() const;
+
+  // Collect the IDs of the points that may project inside the frame of an
+  // image. Subtrees whose bounding sphere projects entirely outside the frame
+  // are skipped. The test is conservative, so the returned points must still
+  // be projected individually. Returns the number of nodes visited.
+  size_t FindVisible(const Camera& camera,
+                     const Image& image,
+                     std::vector<uint64_t>* point3d_ids) const;
+
+ private:
+  double voxel_size_;
+
+  // Nodes of each level, finest first
+  std::vector<std::vector<Node>> levels_;
+
+  std::vector<uint64_t> point3d_ids_;
+
+  // Sorted IDs of the points added by AddUnindexed
+  std::vector<uint64_t> unindexed_ids_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_POINT_HIERARCHY_H_
@@ -0,0 +1,97 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include "pose_table.h"
+#include "util/memory.h"
+
+namespace mercator {
+
+PoseTable::PoseTable() {}
+
+void PoseTable::Clear()
+{
+  image_ids_.clear();
+  rotations_.clear();
+  translations_.clear();
+  centers_.clear();
+}
+
+uint32_t PoseTable::AddPose(const Image& image)
+{
+  image_ids_.push_back(image.ImageId());
+  rotations_.push_back(image.RotationMatrix());
+  translations_.push_back(image.Translation());
+  centers_.push_back(image.ProjectionCenter());
+  return image_ids_.size() - 1;
+}
+
+void PoseTable::SetPose(const uint32_t idx, const Image& image)
+{
+  image_ids_[idx] = image.ImageId();
+  rotations_[idx] = image.RotationMatrix();
+  translations_[idx] = image.Translation();
+  centers_[idx] = image.ProjectionCenter();
+}
+
+size_t PoseTable::Size() const { return image_ids_.size(); }
+
+uint32_t PoseTable::ImageId(const uint32_t idx) const
+{
+  return image_ids_[idx];
+}
+
+const Eigen::Matrix3d& PoseTable::RotationMatrix(const uint32_t idx) const
+{
+  return rotations_[idx];
+}
+
+const Eigen::Vector3d& PoseTable::Translation(const uint32_t idx) const
+{
+  return translations_[idx];
+}
+
+size_t PoseTable::MemoryUsage() const
+{
+  return VectorBytes(image_ids_) + VectorBytes(rotations_)
+    + VectorBytes(translations_) + VectorBytes(centers_);
+}
+
+const Eigen::Vector3d& PoseTable::ProjectionCenter(const uint32_t idx) const
+{
+  return centers_[idx];
+}
+
+Eigen::Vector3d PoseTable::Transform(const uint32_t idx,
+                                     const Eigen::Vector3d& point3d) const
+{
+  return rotations_[idx] * point3d + translations_[idx];
+}
+
+void PoseTable::Transform(const uint32_t idx,
+                          const Eigen::Matrix3Xd& points3d,
+                          Eigen::Matrix3Xd* points3d_local) const
+{
+  points3d_local->noalias() = rotations_[idx] * points3d;
+  points3d_local->colwise() += translations_[idx];
+}
+
+} // namespace mercator
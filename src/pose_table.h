@@ -0,0 +1,80 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_POSE_TABLE_H_
+#define MERCATOR_POSE_TABLE_H_
+
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "image.h"
+
+namespace mercator {
+
+// Contiguous table of image poses. Each entry holds the rotation matrix and
+// translation from the world frame to the image frame and the projection
+// center of the image in the world frame. The table is read-only once built
+// and can be shared between threads.
+class PoseTable {
+ public:
+  PoseTable();
+
+  void Clear();
+
+  // Append the pose of an image and return its index
+  uint32_t AddPose(const Image& image);
+
+  // Replace the pose at an index with the pose of an image
+  void SetPose(const uint32_t idx, const Image& image);
+
+  size_t Size() const;
+
+  // Estimated heap bytes of the table
+  size_t MemoryUsage() const;
+
+  uint32_t ImageId(const uint32_t idx) const;
+
+  const Eigen::Matrix3d& RotationMatrix(const uint32_t idx) const;
+  const Eigen::Vector3d& Translation(const uint32_t idx) const;
+  const Eigen::Vector3d& ProjectionCenter(const uint32_t idx) const;
+
+  // Transform a 3D world point into the reference frame of an image
+  Eigen::Vector3d Transform(const uint32_t idx,
+                            const Eigen::Vector3d& point3d) const;
+
+  // Transform a batch of 3D world points, stored as the columns of a matrix,
+  // into the reference frame of an image
+  void Transform(const uint32_t idx,
+                 const Eigen::Matrix3Xd& points3d,
+                 Eigen::Matrix3Xd* points3d_local) const;
+
+ private:
+  std::vector<uint32_t> image_ids_;
+  std::vector<Eigen::Matrix3d> rotations_;
+  std::vector<Eigen::Vector3d> translations_;
+  std::vector<Eigen::Vector3d> centers_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_POSE_TABLE_H_
@@ -0,0 +1,421 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <iostream>
+#include <unordered_map>
+
+#include "problem_corpus.h"
+
+namespace mercator {
+
+namespace {
+
+// Identifies corpus files and the version of their layout
+const char kCorpusMagic[8] = { 'M', 'E', 'R', 'C', 'B', 'A', 'C', '1' };
+
+// Size of each record in a corpus, without the parameters of a camera
+const size_t kCameraSize = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+const size_t kImageSize = 2 * sizeof(uint32_t) + 7 * sizeof(double);
+const size_t kPointSize =
+  sizeof(uint64_t) + (3 + kPackedCovarianceSize) * sizeof(double);
+const size_t kObservationSize = 2 * sizeof(uint32_t) + 2 * sizeof(double);
+
+// Little endian, like the COLMAP files
+template<typename T>
+void WriteBinary(std::ostream* stream, const T& data)
+{
+  stream->write(reinterpret_cast<const char*>(&data), sizeof(T));
+}
+
+template<typename T>
+T ReadBinary(std::istream* stream)
+{
+  T data;
+  stream->read(reinterpret_cast<char*>(&data), sizeof(T));
+  return data;
+}
+
+} // namespace
+
+CapturedProblem CapturedProblem::FromBundleAdjustment(
+    const BundleAdjustment& ba,
+    const PointRegion& region,
+    const Image& virtual_image)
+{
+  CapturedProblem problem;
+
+  for (const auto& camera : ba.Cameras())
+  {
+    problem.cameras.push_back(camera.second);
+  }
+
+  std::unordered_map<uint32_t, uint32_t> image_idxs;
+  for (const auto& image : ba.Images())
+  {
+    image_idxs.emplace(image.first, problem.images.size());
+
+    Image pose;
+    pose.SetImageId(image.second.ImageId());
+    pose.SetCameraId(image.second.CameraId());
+    pose.SetRotation(image.second.Rotation());
+    pose.SetTranslation(image.second.Translation());
+    problem.images.push_back(pose);
+  }
+  problem.virtual_image_idx = image_idxs.at(virtual_image.ImageId());
+
+  std::unordered_map<uint64_t, uint32_t> point_idxs;
+  for (const auto& point3d : ba.Points())
+  {
+    point_idxs.emplace(point3d.first, problem.points.size());
+
+    Point3d point;
+    point.SetPoint3dId(point3d.second.Point3dId());
+    point.SetCoords(point3d.second.Coords());
+    point.SetCovariance(point3d.second.Covariance());
+    problem.points.push_back(point);
+  }
+
+  for (const auto point3d_id : region.point3d_ids)
+  {
+    problem.region_point_idxs.push_back(point_idxs.at(point3d_id));
+  }
+
+  ba.VisitObservations([&](const Image& image,
+                           const Eigen::Vector2d& xy,
+                           const uint64_t point3d_id)
+      {
+        problem.observations.push_back({ image_idxs.at(image.ImageId()),
+                                         point_idxs.at(point3d_id),
+                                         xy });
+      });
+
+  return problem;
+}
+
+void CapturedProblem::ToBundleAdjustment(BundleAdjustment* ba) const
+{
+  for (const auto& camera : cameras)
+  {
+    ba->AddCamera(camera);
+  }
+
+  std::vector<Image> images_with_points = images;
+  for (const auto& observation : observations)
+  {
+    Point2d point2d(observation.xy(0), observation.xy(1));
+    point2d.SetPoint3dId(points[observation.point_idx].Point3dId());
+    images_with_points[observation.image_idx].Points2d().push_back(point2d);
+  }
+
+  for (const auto& image : images_with_points)
+  {
+    ba->AddImage(image);
+  }
+
+  for (const auto& point : points)
+  {
+    ba->AddPoint(point);
+  }
+}
+
+std::vector<uint64_t> CapturedProblem::RegionPoint3dIds() const
+{
+  std::vector<uint64_t> point3d_ids;
+  point3d_ids.reserve(region_point_idxs.size());
+  for (const auto idx : region_point_idxs)
+  {
+    point3d_ids.push_back(points[idx].Point3dId());
+  }
+  return point3d_ids;
+}
+
+bool ProblemCorpusWriter::Open(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  file_.open(path, std::ios::binary | std::ios::trunc);
+  if (!file_.is_open())
+  {
+    std::cerr << "Could not open file " << path << std::endl;
+    return false;
+  }
+
+  file_.write(kCorpusMagic, sizeof(kCorpusMagic));
+  num_problems_ = 0;
+  return file_.good();
+}
+
+bool ProblemCorpusWriter::Write(const CapturedProblem& problem)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  WriteBinary<uint32_t>(&file_, problem.cameras.size());
+  for (const auto& camera : problem.cameras)
+  {
+    const std::vector<double> params = camera.Params();
+    WriteBinary<uint32_t>(&file_, camera.CameraId());
+    WriteBinary<uint64_t>(&file_, camera.Width());
+    WriteBinary<uint64_t>(&file_, camera.Height());
+    WriteBinary<uint32_t>(&file_, params.size());
+    for (const auto param : params)
+    {
+      WriteBinary<double>(&file_, param);
+    }
+  }
+
+  WriteBinary<uint32_t>(&file_, problem.images.size());
+  for (const auto& image : problem.images)
+  {
+    WriteBinary<uint32_t>(&file_, image.ImageId());
+    WriteBinary<uint32_t>(&file_, image.CameraId());
+    WriteBinary<double>(&file_, image.Rotation().w());
+    WriteBinary<double>(&file_, image.Rotation().x());
+    WriteBinary<double>(&file_, image.Rotation().y());
+    WriteBinary<double>(&file_, image.Rotation().z());
+    for (int i = 0; i < 3; ++i)
+    {
+      WriteBinary<double>(&file_, image.Translation()(i));
+    }
+  }
+
+  WriteBinary<uint32_t>(&file_, problem.points.size());
+  for (const auto& point : problem.points)
+  {
+    WriteBinary<uint64_t>(&file_, point.Point3dId());
+    for (int i = 0; i < 3; ++i)
+    {
+      WriteBinary<double>(&file_, point.Coords()(i));
+    }
+    file_.write(reinterpret_cast<const char*>(point.PackedCovariance()),
+                kPackedCovarianceSize * sizeof(double));
+  }
+
+  WriteBinary<uint64_t>(&file_, problem.observations.size());
+  for (const auto& observation : problem.observations)
+  {
+    WriteBinary<uint32_t>(&file_, observation.image_idx);
+    WriteBinary<uint32_t>(&file_, observation.point_idx);
+    WriteBinary<double>(&file_, observation.xy(0));
+    WriteBinary<double>(&file_, observation.xy(1));
+  }
+
+  WriteBinary<uint32_t>(&file_, problem.virtual_image_idx);
+  WriteBinary<uint32_t>(&file_, problem.region_point_idxs.size());
+  for (const auto idx : problem.region_point_idxs)
+  {
+    WriteBinary<uint32_t>(&file_, idx);
+  }
+
+  // Keep the corpus readable if the run is interrupted
+  file_.flush();
+  ++num_problems_;
+  return file_.good();
+}
+
+size_t ProblemCorpusWriter::NumProblems() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  return num_problems_;
+}
+
+bool ProblemCorpusReader::Open(const std::string& path)
+{
+  file_.open(path, std::ios::binary);
+  if (!file_.is_open())
+  {
+    std::cerr << "Could not open file " << path << std::endl;
+    return false;
+  }
+
+  file_.seekg(0, std::ios::end);
+  file_size_ = file_.tellg();
+  file_.seekg(0, std::ios::beg);
+
+  char magic[sizeof(kCorpusMagic)];
+  file_.read(magic, sizeof(magic));
+  if (!file_ || !std::equal(magic, magic + sizeof(magic), kCorpusMagic))
+  {
+    std::cerr << path << " is not a bundle adjustment corpus" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool ProblemCorpusReader::Read(CapturedProblem* problem)
+{
+  *problem = CapturedProblem();
+
+  const auto num_cameras = ReadBinary<uint32_t>(&file_);
+  if (file_.eof())
+  {
+    return false;
+  }
+  if (!CheckCount(num_cameras, kCameraSize))
+  {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < num_cameras && file_; ++i)
+  {
+    Camera camera;
+    camera.SetCameraId(ReadBinary<uint32_t>(&file_));
+    camera.SetWidth(ReadBinary<uint64_t>(&file_));
+    camera.SetHeight(ReadBinary<uint64_t>(&file_));
+    const auto num_params = ReadBinary<uint32_t>(&file_);
+    if (!CheckCount(num_params, sizeof(double)))
+    {
+      return false;
+    }
+    std::vector<double> params(num_params);
+    for (auto& param : params)
+    {
+      param = ReadBinary<double>(&file_);
+    }
+    camera.SetParams(params);
+    problem->cameras.push_back(camera);
+  }
+
+  const auto num_images = ReadBinary<uint32_t>(&file_);
+  if (!CheckCount(num_images, kImageSize))
+  {
+    return false;
+  }
+  problem->images.reserve(num_images);
+  for (uint32_t i = 0; i < num_images && file_; ++i)
+  {
+    Image image;
+    image.SetImageId(ReadBinary<uint32_t>(&file_));
+    image.SetCameraId(ReadBinary<uint32_t>(&file_));
+    Eigen::Quaterniond rotation;
+    rotation.w() = ReadBinary<double>(&file_);
+    rotation.x() = ReadBinary<double>(&file_);
+    rotation.y() = ReadBinary<double>(&file_);
+    rotation.z() = ReadBinary<double>(&file_);
+    Eigen::Vector3d translation;
+    for (int j = 0; j < 3; ++j)
+    {
+      translation(j) = ReadBinary<double>(&file_);
+    }
+    image.SetRotation(rotation);
+    image.SetTranslation(translation);
+    problem->images.push_back(image);
+  }
+
+  const auto num_points = ReadBinary<uint32_t>(&file_);
+  if (!CheckCount(num_points, kPointSize))
+  {
+    return false;
+  }
+  problem->points.reserve(num_points);
+  for (uint32_t i = 0; i < num_points && file_; ++i)
+  {
+    Point3d point;
+    point.SetPoint3dId(ReadBinary<uint64_t>(&file_));
+    Eigen::Vector3d coords;
+    for (int j = 0; j < 3; ++j)
+    {
+      coords(j) = ReadBinary<double>(&file_);
+    }
+    point.SetCoords(coords);
+
+    double covariance[kPackedCovarianceSize];
+    file_.read(reinterpret_cast<char*>(covariance), sizeof(covariance));
+    point.SetCovariance(UnpackCovariance(covariance));
+    problem->points.push_back(point);
+  }
+
+  const auto num_observations = ReadBinary<uint64_t>(&file_);
+  if (!CheckCount(num_observations, kObservationSize))
+  {
+    return false;
+  }
+  problem->observations.reserve(num_observations);
+  for (uint64_t i = 0; i < num_observations && file_; ++i)
+  {
+    CapturedProblem::Observation observation;
+    observation.image_idx = ReadBinary<uint32_t>(&file_);
+    observation.point_idx = ReadBinary<uint32_t>(&file_);
+    observation.xy(0) = ReadBinary<double>(&file_);
+    observation.xy(1) = ReadBinary<double>(&file_);
+    problem->observations.push_back(observation);
+  }
+
+  problem->virtual_image_idx = ReadBinary<uint32_t>(&file_);
+  const auto num_region_points = ReadBinary<uint32_t>(&file_);
+  if (!CheckCount(num_region_points, sizeof(uint32_t)))
+  {
+    return false;
+  }
+  problem->region_point_idxs.reserve(num_region_points);
+  for (uint32_t i = 0; i < num_region_points && file_; ++i)
+  {
+    problem->region_point_idxs.push_back(ReadBinary<uint32_t>(&file_));
+  }
+
+  if (!file_)
+  {
+    std::cerr << "Bundle adjustment corpus is truncated" << std::endl;
+    return false;
+  }
+
+  // Indices are checked once here so that replaying needs no checks
+  const bool indices_valid =
+    problem->virtual_image_idx < problem->images.size() &&
+    std::all_of(problem->observations.begin(), problem->observations.end(),
+        [problem](const CapturedProblem::Observation& observation)
+        {
+          return observation.image_idx < problem->images.size() &&
+            observation.point_idx < problem->points.size();
+        }) &&
+    std::all_of(problem->region_point_idxs.begin(),
+                problem->region_point_idxs.end(),
+                [problem](const uint32_t idx)
+                {
+                  return idx < problem->points.size();
+                });
+  if (!indices_valid)
+  {
+    std::cerr << "Bundle adjustment corpus is corrupt" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool ProblemCorpusReader::CheckCount(const uint64_t count,
+                                     const size_t record_size)
+{
+  // The position is -1 once a read failed
+  const std::streamoff position = file_.tellg();
+  if (position < 0 || static_cast<uint64_t>(position) > file_size_ ||
+      count > (file_size_ - position) / record_size)
+  {
+    std::cerr << "Bundle adjustment corpus is truncated" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace mercator
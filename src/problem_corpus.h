@@ -0,0 +1,121 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_PROBLEM_CORPUS_H_
+#define MERCATOR_PROBLEM_CORPUS_H_
+
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "bundle_adjustment.h"
+#include "camera.h"
+#include "clustering.h"
+#include "image.h"
+#include "point3d.h"
+
+namespace mercator {
+
+// Self-contained inputs of one bundle adjustment built by the planner: the
+// region being planned for, its neighbourhood, the images that see them, the
+// virtual image and every observation that becomes a residual. Images and
+// points only keep what the adjustment uses, so a problem of a large
+// reconstruction can be replayed without the reconstruction.
+struct CapturedProblem {
+  struct Observation {
+    // Indices into images and points
+    uint32_t image_idx;
+    uint32_t point_idx;
+    Eigen::Vector2d xy;
+  };
+
+  std::vector<Camera> cameras;
+
+  // Poses of the images, without their 2D points
+  std::vector<Image> images;
+
+  // Coordinates and covariances of the points, without their tracks
+  std::vector<Point3d> points;
+
+  std::vector<Observation> observations;
+
+  uint32_t virtual_image_idx = 0;
+
+  // Indices of the points of the region
+  std::vector<uint32_t> region_point_idxs;
+
+  // Capture a bundle adjustment after BuildProblem() and before it is run
+  static CapturedProblem FromBundleAdjustment(const BundleAdjustment& ba,
+                                              const PointRegion& region,
+                                              const Image& virtual_image);
+
+  // Add the cameras, images and points to a new bundle adjustment, with the
+  // observations as the 2D points of the images
+  void ToBundleAdjustment(BundleAdjustment* ba) const;
+
+  std::vector<uint64_t> RegionPoint3dIds() const;
+};
+
+// Appends captured problems to a corpus file. Safe to use from several
+// threads.
+class ProblemCorpusWriter {
+ public:
+  // Create the file and write its header. Returns false if the file could
+  // not be created.
+  bool Open(const std::string& path);
+
+  bool Write(const CapturedProblem& problem);
+
+  size_t NumProblems() const;
+
+ private:
+  mutable std::mutex mutex_;
+  std::ofstream file_;
+  size_t num_problems_ = 0;
+};
+
+// Reads the problems of a corpus file in the order they were captured
+class ProblemCorpusReader {
+ public:
+  // Open a corpus and check its header
+  bool Open(const std::string& path);
+
+  // Read the next problem. Returns false at the end of the corpus or if it
+  // is truncated or corrupt.
+  bool Read(CapturedProblem* problem);
+
+ private:
+  // Whether count records of at least record_size bytes each fit into the
+  // rest of the file, so that a corrupt count is rejected before anything is
+  // allocated for it. Prints an error if they do not.
+  bool CheckCount(const uint64_t count, const size_t record_size);
+
+  std::ifstream file_;
+  uint64_t file_size_ = 0;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_PROBLEM_CORPUS_H_
@@ -0,0 +1,349 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+#include <Eigen/Core>
+#include <Eigen/LU>
+
+#include "redundancy_analysis.h"
+#include "util/thread_pool.h"
+
+namespace mercator {
+
+namespace {
+
+// Images analyzed by one task of the thread pool
+const size_t kImagesPerTask = 16;
+
+// Remove the information of one observation from a covariance. Returns false
+// if the observation holds more information than the covariance.
+bool Downdate(const Eigen::Matrix<double, 2, 3>& jacobian,
+              Eigen::Matrix3d* covariance)
+{
+  const Eigen::Matrix<double, 3, 2> cj =
+    *covariance * jacobian.transpose();
+  const Eigen::Matrix2d s = Eigen::Matrix2d::Identity() - jacobian * cj;
+
+  // A 2x2 symmetric matrix is positive definite if its determinant and
+  // trace are positive
+  const double det = s.determinant();
+  if (!(det > 0 && s.trace() > 0))
+  {
+    return false;
+  }
+
+  *covariance += cj * s.inverse() * cj.transpose();
+  return true;
+}
+
+// Quote a CSV field, doubling the quotes inside it
+std::string QuoteCsv(const std::string& field)
+{
+  std::string quoted = "\"";
+  for (const char c : field)
+  {
+    if (c == '"')
+    {
+      quoted += '"';
+    }
+    quoted += c;
+  }
+  quoted += '"';
+  return quoted;
+}
+
+} // namespace
+
+RedundancyAnalysis::RedundancyAnalysis(const Options& options,
+                                       const ColmapReader& reader)
+  : options_(options), reader_(reader) {}
+
+void RedundancyAnalysis::Run()
+{
+  std::vector<const Image*> images;
+  images.reserve(reader_.Images().size());
+  for (const auto& image : reader_.Images())
+  {
+    images.push_back(&image.second);
+  }
+
+  results_.assign(images.size(), ImageResult());
+
+  {
+    ThreadPool pool(std::max(options_.num_threads, 0));
+    for (size_t begin = 0; begin < images.size(); begin += kImagesPerTask)
+    {
+      const size_t end = std::min(begin + kImagesPerTask, images.size());
+      pool.Submit([this, &images, begin, end]
+          {
+            for (size_t i = begin; i < end; ++i)
+            {
+              AnalyzeImage(*images[i], &results_[i]);
+            }
+          });
+    }
+    pool.Wait();
+  }
+
+  std::stable_sort(results_.begin(), results_.end(),
+                   [](const ImageResult& a, const ImageResult& b)
+                   {
+                     if (a.num_lost != b.num_lost)
+                     {
+                       return a.num_lost < b.num_lost;
+                     }
+                     if (a.num_unconstrained != b.num_unconstrained)
+                     {
+                       return a.num_unconstrained < b.num_unconstrained;
+                     }
+                     return a.mean_increase < b.mean_increase;
+                   });
+}
+
+const std::vector<RedundancyAnalysis::ImageResult>&
+RedundancyAnalysis::Results() const
+{
+  return results_;
+}
+
+const std::string RedundancyAnalysis::Summary(const size_t max_images) const
+{
+  std::ostringstream ss;
+  ss << "Image redundancy, most redundant first:\n"
+     << std::setw(10) << "image_id" << std::setw(10) << "points"
+     << std::setw(8) << "lost" << std::setw(15) << "unconstrained"
+     << std::setw(14) << "inconsistent" << std::setw(14) << "max_increase"
+     << std::setw(15) << "mean_increase" << "  name";
+
+  for (size_t i = 0; i < std::min(max_images, results_.size()); ++i)
+  {
+    const ImageResult& result = results_[i];
+    ss << "\n" << std::setw(10) << result.image_id
+       << std::setw(10) << result.changes.size()
+       << std::setw(8) << result.num_lost
+       << std::setw(15) << result.num_unconstrained
+       << std::setw(14) << result.num_inconsistent
+       << std::setw(14) << result.max_increase
+       << std::setw(15) << result.mean_increase
+       << "  " << result.name;
+  }
+
+  if (results_.size() > max_images)
+  {
+    ss << "\n(" << results_.size() - max_images << " more images)";
+  }
+
+  return ss.str();
+}
+
+size_t RedundancyAnalysis::NumInconsistent() const
+{
+  size_t num_inconsistent = 0;
+  for (const auto& result : results_)
+  {
+    num_inconsistent += result.num_inconsistent;
+  }
+  return num_inconsistent;
+}
+
+bool RedundancyAnalysis::Write(const std::string& path) const
+{
+  std::ofstream file(path, std::ios::trunc);
+  if (!file.is_open())
+  {
+    return false;
+  }
+
+  file << "rank,image_id,name,points,lost,unconstrained,inconsistent,"
+          "max_increase,mean_increase\n";
+  file << std::setprecision(17);
+  for (size_t i = 0; i < results_.size(); ++i)
+  {
+    const ImageResult& result = results_[i];
+    file << i + 1 << "," << result.image_id << "," << QuoteCsv(result.name)
+         << "," << result.changes.size() << "," << result.num_lost << ","
+         << result.num_unconstrained << "," << result.num_inconsistent << ","
+         << result.max_increase << "," << result.mean_increase << "\n";
+  }
+
+  return file.good();
+}
+
+void RedundancyAnalysis::AnalyzeImage(const Image& image,
+                                      ImageResult* result) const
+{
+  result->image_id = image.ImageId();
+  result->name = image.Name();
+
+  const double focal_length =
+    reader_.Cameras().at(image.CameraId()).Params()[0];
+  const PoseTable& poses = reader_.Poses();
+  const uint32_t image_idx = reader_.Observations().ImageIdx(image.ImageId());
+  const Eigen::Matrix3d& rotation = poses.RotationMatrix(image_idx);
+
+  // Covariance of every observed point without the image, until a downdate
+  // turns out to be inconsistent
+  struct Downdated {
+    Eigen::Matrix3d covariance;
+    bool consistent;
+  };
+  std::unordered_map<uint64_t, Downdated> downdated;
+  std::vector<uint64_t> point3d_ids;
+
+  // Observed points with a covariance, in the order of the 2D points
+  std::vector<Downdated*> observed;
+  std::vector<const Point3d*> observed_points;
+  for (const auto& point2d : image.Points2d())
+  {
+    if (!point2d.HasPoint3d())
+    {
+      continue;
+    }
+
+    const auto point = reader_.Points().find(point2d.Point3dId());
+    if (point == reader_.Points().end() ||
+        !point->second.HasCovariance())
+    {
+      continue;
+    }
+
+    auto entry = downdated.find(point->first);
+    if (entry == downdated.end())
+    {
+      entry = downdated.emplace(
+          point->first, Downdated{ point->second.Covariance(), true }).first;
+      point3d_ids.push_back(point->first);
+    }
+    observed.push_back(&entry->second);
+    observed_points.push_back(&point->second);
+  }
+
+  // Transform the observed points into the image frame in one product
+  Eigen::Matrix3Xd coords(3, observed_points.size());
+  for (size_t i = 0; i < observed_points.size(); ++i)
+  {
+    coords.col(i) = observed_points[i]->Coords();
+  }
+  Eigen::Matrix3Xd local_coords;
+  poses.Transform(image_idx, coords, &local_coords);
+
+  for (size_t i = 0; i < observed.size(); ++i)
+  {
+    Downdated* entry = observed[i];
+    if (!entry->consistent)
+    {
+      continue;
+    }
+
+    // Jacobian of the pinhole projection with respect to the point
+    const Eigen::Vector3d local = local_coords.col(i);
+    if (local(2) <= 0)
+    {
+      continue;
+    }
+    Eigen::Matrix<double, 2, 3> projection;
+    projection << 1, 0, -local(0) / local(2),
+                  0, 1, -local(1) / local(2);
+    const Eigen::Matrix<double, 2, 3> jacobian =
+      (focal_length / (options_.pixel_sigma * local(2))) * projection *
+      rotation;
+
+    entry->consistent = Downdate(jacobian, &entry->covariance);
+  }
+
+  double total_increase = 0.0;
+  size_t num_constrained = 0;
+  result->changes.reserve(point3d_ids.size());
+  for (const uint64_t point3d_id : point3d_ids)
+  {
+    const Point3d& point3d = reader_.Points().at(point3d_id);
+    const size_t num_images = point3d.ImageIds().size();
+    const Downdated& entry = downdated.at(point3d_id);
+
+    // One image alone does not constrain a point
+    PointChange change;
+    change.point3d_id = point3d_id;
+    change.uncertainty = point3d.Uncertainty();
+    change.covered = IsCovered(change.uncertainty, num_images);
+    change.inconsistent = num_images > 2 && !entry.consistent;
+    if (num_images <= 2)
+    {
+      change.new_uncertainty = std::numeric_limits<double>::infinity();
+    }
+    else if (change.inconsistent)
+    {
+      change.new_uncertainty = std::numeric_limits<double>::quiet_NaN();
+    }
+    else
+    {
+      change.new_uncertainty = MaxEigenvalue(entry.covariance);
+    }
+    change.new_covered = change.inconsistent
+      ? change.covered : IsCovered(change.new_uncertainty, num_images - 1);
+    result->changes.push_back(change);
+
+    if (change.inconsistent)
+    {
+      ++result->num_inconsistent;
+      continue;
+    }
+
+    if (change.covered && !change.new_covered)
+    {
+      ++result->num_lost;
+    }
+
+    if (std::isinf(change.new_uncertainty))
+    {
+      ++result->num_unconstrained;
+    }
+    else if (change.uncertainty > 0)
+    {
+      const double increase =
+        (change.new_uncertainty - change.uncertainty) / change.uncertainty;
+      result->max_increase = std::max(result->max_increase, increase);
+      total_increase += increase;
+      ++num_constrained;
+    }
+  }
+
+  if (num_constrained > 0)
+  {
+    result->mean_increase = total_increase / num_constrained;
+  }
+}
+
+bool RedundancyAnalysis::IsCovered(const double uncertainty,
+                                   const size_t num_images) const
+{
+  return uncertainty < options_.uncertainty_threshold &&
+    num_images >= options_.min_cameras;
+}
+
+} // namespace mercator
@@ -0,0 +1,134 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_REDUNDANCY_ANALYSIS_H_
+#define MERCATOR_REDUNDANCY_ANALYSIS_H_
+
+#include <string>
+#include <vector>
+
+#include "util/colmap.h"
+
+namespace mercator {
+
+// Estimates, for every image of a reconstruction, what the points it observes
+// would lose if the image was removed, without solving a bundle adjustment
+// again.
+//
+// Each observation contributes J^T J to the 3x3 information matrix of its
+// point, where J is the 2x3 Jacobian of the pinhole projection divided by the
+// pixel noise. Removing the image is a rank-2 downdate per observation,
+// applied to the covariance with the Woodbury identity:
+//
+//   C' = C + C J^T (I - J C J^T)^-1 J C
+//
+// A point left with fewer than two images is unconstrained. If I - J C J^T
+// is not positive definite for a point still seen by two images, the
+// observation holds more information than the covariance of the point, i.e.
+// the covariance was not estimated with the given pixel noise. Such points
+// are flagged as inconsistent and left out of the other counts. Images are
+// analyzed in parallel.
+class RedundancyAnalysis {
+ public:
+  struct Options {
+    // Coverage criteria, as in Planner::Options
+    double uncertainty_threshold = 0.01;
+    uint64_t min_cameras = 3;
+
+    // Standard deviation of the image observations, in pixels
+    double pixel_sigma = 1.0;
+
+    // Threads analyzing images. If not positive, one per hardware thread.
+    int num_threads = 0;
+  };
+
+  // Effect of removing an image on one point it observes
+  struct PointChange {
+    uint64_t point3d_id;
+
+    double uncertainty;
+
+    // Infinity if the point is unconstrained without the image and NaN if
+    // the downdate is inconsistent
+    double new_uncertainty;
+
+    bool covered;
+    bool new_covered;
+
+    // The observation holds more information than the covariance
+    bool inconsistent;
+  };
+
+  struct ImageResult {
+    uint32_t image_id = 0;
+    std::string name;
+
+    // Points observed by the image that have a covariance
+    std::vector<PointChange> changes;
+
+    // Points that are covered with the image and are not without it
+    size_t num_lost = 0;
+
+    size_t num_unconstrained = 0;
+
+    size_t num_inconsistent = 0;
+
+    // Largest and mean increase of the uncertainty of the constrained points,
+    // relative to their uncertainty with the image
+    double max_increase = 0.0;
+    double mean_increase = 0.0;
+  };
+
+  RedundancyAnalysis(const Options& options, const ColmapReader& reader);
+
+  void Run();
+
+  // Results from the most to the least redundant image: by the number of
+  // points that lose coverage, then of points left unconstrained, then by
+  // the mean increase of the uncertainty
+  const std::vector<ImageResult>& Results() const;
+
+  // The first max_images images of the ranking
+  const std::string Summary(const size_t max_images) const;
+
+  // Points of all images whose downdate was inconsistent
+  size_t NumInconsistent() const;
+
+  // Write the ranking as CSV, one image per line. Returns false if the file
+  // could not be written.
+  bool Write(const std::string& path) const;
+
+ private:
+  void AnalyzeImage(const Image& image, ImageResult* result) const;
+
+  bool IsCovered(const double uncertainty, const size_t num_images) const;
+
+  const Options options_;
+
+  const ColmapReader& reader_;
+
+  std::vector<ImageResult> results_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_REDUNDANCY_ANALYSIS_H_
@@ -0,0 +1,324 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include "result_cache.h"
+#include "util/hash.h"
+
+namespace mercator {
+
+namespace {
+
+// Identifies cache files and the version of their layout
+const char kCacheMagic[8] = { 'M', 'E', 'R', 'C', 'A', 'C', 'H', '2' };
+
+} // namespace
+
+ResultCache::ResultCache()
+  : config_hash_(0),
+    model_hash_(0),
+    data_(nullptr),
+    size_(0),
+    header_(nullptr),
+    points_(nullptr),
+    regions_(nullptr) {}
+
+ResultCache::~ResultCache() { Close(); }
+
+bool ResultCache::Open(const std::string& path, const uint64_t config_hash)
+{
+  Close();
+  path_ = path;
+  config_hash_ = config_hash;
+  new_points_.clear();
+  new_regions_.clear();
+
+  const int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0)
+  {
+    return errno == ENOENT;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  if (static_cast<size_t>(info.st_size) < sizeof(Header))
+  {
+    std::cerr << "Ignoring invalid result cache " << path << std::endl;
+    close(fd);
+    return true;
+  }
+
+  size_ = info.st_size;
+  data_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data_ == MAP_FAILED)
+  {
+    data_ = nullptr;
+    size_ = 0;
+    return false;
+  }
+
+  const Header* header = static_cast<const Header*>(data_);
+  const size_t expected_size = sizeof(Header)
+    + header->num_points * sizeof(PointResult)
+    + header->num_regions * sizeof(RegionResult);
+  if (std::memcmp(header->magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header->config_hash != config_hash || size_ != expected_size)
+  {
+    std::cerr << "Ignoring invalid result cache " << path << std::endl;
+    Close();
+    return true;
+  }
+
+  header_ = header;
+  points_ = reinterpret_cast<const PointResult*>(header_ + 1);
+  regions_ = reinterpret_cast<const RegionResult*>(
+      points_ + header_->num_points);
+  return true;
+}
+
+void ResultCache::SetModelHash(const uint64_t model_hash)
+{
+  model_hash_ = model_hash;
+}
+
+bool ResultCache::ModelUnchanged() const
+{
+  return header_ != nullptr && header_->model_hash == model_hash_;
+}
+
+size_t ResultCache::NumCachedPoints() const
+{
+  return header_ != nullptr ? header_->num_points : 0;
+}
+
+size_t ResultCache::NumCachedRegions() const
+{
+  return header_ != nullptr ? header_->num_regions : 0;
+}
+
+const ResultCache::PointResult* ResultCache::FindPoint(
+    const uint64_t point3d_id) const
+{
+  const PointResult* end = points_ + NumCachedPoints();
+  const PointResult* it = std::lower_bound(points_, end, point3d_id,
+      [](const PointResult& result, const uint64_t id)
+      {
+        return result.point3d_id < id;
+      });
+  return (it != end && it->point3d_id == point3d_id) ? it : nullptr;
+}
+
+const ResultCache::RegionResult* ResultCache::FindRegion(
+    const uint64_t hash) const
+{
+  const RegionResult* end = regions_ + NumCachedRegions();
+  const RegionResult* it = std::lower_bound(regions_, end, hash,
+      [](const RegionResult& result, const uint64_t h)
+      {
+        return result.hash < h;
+      });
+  return (it != end && it->hash == hash) ? it : nullptr;
+}
+
+void ResultCache::AddPoint(const PointResult& result)
+{
+  new_points_.push_back(result);
+}
+
+void ResultCache::AddRegion(const RegionResult& result)
+{
+  new_regions_.push_back(result);
+}
+
+uint64_t ResultCache::PointHash(const uint64_t point3d_id) const
+{
+  const auto it = std::lower_bound(new_points_.begin(), new_points_.end(),
+      point3d_id,
+      [](const PointResult& result, const uint64_t id)
+      {
+        return result.point3d_id < id;
+      });
+  return (it != new_points_.end() && it->point3d_id == point3d_id)
+    ? it->hash : 0;
+}
+
+uint64_t ResultCache::RegionHash(const PointRegion& region) const
+{
+  std::vector<uint64_t> point3d_ids = region.point3d_ids;
+  std::sort(point3d_ids.begin(), point3d_ids.end());
+
+  uint64_t hash = kFnvOffsetBasis;
+  for (const auto point3d_id : point3d_ids)
+  {
+    hash = HashValue(point3d_id, hash);
+    hash = HashValue(PointHash(point3d_id), hash);
+  }
+  return hash;
+}
+
+bool ResultCache::Save()
+{
+  std::sort(new_regions_.begin(), new_regions_.end(),
+      [](const RegionResult& a, const RegionResult& b)
+      {
+        return a.hash < b.hash;
+      });
+
+  Header header;
+  std::memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+  header.config_hash = config_hash_;
+  header.model_hash = model_hash_;
+  header.num_points = new_points_.size();
+  header.num_regions = new_regions_.size();
+
+  // Written next to the file and renamed, so that a run reading the old file
+  // never sees a partial one
+  const std::string tmp_path = path_ + ".tmp";
+  {
+    std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open())
+    {
+      std::cerr << "Could not open file " << tmp_path << std::endl;
+      return false;
+    }
+
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(new_points_.data()),
+               new_points_.size() * sizeof(PointResult));
+    file.write(reinterpret_cast<const char*>(new_regions_.data()),
+               new_regions_.size() * sizeof(RegionResult));
+    if (!file.good())
+    {
+      std::cerr << "Could not write file " << tmp_path << std::endl;
+      return false;
+    }
+  }
+
+  Close();
+  return std::rename(tmp_path.c_str(), path_.c_str()) == 0;
+}
+
+uint64_t ResultCache::HashPoint(const Point3d& point3d)
+{
+  uint64_t hash = HashValue(point3d.Point3dId());
+  hash = HashBytes(point3d.Coords().data(), 3 * sizeof(double), hash);
+  const Eigen::Matrix3d covariance = point3d.Covariance();
+  hash = HashBytes(covariance.data(), 9 * sizeof(double), hash);
+  return HashBytes(point3d.ImageIds().data(),
+                   point3d.ImageIds().size() * sizeof(uint32_t), hash);
+}
+
+uint64_t ResultCache::HashImage(const Image& image,
+                                const Camera& camera,
+                                uint64_t hash)
+{
+  hash = HashValue(image.ImageId(), hash);
+  hash = HashBytes(image.Rotation().coeffs().data(), 4 * sizeof(double), hash);
+  hash = HashBytes(image.Translation().data(), 3 * sizeof(double), hash);
+  for (const auto& point2d : image.Points2d())
+  {
+    hash = HashBytes(point2d.Coords().data(), 2 * sizeof(double), hash);
+    hash = HashValue(point2d.Point3dId(), hash);
+  }
+  return HashCamera(camera, hash);
+}
+
+uint64_t ResultCache::HashCamera(const Camera& camera, uint64_t hash)
+{
+  hash = HashValue(camera.CameraId(), hash);
+  hash = HashValue(camera.Width(), hash);
+  hash = HashValue(camera.Height(), hash);
+  const std::vector<double> params = camera.Params();
+  return HashBytes(params.data(), params.size() * sizeof(double), hash);
+}
+
+ResultCache::RegionResult ResultCache::MakeRegionResult(
+    const uint64_t hash,
+    const double uncertainty,
+    const Image* virtual_image)
+{
+  RegionResult result;
+  std::memset(&result, 0, sizeof(result));
+  result.hash = hash;
+  result.uncertainty = uncertainty;
+
+  if (virtual_image != nullptr)
+  {
+    result.rotation[0] = virtual_image->Rotation().w();
+    result.rotation[1] = virtual_image->Rotation().x();
+    result.rotation[2] = virtual_image->Rotation().y();
+    result.rotation[3] = virtual_image->Rotation().z();
+    for (int i = 0; i < 3; ++i)
+    {
+      result.translation[i] = virtual_image->Translation()(i);
+    }
+    result.camera_id = virtual_image->CameraId();
+    result.flags = REGION_PLANNED;
+  }
+
+  return result;
+}
+
+Image ResultCache::VirtualImage(const RegionResult& result)
+{
+  Image image;
+  image.SetCameraId(result.camera_id);
+  image.SetRotation(Eigen::Quaterniond(result.rotation[0], result.rotation[1],
+                                       result.rotation[2],
+                                       result.rotation[3]));
+  image.SetTranslation(Eigen::Vector3d(result.translation[0],
+                                       result.translation[1],
+                                       result.translation[2]));
+  return image;
+}
+
+void ResultCache::Close()
+{
+  if (data_ != nullptr)
+  {
+    munmap(data_, size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  header_ = nullptr;
+  points_ = nullptr;
+  regions_ = nullptr;
+}
+
+} // namespace mercator
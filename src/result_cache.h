@@ -0,0 +1,167 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_RESULT_CACHE_H_
+#define MERCATOR_RESULT_CACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "camera.h"
+#include "clustering.h"
+#include "image.h"
+#include "point3d.h"
+#include "util/hash.h"
+
+namespace mercator {
+
+// Results of a previous run with the same configuration, and the results of
+// the current run to be saved for the next one.
+//
+// A cache file holds a header followed by two arrays of fixed size records,
+// the points sorted by ID and the regions sorted by hash, so that it is
+// mapped into memory and searched in place instead of being parsed. Points
+// are matched by ID and by a hash of their attributes, so that only the
+// points that changed since the previous run are classified again. Regions
+// are matched by a hash of everything their bundle adjustments depend on,
+// which the planner builds from the hashes of their points, of the images
+// and cameras that see them and of the neighbouring points.
+class ResultCache {
+ public:
+  enum PointFlags : uint32_t {
+    POINT_COVERED = 1
+  };
+
+  enum RegionFlags : uint32_t {
+    // A camera improving the region was found. Otherwise every candidate was
+    // tried without success.
+    REGION_PLANNED = 1
+  };
+
+  struct PointResult {
+    uint64_t point3d_id;
+    uint64_t hash;
+    double uncertainty;
+    uint32_t flags;
+    uint32_t reserved;
+  };
+
+  struct RegionResult {
+    uint64_t hash;
+
+    // Uncertainty of the region with the virtual camera
+    double uncertainty;
+
+    // Pose of the virtual camera
+    double rotation[4];
+    double translation[3];
+    uint32_t camera_id;
+
+    uint32_t flags;
+  };
+
+  ResultCache();
+  ~ResultCache();
+
+  ResultCache(const ResultCache&) = delete;
+  ResultCache& operator=(const ResultCache&) = delete;
+
+  // Map the cache file of a configuration, if there is one. A missing or
+  // invalid file leaves the cache empty. Returns false only if the file
+  // exists but cannot be read.
+  bool Open(const std::string& path, const uint64_t config_hash);
+
+  // Hash of the model of the current run, known once it has been read
+  void SetModelHash(const uint64_t model_hash);
+
+  // Whether the previous run was made on the same model files, in which
+  // case the hashes of its points are still valid
+  bool ModelUnchanged() const;
+
+  size_t NumCachedPoints() const;
+  size_t NumCachedRegions() const;
+
+  // Results of the previous run, or nullptr
+  const PointResult* FindPoint(const uint64_t point3d_id) const;
+  const RegionResult* FindRegion(const uint64_t hash) const;
+
+  // Record a result of the current run. Points must be added in order of
+  // their IDs.
+  void AddPoint(const PointResult& result);
+  void AddRegion(const RegionResult& result);
+
+  // Hash added to the current run for a point, or 0 if there is none
+  uint64_t PointHash(const uint64_t point3d_id) const;
+
+  // Hash of the points of a region, from their hashes added to the current
+  // run
+  uint64_t RegionHash(const PointRegion& region) const;
+
+  // Write the results of the current run, replacing the file that was opened
+  bool Save();
+
+  static uint64_t HashPoint(const Point3d& point3d);
+
+  // Pose and 2D points of an image and the intrinsics of its camera
+  static uint64_t HashImage(const Image& image,
+                            const Camera& camera,
+                            const uint64_t hash = kFnvOffsetBasis);
+  static uint64_t HashCamera(const Camera& camera,
+                             const uint64_t hash = kFnvOffsetBasis);
+
+  static RegionResult MakeRegionResult(const uint64_t hash,
+                                       const double uncertainty,
+                                       const Image* virtual_image);
+
+  // Pose of the virtual camera of a region result
+  static Image VirtualImage(const RegionResult& result);
+
+ private:
+  struct Header {
+    char magic[8];
+    uint64_t config_hash;
+    uint64_t model_hash;
+    uint64_t num_points;
+    uint64_t num_regions;
+  };
+
+  void Close();
+
+  std::string path_;
+  uint64_t config_hash_;
+  uint64_t model_hash_;
+
+  // Mapping of the previous results
+  void* data_;
+  size_t size_;
+  const Header* header_;
+  const PointResult* points_;
+  const RegionResult* regions_;
+
+  std::vector<PointResult> new_points_;
+  std::vector<RegionResult> new_regions_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_RESULT_CACHE_H_
@@ -0,0 +1,202 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <iomanip>
+#include <sstream>
+
+#include "solver_statistics.h"
+
+namespace mercator {
+
+const char* SolverStatistics::FieldName(const Field field)
+{
+  switch (field)
+  {
+    case PREPROCESSOR:        return "preprocessor";
+    case RESIDUAL_EVALUATION: return "residual_evaluation";
+    case JACOBIAN_EVALUATION: return "jacobian_evaluation";
+    case LINEAR_SOLVER:       return "linear_solver";
+    case MINIMIZER:           return "minimizer";
+    case POSTPROCESSOR:       return "postprocessor";
+    case TOTAL:               return "total";
+    default:                  return "unknown";
+  }
+}
+
+void SolverStatistics::Add(const ceres::Solver::Summary& summary)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  Bucket& bucket = buckets_[BucketFor(summary.num_residuals)];
+  ++bucket.num_problems;
+  bucket.times[PREPROCESSOR].push_back(summary.preprocessor_time_in_seconds);
+  bucket.times[RESIDUAL_EVALUATION].push_back(
+      summary.residual_evaluation_time_in_seconds);
+  bucket.times[JACOBIAN_EVALUATION].push_back(
+      summary.jacobian_evaluation_time_in_seconds);
+  bucket.times[LINEAR_SOLVER].push_back(summary.linear_solver_time_in_seconds);
+  bucket.times[MINIMIZER].push_back(summary.minimizer_time_in_seconds);
+  bucket.times[POSTPROCESSOR].push_back(summary.postprocessor_time_in_seconds);
+  bucket.times[TOTAL].push_back(summary.total_time_in_seconds);
+}
+
+size_t SolverStatistics::NumProblems() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  size_t num_problems = 0;
+  for (const auto& bucket : buckets_)
+  {
+    num_problems += bucket.second.num_problems;
+  }
+  return num_problems;
+}
+
+RunReport::Distribution SolverStatistics::Timing(const Field field,
+                                                 const int bucket) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<double> times;
+  for (const auto& entry : buckets_)
+  {
+    if (bucket < 0 || entry.first == bucket)
+    {
+      const auto& values = entry.second.times[field];
+      times.insert(times.end(), values.begin(), values.end());
+    }
+  }
+  return RunReport::Summarize(times);
+}
+
+std::vector<int> SolverStatistics::Buckets() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::vector<int> buckets;
+  for (const auto& bucket : buckets_)
+  {
+    buckets.push_back(bucket.first);
+  }
+  return buckets;
+}
+
+size_t SolverStatistics::MinResiduals(const int bucket)
+{
+  return bucket == 0 ? 0 : size_t(1) << bucket;
+}
+
+size_t SolverStatistics::MaxResiduals(const int bucket)
+{
+  return size_t(1) << (bucket + 1);
+}
+
+const std::string SolverStatistics::ToString() const
+{
+  std::ostringstream ss;
+  ss << std::fixed << std::setprecision(3);
+  ss << "Solver time by number of residuals:";
+
+  std::vector<int> buckets = Buckets();
+  buckets.push_back(-1);
+  for (const auto bucket : buckets)
+  {
+    const RunReport::Distribution total = Timing(TOTAL, bucket);
+    if (total.count == 0)
+    {
+      continue;
+    }
+
+    ss << "\n  ";
+    if (bucket < 0)
+    {
+      ss << "all";
+    }
+    else
+    {
+      ss << "[" << MinResiduals(bucket) << ", " << MaxResiduals(bucket)
+         << ")";
+    }
+    ss << ": " << total.count << " problems, " << total.total
+       << " s total, " << total.p50 << " s p50, " << total.p95 << " s p95, "
+       << total.max << " s max";
+
+    for (int field = 0; field < TOTAL; ++field)
+    {
+      const RunReport::Distribution d =
+        Timing(static_cast<Field>(field), bucket);
+      ss << "\n    " << std::setw(20) << std::left
+         << FieldName(static_cast<Field>(field)) << std::right
+         << std::setw(10) << d.total << " s"
+         << std::setw(7) << std::setprecision(1)
+         << (total.total > 0 ? 100.0 * d.total / total.total : 0.0) << "%"
+         << std::setprecision(3);
+    }
+  }
+
+  return ss.str();
+}
+
+void SolverStatistics::AddToReport(RunReport* report) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  for (const auto& bucket : buckets_)
+  {
+    std::ostringstream range;
+    range << MinResiduals(bucket.first) << "-" << MaxResiduals(bucket.first);
+
+    for (int field = 0; field < NUM_FIELDS; ++field)
+    {
+      const std::string name =
+        std::string("solver/") + FieldName(static_cast<Field>(field));
+      for (const auto time : bucket.second.times[field])
+      {
+        report->AddTiming(name, time);
+        report->AddTiming(name + "/" + range.str(), time);
+      }
+    }
+  }
+}
+
+void SolverStatistics::Clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  buckets_.clear();
+}
+
+int SolverStatistics::BucketFor(const int num_residuals)
+{
+  if (num_residuals <= 1)
+  {
+    return 0;
+  }
+
+  int bucket = 0;
+  while ((size_t(1) << (bucket + 1)) <= static_cast<size_t>(num_residuals))
+  {
+    ++bucket;
+  }
+  return bucket;
+}
+
+} // namespace mercator
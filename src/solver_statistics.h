@@ -0,0 +1,100 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_SOLVER_STATISTICS_H_
+#define MERCATOR_SOLVER_STATISTICS_H_
+
+#include <array>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <ceres/ceres.h>
+
+#include "util/report.h"
+
+namespace mercator {
+
+// Accumulates the timing breakdown of the Ceres summaries of every bundle
+// adjustment of a run. Problems are bucketed by their number of residuals in
+// powers of two, so that the stages dominating large problems can be told
+// apart from those dominating small ones. Safe to use from several threads.
+class SolverStatistics {
+ public:
+  // Timing fields of ceres::Solver::Summary. The residual evaluation,
+  // Jacobian evaluation and linear solver times are part of the minimizer
+  // time, which with the preprocessor and postprocessor times makes up the
+  // total.
+  enum Field {
+    PREPROCESSOR,
+    RESIDUAL_EVALUATION,
+    JACOBIAN_EVALUATION,
+    LINEAR_SOLVER,
+    MINIMIZER,
+    POSTPROCESSOR,
+    TOTAL,
+    NUM_FIELDS
+  };
+
+  static const char* FieldName(const Field field);
+
+  void Add(const ceres::Solver::Summary& summary);
+
+  size_t NumProblems() const;
+
+  // Distribution of one field over the problems whose number of residuals is
+  // in [MinResiduals(bucket), MaxResiduals(bucket)), or over all problems if
+  // bucket is negative
+  RunReport::Distribution Timing(const Field field, const int bucket) const;
+
+  // Buckets that hold at least one problem
+  std::vector<int> Buckets() const;
+
+  static size_t MinResiduals(const int bucket);
+  static size_t MaxResiduals(const int bucket);
+
+  // Table of the totals and the share of each field, per bucket
+  const std::string ToString() const;
+
+  // Add every recorded time to the report, as timings named
+  // solver/<field> and solver/<field>/<min>-<max>
+  void AddToReport(RunReport* report) const;
+
+  void Clear();
+
+ private:
+  struct Bucket {
+    size_t num_problems = 0;
+    std::array<std::vector<double>, NUM_FIELDS> times;
+  };
+
+  static int BucketFor(const int num_residuals);
+
+  mutable std::mutex mutex_;
+
+  std::map<int, Bucket> buckets_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_SOLVER_STATISTICS_H_
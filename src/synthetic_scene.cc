@@ -0,0 +1,495 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+#include "camera.h"
+#include "camera_models.h"
+#include "synthetic_scene.h"
+#include "util/types.h"
+
+namespace mercator {
+
+namespace {
+
+// Independent random streams derived from the seed
+enum Stream : uint64_t {
+  TRACK_STREAM = 1,
+  POSITION_STREAM = 2,
+  COVARIANCE_STREAM = 3,
+  NOISE_STREAM = 4,
+  KEYPOINT_STREAM = 5
+};
+
+inline uint64_t Mix(uint64_t z)
+{
+  z += 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// SplitMix64 generator, cheap enough to be created for every point
+class Random {
+ public:
+  Random(const uint64_t seed,
+         const Stream stream,
+         const uint64_t idx,
+         const uint64_t sub_idx = 0)
+    : state_(Mix(Mix(Mix(seed ^ stream) ^ idx) ^ sub_idx)) {}
+
+  uint64_t Next()
+  {
+    state_ = Mix(state_);
+    return state_;
+  }
+
+  // Uniform in [0, 1)
+  double Uniform() { return (Next() >> 11) * (1.0 / 9007199254740992.0); }
+
+  double Normal()
+  {
+    const double u1 = 1.0 - Uniform();
+    const double u2 = Uniform();
+    return std::sqrt(-2.0 * std::log(u1)) * std::cos(2.0 * M_PI * u2);
+  }
+
+ private:
+  uint64_t state_;
+};
+
+template<typename T>
+void WriteBinary(std::ostream* stream, const T& data)
+{
+  // The reader expects little endian data
+  stream->write(reinterpret_cast<const char*>(&data), sizeof(T));
+}
+
+// Large buffer for the output files, which can reach many gigabytes
+class OutputFile {
+ public:
+  explicit OutputFile(const std::string& path) : buffer_(1 << 20)
+  {
+    file_.rdbuf()->pubsetbuf(buffer_.data(), buffer_.size());
+    file_.open(path, std::ios::binary);
+  }
+
+  std::ofstream& Stream() { return file_; }
+
+ private:
+  std::vector<char> buffer_;
+  std::ofstream file_;
+};
+
+} // namespace
+
+SyntheticScene::SyntheticScene(const Options& options) : options_(options)
+{
+  params_[0] = options.focal_length;
+  params_[1] = options.width / 2.0;
+  params_[2] = options.height / 2.0;
+  params_[3] = options.radial_distortion;
+
+  // Consecutive images are close enough that the longest track still fits
+  // in the footprint of every image that sees it
+  const double half_footprint = options.altitude * params_[1] / params_[0];
+  baseline_ = 1.6 * half_footprint / std::max(WindowSize(), 1);
+  radius_ = options.num_images * baseline_ / (2 * M_PI);
+}
+
+bool SyntheticScene::Validate() const
+{
+  if (options_.num_images == 0 || options_.num_points == 0)
+  {
+    std::cerr << "The scene needs at least one image and one point"
+              << std::endl;
+    return false;
+  }
+
+  if (options_.min_track_length < 1 ||
+      options_.max_track_length < options_.min_track_length)
+  {
+    std::cerr << "Track lengths must satisfy 1 <= min <= max" << std::endl;
+    return false;
+  }
+
+  if (options_.max_track_length > static_cast<int>(options_.num_images))
+  {
+    std::cerr << "Tracks cannot be longer than the number of images"
+              << std::endl;
+    return false;
+  }
+
+  if (FindCameraModel(options_.camera_model) == nullptr)
+  {
+    std::cerr << "Unknown camera model " << options_.camera_model
+              << std::endl;
+    return false;
+  }
+
+  if (options_.width == 0 || options_.height == 0 ||
+      options_.focal_length <= 0 || options_.altitude <= 0)
+  {
+    std::cerr << "The camera and the orbit must have a positive size"
+              << std::endl;
+    return false;
+  }
+
+  const uint64_t max_points2d =
+    (options_.num_points / options_.num_images + 1) * WindowSize();
+  if (max_points2d > UINT32_MAX)
+  {
+    std::cerr << "Too many 2D points per image, add more images" << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool SyntheticScene::Write(const std::string& path) const
+{
+  return Validate() &&
+    WriteCameras(path) && WriteImages(path) && WritePoints(path);
+}
+
+const SyntheticScene::Options& SyntheticScene::SceneOptions() const
+{
+  return options_;
+}
+
+uint32_t SyntheticScene::BaseImage(const uint64_t point_idx) const
+{
+  uint32_t image_idx = static_cast<uint32_t>(
+      static_cast<long double>(point_idx) * options_.num_images
+      / options_.num_points);
+
+  // Correct the rounding of the estimate
+  while (image_idx + 1 < options_.num_images &&
+         FirstPoint(image_idx + 1) <= point_idx)
+  {
+    ++image_idx;
+  }
+  while (image_idx > 0 && FirstPoint(image_idx) > point_idx)
+  {
+    --image_idx;
+  }
+  return image_idx;
+}
+
+uint64_t SyntheticScene::FirstPoint(const uint32_t image_idx) const
+{
+  const uint64_t num_images = options_.num_images;
+  const uint64_t num_points = options_.num_points;
+  return (num_points / num_images) * image_idx
+    + (num_points % num_images) * image_idx / num_images;
+}
+
+int SyntheticScene::TrackLength(const uint64_t point_idx) const
+{
+  Random random(options_.seed, TRACK_STREAM, point_idx);
+
+  const int min_length = options_.min_track_length;
+  const int max_length = options_.max_track_length;
+
+  if (options_.track_length_distribution == TrackLengthDistribution::UNIFORM)
+  {
+    return min_length + static_cast<int>(
+        random.Next() % static_cast<uint64_t>(max_length - min_length + 1));
+  }
+
+  // Geometric number of extra images, with the requested mean
+  const double mean_extra = options_.mean_track_length - min_length;
+  if (mean_extra <= 0)
+  {
+    return min_length;
+  }
+
+  const double p = 1.0 / (mean_extra + 1.0);
+  const double extra =
+    std::floor(std::log(1.0 - random.Uniform()) / std::log(1.0 - p));
+  return static_cast<int>(
+      std::min<double>(min_length + extra, max_length));
+}
+
+Eigen::Vector3d SyntheticScene::PointCoords(const uint64_t point_idx) const
+{
+  Random random(options_.seed, POSITION_STREAM, point_idx);
+
+  // Centered between the first and last image of the track, with some jitter
+  // along and across the orbit
+  const double track_center = BaseImage(point_idx)
+    + (TrackLength(point_idx) - 1) / 2.0 + (random.Uniform() - 0.5) / 2.0;
+  const double angle = 2 * M_PI * track_center / options_.num_images;
+
+  const double half_footprint = options_.altitude * params_[2] / params_[0];
+  const double radius =
+    radius_ + (2 * random.Uniform() - 1) * 0.8 * half_footprint;
+
+  return Eigen::Vector3d(radius * std::cos(angle),
+                         radius * std::sin(angle),
+                         0.05 * options_.altitude * random.Uniform());
+}
+
+Eigen::Matrix3d SyntheticScene::PointCovariance(const uint64_t point_idx) const
+{
+  Random random(options_.seed, COVARIANCE_STREAM, point_idx);
+
+  const Eigen::Quaterniond axes = Eigen::Quaterniond(
+      random.Normal(), random.Normal(), random.Normal(), random.Normal())
+    .normalized();
+
+  Eigen::Vector3d eigenvalues;
+  for (int i = 0; i < 3; ++i)
+  {
+    eigenvalues(i) = options_.covariance_scale
+      * std::exp(options_.covariance_spread * random.Normal());
+  }
+
+  const Eigen::Matrix3d rotation = axes.toRotationMatrix();
+  return rotation * eigenvalues.asDiagonal() * rotation.transpose();
+}
+
+Eigen::Quaterniond SyntheticScene::ImageRotation(const uint32_t image_idx) const
+{
+  // Looking straight down with the x axis along the orbit
+  const double angle = 2 * M_PI * image_idx / options_.num_images;
+  Eigen::Matrix3d rotation;
+  rotation << -std::sin(angle), std::cos(angle), 0,
+              std::cos(angle), std::sin(angle), 0,
+              0, 0, -1;
+  return Eigen::Quaterniond(rotation);
+}
+
+Eigen::Vector3d SyntheticScene::ImageTranslation(
+    const uint32_t image_idx) const
+{
+  const double angle = 2 * M_PI * image_idx / options_.num_images;
+  const Eigen::Vector3d center(radius_ * std::cos(angle),
+                               radius_ * std::sin(angle),
+                               options_.altitude);
+  return -(ImageRotation(image_idx) * center);
+}
+
+uint64_t SyntheticScene::NumPoints2d(const uint32_t image_idx) const
+{
+  return Point2dIdx(image_idx, FirstPoint(0), WindowSize());
+}
+
+uint64_t SyntheticScene::Point2dIdx(const uint32_t image_idx,
+                                    const uint64_t point_idx,
+                                    const int offset) const
+{
+  const uint32_t num_images = options_.num_images;
+
+  // The 2D points of an image are the points of the blocks of this image
+  // and the window before it, latest block first
+  uint64_t idx = 0;
+  for (int d = 0; d < offset; ++d)
+  {
+    const uint32_t base = (image_idx + num_images - d) % num_images;
+    const uint64_t end = base + 1 < num_images
+      ? FirstPoint(base + 1) : options_.num_points;
+    idx += end - FirstPoint(base);
+  }
+
+  if (offset < WindowSize())
+  {
+    const uint32_t base = (image_idx + num_images - offset) % num_images;
+    idx += point_idx - FirstPoint(base);
+  }
+
+  return idx;
+}
+
+Eigen::Vector2d SyntheticScene::Observe(const Eigen::Matrix3d& rotation,
+                                        const Eigen::Vector3d& translation,
+                                        const uint32_t image_idx,
+                                        const uint64_t point_idx) const
+{
+  const Eigen::Vector3d local = rotation * PointCoords(point_idx) + translation;
+
+  Eigen::Vector2d xy;
+  Camera::WorldToImage(params_, local.data(), xy.data());
+
+  Random random(options_.seed, NOISE_STREAM, point_idx, image_idx);
+  xy(0) += options_.pixel_noise * random.Normal();
+  xy(1) += options_.pixel_noise * random.Normal();
+  return xy;
+}
+
+int SyntheticScene::WindowSize() const
+{
+  return std::min<int>(options_.max_track_length, options_.num_images);
+}
+
+bool SyntheticScene::WriteCameras(const std::string& path) const
+{
+  OutputFile file(path + "/cameras.bin");
+  std::ofstream& stream = file.Stream();
+  if (!stream.is_open())
+  {
+    std::cerr << "Could not open file " << path << "/cameras.bin" << std::endl;
+    return false;
+  }
+
+  const CameraModel& model = *FindCameraModel(options_.camera_model);
+  const std::vector<double> params = FromSimpleRadialParams(
+      model, std::vector<double>(params_, params_ + 4));
+
+  WriteBinary<uint64_t>(&stream, 1);
+  WriteBinary<uint32_t>(&stream, 1);
+  WriteBinary<int>(&stream, model.model_id);
+  WriteBinary<uint64_t>(&stream, options_.width);
+  WriteBinary<uint64_t>(&stream, options_.height);
+  for (const auto param : params)
+  {
+    WriteBinary<double>(&stream, param);
+  }
+
+  return stream.good();
+}
+
+bool SyntheticScene::WriteImages(const std::string& path) const
+{
+  OutputFile file(path + "/images.bin");
+  std::ofstream& stream = file.Stream();
+  if (!stream.is_open())
+  {
+    std::cerr << "Could not open file " << path << "/images.bin" << std::endl;
+    return false;
+  }
+
+  const uint32_t num_images = options_.num_images;
+
+  WriteBinary<uint64_t>(&stream, num_images);
+  for (uint32_t image_idx = 0; image_idx < num_images; ++image_idx)
+  {
+    const Eigen::Quaterniond rotation = ImageRotation(image_idx);
+    const Eigen::Matrix3d rotation_matrix = rotation.toRotationMatrix();
+    const Eigen::Vector3d translation = ImageTranslation(image_idx);
+
+    WriteBinary<uint32_t>(&stream, image_idx + 1);
+    WriteBinary<double>(&stream, rotation.w());
+    WriteBinary<double>(&stream, rotation.x());
+    WriteBinary<double>(&stream, rotation.y());
+    WriteBinary<double>(&stream, rotation.z());
+    WriteBinary<double>(&stream, translation(0));
+    WriteBinary<double>(&stream, translation(1));
+    WriteBinary<double>(&stream, translation(2));
+    WriteBinary<uint32_t>(&stream, 1);
+
+    char name[32];
+    std::snprintf(name, sizeof(name), "image_%06u.jpg", image_idx + 1);
+    stream.write(name, std::strlen(name) + 1);
+
+    WriteBinary<uint64_t>(&stream, NumPoints2d(image_idx));
+    for (int offset = 0; offset < WindowSize(); ++offset)
+    {
+      const uint32_t base = (image_idx + num_images - offset) % num_images;
+      const uint64_t end = base + 1 < num_images
+        ? FirstPoint(base + 1) : options_.num_points;
+
+      for (uint64_t point_idx = FirstPoint(base); point_idx < end;
+           ++point_idx)
+      {
+        if (offset < TrackLength(point_idx))
+        {
+          const Eigen::Vector2d xy =
+            Observe(rotation_matrix, translation, image_idx, point_idx);
+          WriteBinary<double>(&stream, xy(0));
+          WriteBinary<double>(&stream, xy(1));
+          WriteBinary<uint64_t>(&stream, point_idx + 1);
+        }
+        else
+        {
+          // An unmatched feature anywhere in the frame
+          Random random(options_.seed, KEYPOINT_STREAM, point_idx, image_idx);
+          WriteBinary<double>(&stream, random.Uniform() * options_.width);
+          WriteBinary<double>(&stream, random.Uniform() * options_.height);
+          WriteBinary<uint64_t>(&stream, kInvalidPoint3dId);
+        }
+      }
+    }
+  }
+
+  return stream.good();
+}
+
+bool SyntheticScene::WritePoints(const std::string& path) const
+{
+  OutputFile file(path + "/points3D.bin");
+  std::ofstream& stream = file.Stream();
+  if (!stream.is_open())
+  {
+    std::cerr << "Could not open file " << path << "/points3D.bin"
+              << std::endl;
+    return false;
+  }
+
+  const uint32_t num_images = options_.num_images;
+
+  WriteBinary<uint64_t>(&stream, options_.num_points);
+  for (uint64_t point_idx = 0; point_idx < options_.num_points; ++point_idx)
+  {
+    const Eigen::Vector3d coords = PointCoords(point_idx);
+    const Eigen::Matrix3d covariance = PointCovariance(point_idx);
+
+    WriteBinary<uint64_t>(&stream, point_idx + 1);
+    WriteBinary<double>(&stream, coords(0));
+    WriteBinary<double>(&stream, coords(1));
+    WriteBinary<double>(&stream, coords(2));
+
+    Random random(options_.seed, COVARIANCE_STREAM, point_idx, 1);
+    for (int i = 0; i < 3; ++i)
+    {
+      WriteBinary<uint8_t>(&stream, static_cast<uint8_t>(random.Next()));
+    }
+
+    WriteBinary<double>(&stream, options_.pixel_noise);
+
+    for (int i = 0; i < covariance.size(); ++i)
+    {
+      WriteBinary<double>(&stream, covariance(i));
+    }
+
+    const int track_length = TrackLength(point_idx);
+    const uint32_t base = BaseImage(point_idx);
+    WriteBinary<uint64_t>(&stream, track_length);
+    for (int offset = 0; offset < track_length; ++offset)
+    {
+      const uint32_t image_idx = (base + offset) % num_images;
+      WriteBinary<uint32_t>(&stream, image_idx + 1);
+      WriteBinary<uint32_t>(&stream, static_cast<uint32_t>(
+            Point2dIdx(image_idx, point_idx, offset)));
+    }
+  }
+
+  return stream.good();
+}
+
+} // namespace mercator
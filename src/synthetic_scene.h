@@ -0,0 +1,148 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_SYNTHETIC_SCENE_H_
+#define MERCATOR_SYNTHETIC_SCENE_H_
+
+#include <cstdint>
+#include <string>
+
+#include <Eigen/Core>
+#include <Eigen/Geometry>
+
+namespace mercator {
+
+// Generates a reconstruction in the binary format read by ColmapReader,
+// including the covariance block of each point, so that benchmarks can run on
+// scenes of any size without field data.
+//
+// The images are taken looking down from a circular orbit. The points are
+// split into contiguous blocks, one per image, and the track of a point starts
+// at the image of its block and continues through the following images around
+// the orbit. Every image therefore holds a 2D point for each point of the
+// max_track_length blocks before it; those of points whose track ends earlier
+// are left unmatched, as detected features without a 3D point are. This lets
+// every point, track and 2D point be computed independently from the seed, so
+// that the files are written in a single streaming pass with constant memory.
+class SyntheticScene {
+ public:
+  enum class TrackLengthDistribution {
+    // Uniform between min_track_length and max_track_length
+    UNIFORM,
+
+    // min_track_length plus a geometric variable with the given mean,
+    // truncated at max_track_length
+    GEOMETRIC
+  };
+
+  struct Options {
+    uint32_t num_images = 100;
+    uint64_t num_points = 10000;
+
+    TrackLengthDistribution track_length_distribution =
+      TrackLengthDistribution::GEOMETRIC;
+    int min_track_length = 2;
+    double mean_track_length = 4.0;
+    int max_track_length = 12;
+
+    // Each eigenvalue of a point's covariance is
+    // covariance_scale * exp(covariance_spread * N(0, 1)), along random axes
+    double covariance_scale = 1e-4;
+    double covariance_spread = 1.0;
+
+    // Name of the COLMAP camera model written to cameras.bin
+    std::string camera_model = "SIMPLE_RADIAL";
+    uint64_t width = 4000;
+    uint64_t height = 3000;
+    double focal_length = 3000.0;
+    double radial_distortion = 0.0;
+
+    // Height of the orbit above the ground, in model units
+    double altitude = 50.0;
+
+    // Standard deviation of the noise added to the 2D points, in pixels
+    double pixel_noise = 0.5;
+
+    uint64_t seed = 1;
+  };
+
+  explicit SyntheticScene(const Options& options);
+
+  // Check the options, printing the first problem found
+  bool Validate() const;
+
+  // Write cameras.bin, images.bin and points3D.bin into an existing directory
+  bool Write(const std::string& path) const;
+
+  const Options& SceneOptions() const;
+
+  // Image whose block contains a point, and the first point of the block of
+  // an image. Points and images are numbered from 0; their IDs are one
+  // higher.
+  uint32_t BaseImage(const uint64_t point_idx) const;
+  uint64_t FirstPoint(const uint32_t image_idx) const;
+
+  int TrackLength(const uint64_t point_idx) const;
+
+  Eigen::Vector3d PointCoords(const uint64_t point_idx) const;
+
+  Eigen::Matrix3d PointCovariance(const uint64_t point_idx) const;
+
+  // Rotation from the world frame to the camera frame and translation of an
+  // image
+  Eigen::Quaterniond ImageRotation(const uint32_t image_idx) const;
+  Eigen::Vector3d ImageTranslation(const uint32_t image_idx) const;
+
+  // Number of 2D points of an image, and the index among them of the
+  // observation of a point whose track starts offset images earlier
+  uint64_t NumPoints2d(const uint32_t image_idx) const;
+  uint64_t Point2dIdx(const uint32_t image_idx,
+                      const uint64_t point_idx,
+                      const int offset) const;
+
+ private:
+  bool WriteCameras(const std::string& path) const;
+  bool WriteImages(const std::string& path) const;
+  bool WritePoints(const std::string& path) const;
+
+  // Projection of a point onto an image with the given pose, with noise
+  Eigen::Vector2d Observe(const Eigen::Matrix3d& rotation,
+                          const Eigen::Vector3d& translation,
+                          const uint32_t image_idx,
+                          const uint64_t point_idx) const;
+
+  // Number of blocks that hold 2D points of each image
+  int WindowSize() const;
+
+  const Options options_;
+
+  // Intrinsics in the form used by Camera
+  double params_[4];
+
+  // Distance between consecutive images and radius of the orbit
+  double baseline_;
+  double radius_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_SYNTHETIC_SCENE_H_
@@ -0,0 +1,155 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <iomanip>
+#include <sstream>
+
+#include "point_hierarchy.h"
+#include "threshold_sweep.h"
+#include "util/report.h"
+
+namespace mercator {
+
+ThresholdSweep::ThresholdSweep(const Options& options,
+                               const Planner::Options& planner_options,
+                               ColmapReader* reader,
+                               const Logger& logger)
+  : options_(options),
+    planner_options_(planner_options),
+    reader_(reader),
+    logger_(logger) {}
+
+void ThresholdSweep::Run()
+{
+  results_.clear();
+
+  PointHierarchy hierarchy;
+  if (planner_options_.lod_levels > 0)
+  {
+    hierarchy.Build(reader_->Points(), planner_options_.lod_voxel_size,
+                    planner_options_.lod_levels);
+  }
+
+  const size_t num_combinations = options_.uncertainty_thresholds.size() *
+    options_.min_cameras.size() *
+    options_.min_ground_sampling_distances.size();
+
+  // Candidates of every combination, keyed by region, angle and ground
+  // sampling distance
+  Planner::CandidateCache candidates;
+
+  for (const double gsd : options_.min_ground_sampling_distances)
+  {
+    for (const double threshold : options_.uncertainty_thresholds)
+    {
+      for (const uint64_t min_cameras : options_.min_cameras)
+      {
+        Planner::Options planner_options = planner_options_;
+        planner_options.uncertainty_threshold = threshold;
+        planner_options.min_cameras = min_cameras;
+        planner_options.min_ground_sampling_distance = gsd;
+
+        Planner planner(planner_options, logger_, reader_);
+        planner.SetCandidateCache(&candidates);
+        if (hierarchy.NumLevels() > 0)
+        {
+          planner.SetPointHierarchy(hierarchy);
+        }
+
+        Result result;
+        result.uncertainty_threshold = threshold;
+        result.min_cameras = min_cameras;
+        result.min_ground_sampling_distance = gsd;
+        {
+          ScopedTimer timer(&planner.Report(), "sweep");
+          planner.Run();
+          result.seconds = timer.Elapsed();
+        }
+
+        const RunReport& report = planner.Report();
+        result.num_points = report.Count("points_classified");
+        result.num_covered = result.num_points -
+          report.Count("points_uncovered");
+        result.num_regions = report.Count("regions");
+        result.num_virtual_cameras = planner.VirtualCameras().size();
+        for (const double uncertainty : planner.VirtualCameraUncertainties())
+        {
+          if (uncertainty < threshold)
+          {
+            ++result.num_resolved;
+          }
+        }
+        result.num_candidates = report.Count("candidates");
+        result.num_reused = report.Count("candidates_reused");
+
+        results_.push_back(result);
+
+        logger_.Log() << "[" << results_.size() << "/" << num_combinations
+                      << "] uncertainty_threshold = " << threshold
+                      << ", min_cameras = " << min_cameras
+                      << ", min_ground_sampling_distance = " << gsd << ": "
+                      << result.num_virtual_cameras << " virtual cameras, "
+                      << result.num_reused << " candidates reused"
+                      << std::endl;
+      }
+    }
+  }
+
+  logger_.Flush();
+}
+
+const std::vector<ThresholdSweep::Result>& ThresholdSweep::Results() const
+{
+  return results_;
+}
+
+const std::string ThresholdSweep::Summary() const
+{
+  std::ostringstream ss;
+  ss << "Threshold sweep:\n"
+     << std::setw(12) << "uncertainty" << std::setw(8) << "cams"
+     << std::setw(12) << "gsd" << std::setw(10) << "points"
+     << std::setw(10) << "covered" << std::setw(9) << "regions"
+     << std::setw(9) << "virtual" << std::setw(10) << "resolved"
+     << std::setw(8) << "solved" << std::setw(8) << "reused"
+     << std::setw(10) << "seconds";
+
+  for (const auto& result : results_)
+  {
+    ss << "\n" << std::setw(12) << result.uncertainty_threshold
+       << std::setw(8) << result.min_cameras
+       << std::setw(12) << result.min_ground_sampling_distance
+       << std::setw(10) << result.num_points
+       << std::setw(10) << result.num_covered
+       << std::setw(9) << result.num_regions
+       << std::setw(9) << result.num_virtual_cameras
+       << std::setw(10) << result.num_resolved
+       << std::setw(8) << result.num_candidates
+       << std::setw(8) << result.num_reused
+       << std::setw(10) << std::fixed << std::setprecision(3)
+       << result.seconds << std::defaultfloat;
+  }
+
+  return ss.str();
+}
+
+} // namespace mercator
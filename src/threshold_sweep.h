@@ -0,0 +1,98 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_THRESHOLD_SWEEP_H_
+#define MERCATOR_THRESHOLD_SWEEP_H_
+
+#include <string>
+#include <vector>
+
+#include "planner.h"
+#include "util/colmap.h"
+#include "util/logger.h"
+
+namespace mercator {
+
+// Plans a model once for every combination of a grid of coverage criteria
+// and ground sampling distances. The model is read and the point hierarchy
+// is built only once, and the bundle adjustments of the candidate cameras
+// are shared: a candidate solved for one combination is reused by every
+// other combination that plans the same region with the same ground
+// sampling distance.
+class ThresholdSweep {
+ public:
+  // Values of each parameter. The grid is their cartesian product.
+  struct Options {
+    std::vector<double> uncertainty_thresholds;
+    std::vector<uint64_t> min_cameras;
+    std::vector<double> min_ground_sampling_distances;
+  };
+
+  // Coverage and planning statistics of one combination
+  struct Result {
+    double uncertainty_threshold = 0.0;
+    uint64_t min_cameras = 0;
+    double min_ground_sampling_distance = 0.0;
+
+    size_t num_points = 0;
+    size_t num_covered = 0;
+    size_t num_regions = 0;
+    size_t num_virtual_cameras = 0;
+
+    // Virtual cameras that bring their region below the threshold
+    size_t num_resolved = 0;
+
+    // Candidates solved for this combination and reused from others
+    size_t num_candidates = 0;
+    size_t num_reused = 0;
+
+    double seconds = 0.0;
+  };
+
+  // The other planner options are the same for every combination
+  ThresholdSweep(const Options& options,
+                 const Planner::Options& planner_options,
+                 ColmapReader* reader,
+                 const Logger& logger);
+
+  void Run();
+
+  const std::vector<Result>& Results() const;
+
+  // Table of the results, one combination per row
+  const std::string Summary() const;
+
+ private:
+  const Options options_;
+
+  const Planner::Options planner_options_;
+
+  ColmapReader* reader_;
+
+  const Logger& logger_;
+
+  std::vector<Result> results_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_THRESHOLD_SWEEP_H_
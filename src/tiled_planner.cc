@@ -0,0 +1,722 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+
+#include "mercator.h"
+#include "result_cache.h"
+#include "tiled_planner.h"
+#include "voxel_grid.h"
+
+extern char** environ;
+
+namespace mercator {
+
+namespace {
+
+// Index of the cell of a grid with the given spacing that contains x,
+// consistent with the bounds of the cell computed as index * spacing
+int64_t CellIndex(const double x, const double spacing)
+{
+  int64_t idx = static_cast<int64_t>(std::floor(x / spacing));
+  if (x < idx * spacing)
+  {
+    --idx;
+  }
+  else if (x >= (idx + 1) * spacing)
+  {
+    ++idx;
+  }
+  return idx;
+}
+
+// Row and column of the cell of the tile grid that contains a point
+std::pair<int64_t, int64_t> Cell(const Eigen::Vector2d& xy,
+                                 const double tile_size)
+{
+  return { CellIndex(xy(1), tile_size), CellIndex(xy(0), tile_size) };
+}
+
+// Direction of the optical axis of an image in the world frame
+Eigen::Vector3d OpticalAxis(const Image& image)
+{
+  return image.RotationMatrix().row(2).transpose();
+}
+
+} // namespace
+
+bool Tile::Contains(const Eigen::Vector3d& xyz) const
+{
+  return xyz(0) >= min(0) && xyz(0) < max(0) &&
+    xyz(1) >= min(1) && xyz(1) < max(1);
+}
+
+Tile Tile::Expanded(const double margin) const
+{
+  Tile tile;
+  tile.min = min.array() - margin;
+  tile.max = max.array() + margin;
+  return tile;
+}
+
+std::string Tile::ToString() const
+{
+  char buffer[128];
+  std::snprintf(buffer, sizeof(buffer), "%.17g,%.17g,%.17g,%.17g",
+                min(0), min(1), max(0), max(1));
+  return buffer;
+}
+
+bool Tile::Parse(const std::string& str, Tile* tile)
+{
+  std::istringstream ss(str);
+  char sep[3];
+  ss >> tile->min(0) >> sep[0] >> tile->min(1) >> sep[1] >> tile->max(0)
+     >> sep[2] >> tile->max(1);
+  return ss && ss.peek() == EOF &&
+    sep[0] == ',' && sep[1] == ',' && sep[2] == ',';
+}
+
+TiledPlanner::TiledPlanner(const Options& options,
+                           Planner* planner,
+                           ColmapReader* reader,
+                           const Logger& logger)
+  : options_(options), planner_(planner), reader_(reader), logger_(logger) {}
+
+std::vector<Tile> TiledPlanner::MakeTiles() const
+{
+  // Occupied cells, ordered by row
+  std::set<std::pair<int64_t, int64_t>> cells;
+  for (const auto& point3d : reader_->Points())
+  {
+    cells.insert(Cell(point3d.second.Coords().head<2>(), options_.tile_size));
+  }
+
+  std::vector<Tile> tiles;
+  tiles.reserve(cells.size());
+  for (const auto& cell : cells)
+  {
+    Tile tile;
+    tile.min << cell.second * options_.tile_size,
+                cell.first * options_.tile_size;
+    tile.max << (cell.second + 1) * options_.tile_size,
+                (cell.first + 1) * options_.tile_size;
+    tiles.push_back(tile);
+  }
+
+  return tiles;
+}
+
+double TiledPlanner::HaloSize() const
+{
+  const Planner::Options& options = planner_->PlannerOptions();
+  const Camera& camera = reader_->Cameras().begin()->second;
+
+  // The halo also holds the rest of any region that reaches into the tile,
+  // so that both tiles build the same region
+  return std::max(CalculateDistanceForGSD(options.camera_pixel_size,
+                                          camera.Params()[0],
+                                          options.min_ground_sampling_distance),
+                  options.region_voxel_size);
+}
+
+bool TiledPlanner::Run(const std::vector<std::string>& worker_args)
+{
+  ScopedTimer timer(&planner_->Report(), "tiles");
+
+  const std::vector<Tile> tiles = MakeTiles();
+
+  const size_t num_workers = options_.num_workers > 0
+    ? options_.num_workers
+    : std::max(1u, std::thread::hardware_concurrency());
+
+  logger_.Info() << "Planning " << tiles.size() << " tiles with a halo of "
+                 << HaloSize() << " in up to " << num_workers
+                 << " worker processes" << std::endl;
+
+  const char* tmpdir = std::getenv("TMPDIR");
+  std::string dir = std::string(tmpdir ? tmpdir : "/tmp")
+    + "/mercator_tiles_XXXXXX";
+  if (mkdtemp(&dir[0]) == nullptr)
+  {
+    std::cerr << "Failed to create " << dir << ": " << std::strerror(errno)
+              << std::endl;
+    return false;
+  }
+
+  std::vector<std::string> paths(tiles.size());
+  std::vector<std::string> subset_paths(tiles.size());
+  for (size_t i = 0; i < tiles.size(); ++i)
+  {
+    paths[i] = dir + "/tile" + std::to_string(i) + ".bin";
+    subset_paths[i] = dir + "/tile" + std::to_string(i) + ".subset";
+  }
+
+  // The regions are found once on the whole model. A region belongs to the
+  // tile of its point with the lowest ID.
+  std::map<std::pair<int64_t, int64_t>, size_t> tile_idxs;
+  for (size_t i = 0; i < tiles.size(); ++i)
+  {
+    tile_idxs.emplace(Cell(0.5 * (tiles[i].min + tiles[i].max),
+                           options_.tile_size), i);
+  }
+
+  planner_->Start();
+  const std::vector<PointRegion> regions =
+    planner_->MakeRegions(planner_->Classify());
+  std::vector<std::vector<const PointRegion*>> tile_regions(tiles.size());
+  for (const auto& region : regions)
+  {
+    const Point3d& point3d = reader_->Point(*std::min_element(
+          region.point3d_ids.begin(), region.point3d_ids.end()));
+    tile_regions[tile_idxs.at(Cell(point3d.Coords().head<2>(),
+                                   options_.tile_size))].push_back(&region);
+  }
+
+  const CellPoints cells = PointsByCell();
+
+  // Start workers as others finish, and stop starting them once one failed.
+  // The subset of a tile is written just before its worker starts, and tiles
+  // without regions have no worker.
+  std::vector<TileCamera> cameras;
+  std::map<pid_t, size_t> running;
+  size_t next = 0;
+  bool ok = true;
+  while ((ok && next < tiles.size()) || !running.empty())
+  {
+    if (ok && next < tiles.size() && tile_regions[next].empty())
+    {
+      ++next;
+      continue;
+    }
+
+    if (ok && next < tiles.size() && running.size() < num_workers)
+    {
+      std::vector<uint32_t> image_ids;
+      std::vector<uint64_t> point3d_ids;
+      FindSubset(tiles[next], tile_regions[next], cells, &image_ids,
+                 &point3d_ids);
+      if (!WriteSubset(subset_paths[next], image_ids, point3d_ids))
+      {
+        ok = false;
+        continue;
+      }
+
+      const pid_t pid =
+        Spawn(worker_args, tiles[next], paths[next], subset_paths[next]);
+      if (pid < 0)
+      {
+        ok = false;
+        continue;
+      }
+      running.emplace(pid, next++);
+      continue;
+    }
+
+    int status;
+    const pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0)
+    {
+      if (errno == EINTR)
+      {
+        continue;
+      }
+      std::cerr << "Failed to wait for tile workers: "
+                << std::strerror(errno) << std::endl;
+      ok = false;
+      break;
+    }
+
+    const auto worker = running.find(pid);
+    if (worker == running.end())
+    {
+      continue;
+    }
+    const size_t idx = worker->second;
+    running.erase(worker);
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+      logger_.Error() << "Worker of tile " << tiles[idx].ToString()
+                      << " failed" << std::endl;
+      ok = false;
+      continue;
+    }
+
+    const size_t num_cameras = cameras.size();
+    if (!ReadCameras(paths[idx], idx, &cameras))
+    {
+      ok = false;
+      continue;
+    }
+
+    logger_.Info() << "Tile " << idx + 1 << " of " << tiles.size()
+                   << " planned " << cameras.size() - num_cameras
+                   << " virtual cameras" << std::endl;
+  }
+
+  for (size_t i = 0; i < tiles.size(); ++i)
+  {
+    std::remove(paths[i].c_str());
+    std::remove(subset_paths[i].c_str());
+  }
+  rmdir(dir.c_str());
+
+  if (!ok)
+  {
+    return false;
+  }
+
+  const Planner::Options& options = planner_->PlannerOptions();
+  const std::vector<TileCamera> merged = MergeCameras(
+      cameras, options.region_voxel_size, options.candidate_angle_step);
+
+  logger_.Info() << "Merged " << cameras.size() << " virtual cameras of "
+                 << tiles.size() << " tiles, removing "
+                 << cameras.size() - merged.size() << " duplicates"
+                 << std::endl;
+
+  for (const auto& camera : merged)
+  {
+    planner_->AddVirtualCamera(camera.image, camera.uncertainty);
+  }
+
+  planner_->Report().AddCount("tiles", tiles.size());
+  planner_->Report().AddCount("tile_duplicates",
+                              cameras.size() - merged.size());
+
+  return true;
+}
+
+bool TiledPlanner::PlanTile(const Tile& tile, const std::string& path)
+{
+  const auto& points = reader_->Points();
+
+  // A region belongs to the tile of its point with the lowest ID, which the
+  // halo guarantees is the same in every tile that builds the region
+  const auto in_tile = [&tile, &points](const PointRegion& region)
+  {
+    return !region.point3d_ids.empty() &&
+      tile.Contains(points.at(*std::min_element(
+            region.point3d_ids.begin(),
+            region.point3d_ids.end())).Coords());
+  };
+
+  logger_.Info() << "Tile " << tile.ToString() << " keeps "
+                 << points.size() << " points and "
+                 << reader_->Images().size() << " images" << std::endl;
+
+  planner_->SetRegionFilter(in_tile);
+
+  planner_->Run();
+
+  return WriteCameras(path, *planner_);
+}
+
+bool TiledPlanner::ReadSubset(const std::string& path,
+                              std::vector<uint32_t>* image_ids,
+                              std::vector<uint64_t>* point3d_ids)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+  {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+
+  file.seekg(0, std::ios::end);
+  const uint64_t file_size = file.tellg();
+  file.seekg(0);
+
+  // The counts are bounded by the file size before anything is allocated
+  uint64_t num_images = 0;
+  file.read(reinterpret_cast<char*>(&num_images), sizeof(num_images));
+  if (!file || num_images > file_size / sizeof(uint32_t))
+  {
+    std::cerr << "Truncated tile subset: " << path << std::endl;
+    return false;
+  }
+  image_ids->resize(num_images);
+  file.read(reinterpret_cast<char*>(image_ids->data()),
+            num_images * sizeof(uint32_t));
+
+  uint64_t num_points = 0;
+  file.read(reinterpret_cast<char*>(&num_points), sizeof(num_points));
+  if (!file || num_points > file_size / sizeof(uint64_t))
+  {
+    std::cerr << "Truncated tile subset: " << path << std::endl;
+    return false;
+  }
+  point3d_ids->resize(num_points);
+  file.read(reinterpret_cast<char*>(point3d_ids->data()),
+            num_points * sizeof(uint64_t));
+
+  if (!file)
+  {
+    std::cerr << "Truncated tile subset: " << path << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+std::vector<TileCamera> TiledPlanner::MergeCameras(
+    const std::vector<TileCamera>& cameras,
+    const double max_distance,
+    const double max_angle)
+{
+  if (max_distance <= 0)
+  {
+    return cameras;
+  }
+
+  // Visit the cameras from the lowest uncertainty and keep each unless a
+  // kept camera of another tile is close and looks the same way
+  std::vector<size_t> order(cameras.size());
+  for (size_t i = 0; i < order.size(); ++i)
+  {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(),
+                   [&cameras](const size_t a, const size_t b)
+                   {
+                     return cameras[a].uncertainty < cameras[b].uncertainty;
+                   });
+
+  const double min_cos_angle = std::cos(max_angle);
+
+  VoxelGrid kept(max_distance);
+  std::vector<bool> keep(cameras.size(), false);
+  for (const size_t i : order)
+  {
+    const Eigen::Vector3d& center = cameras[i].image.ProjectionCenter();
+    const Eigen::Vector3d axis = OpticalAxis(cameras[i].image);
+    const VoxelKey key = kept.Key(center);
+
+    bool duplicate = false;
+    for (int64_t dx = -1; dx <= 1 && !duplicate; ++dx)
+    {
+      for (int64_t dy = -1; dy <= 1 && !duplicate; ++dy)
+      {
+        for (int64_t dz = -1; dz <= 1 && !duplicate; ++dz)
+        {
+          const auto voxel = kept.Find({ key.x + dx, key.y + dy, key.z + dz });
+          if (voxel == nullptr)
+          {
+            continue;
+          }
+
+          for (const uint64_t j : *voxel)
+          {
+            const Image& other = cameras[j].image;
+            if (cameras[j].tile_idx != cameras[i].tile_idx &&
+                (other.ProjectionCenter() - center).norm() <= max_distance &&
+                OpticalAxis(other).dot(axis) >= min_cos_angle)
+            {
+              duplicate = true;
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    if (!duplicate)
+    {
+      keep[i] = true;
+      kept.Insert(i, center);
+    }
+  }
+
+  std::vector<TileCamera> merged;
+  for (size_t i = 0; i < cameras.size(); ++i)
+  {
+    if (keep[i])
+    {
+      merged.push_back(cameras[i]);
+    }
+  }
+
+  return merged;
+}
+
+TiledPlanner::CellPoints TiledPlanner::PointsByCell() const
+{
+  CellPoints cells;
+  for (const auto& point3d : reader_->Points())
+  {
+    cells[Cell(point3d.second.Coords().head<2>(), options_.tile_size)]
+      .push_back(point3d.first);
+  }
+  return cells;
+}
+
+void TiledPlanner::FindSubset(const Tile& tile,
+                              const std::vector<const PointRegion*>& regions,
+                              const CellPoints& cells,
+                              std::vector<uint32_t>* image_ids,
+                              std::vector<uint64_t>* point3d_ids) const
+{
+  const Camera& camera = reader_->Cameras().begin()->second;
+  const Planner::Options& options = planner_->PlannerOptions();
+
+  // The points that the bundle adjustments of the regions hold in a single
+  // process: those seen by the images that see a region, and those seen by
+  // its candidate cameras, which may be anywhere in the scene
+  std::unordered_set<uint64_t> needed_ids;
+  std::unordered_set<uint32_t> region_image_ids;
+  for (const PointRegion* region : regions)
+  {
+    for (const auto point3d_id : region->point3d_ids)
+    {
+      const auto& ids = reader_->Point(point3d_id).ImageIds();
+      region_image_ids.insert(ids.begin(), ids.end());
+    }
+
+    for (const double angle : planner_->CandidateAngles(*region))
+    {
+      Image virtual_image;
+      CreateVirtualCameraForRegion(region->centroid, region->covariance,
+                                   camera,
+                                   options.min_ground_sampling_distance,
+                                   angle, &virtual_image);
+      std::vector<uint64_t> visible_ids;
+      planner_->FindVisiblePoints(&virtual_image, &visible_ids);
+      needed_ids.insert(visible_ids.begin(), visible_ids.end());
+    }
+  }
+
+  for (const auto image_id : region_image_ids)
+  {
+    for (const auto& point2d : reader_->Image(image_id).Points2d())
+    {
+      if (point2d.HasPoint3d())
+      {
+        needed_ids.insert(point2d.Point3dId());
+      }
+    }
+  }
+
+  point3d_ids->clear();
+  for (const auto point3d_id : needed_ids)
+  {
+    if (reader_->Points().count(point3d_id) > 0)
+    {
+      point3d_ids->push_back(point3d_id);
+    }
+  }
+
+  // The points near the tile are kept as well, so that the regions reaching
+  // into the tile are built the same. The cells overlapping the halo are
+  // visited, or every occupied cell if there are fewer.
+  const Tile halo = tile.Expanded(HaloSize());
+  const auto add_halo_points = [this, &halo, point3d_ids](
+      const std::vector<uint64_t>& cell_point3d_ids)
+  {
+    for (const auto point3d_id : cell_point3d_ids)
+    {
+      if (halo.Contains(reader_->Point(point3d_id).Coords()))
+      {
+        point3d_ids->push_back(point3d_id);
+      }
+    }
+  };
+
+  const auto min_cell = Cell(halo.min, options_.tile_size);
+  const auto max_cell = Cell(halo.max, options_.tile_size);
+  const double num_halo_cells =
+    static_cast<double>(max_cell.first - min_cell.first + 1) *
+    static_cast<double>(max_cell.second - min_cell.second + 1);
+  if (num_halo_cells < cells.size())
+  {
+    for (int64_t row = min_cell.first; row <= max_cell.first; ++row)
+    {
+      for (int64_t col = min_cell.second; col <= max_cell.second; ++col)
+      {
+        const auto cell = cells.find({ row, col });
+        if (cell != cells.end())
+        {
+          add_halo_points(cell->second);
+        }
+      }
+    }
+  }
+  else
+  {
+    for (const auto& cell : cells)
+    {
+      add_halo_points(cell.second);
+    }
+  }
+
+  std::sort(point3d_ids->begin(), point3d_ids->end());
+  point3d_ids->erase(std::unique(point3d_ids->begin(), point3d_ids->end()),
+                     point3d_ids->end());
+
+  // Every image that sees a point that is kept, so that the tracks of the
+  // points stay whole
+  std::unordered_set<uint32_t> kept_image_ids;
+  for (const auto point3d_id : *point3d_ids)
+  {
+    const auto& ids = reader_->Point(point3d_id).ImageIds();
+    kept_image_ids.insert(ids.begin(), ids.end());
+  }
+  image_ids->assign(kept_image_ids.begin(), kept_image_ids.end());
+  std::sort(image_ids->begin(), image_ids->end());
+}
+
+bool TiledPlanner::WriteSubset(const std::string& path,
+                               const std::vector<uint32_t>& image_ids,
+                               const std::vector<uint64_t>& point3d_ids)
+{
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    std::cerr << "Failed to create " << path << std::endl;
+    return false;
+  }
+
+  const uint64_t num_images = image_ids.size();
+  file.write(reinterpret_cast<const char*>(&num_images), sizeof(num_images));
+  file.write(reinterpret_cast<const char*>(image_ids.data()),
+             num_images * sizeof(uint32_t));
+
+  const uint64_t num_points = point3d_ids.size();
+  file.write(reinterpret_cast<const char*>(&num_points), sizeof(num_points));
+  file.write(reinterpret_cast<const char*>(point3d_ids.data()),
+             num_points * sizeof(uint64_t));
+
+  if (!file.good())
+  {
+    std::cerr << "Failed to write " << path << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+int TiledPlanner::Spawn(const std::vector<std::string>& worker_args,
+                        const Tile& tile,
+                        const std::string& path,
+                        const std::string& subset_path) const
+{
+  std::vector<std::string> args = worker_args;
+  args.push_back("--tile");
+  args.push_back(tile.ToString());
+  args.push_back("--tile-output");
+  args.push_back(path);
+  args.push_back("--tile-input");
+  args.push_back(subset_path);
+
+  std::vector<char*> argv;
+  for (auto& arg : args)
+  {
+    argv.push_back(&arg[0]);
+  }
+  argv.push_back(nullptr);
+
+  pid_t pid;
+  const int error = posix_spawnp(&pid, argv[0], nullptr, nullptr,
+                                 argv.data(), environ);
+  if (error != 0)
+  {
+    std::cerr << "Failed to start " << argv[0] << ": " << std::strerror(error)
+              << std::endl;
+    return -1;
+  }
+
+  return pid;
+}
+
+bool TiledPlanner::WriteCameras(const std::string& path,
+                                const Planner& planner)
+{
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if (!file.is_open())
+  {
+    std::cerr << "Failed to create " << path << std::endl;
+    return false;
+  }
+
+  // Cameras are stored as the results of the result cache
+  const auto& images = planner.VirtualCameras();
+  const auto& uncertainties = planner.VirtualCameraUncertainties();
+  for (size_t i = 0; i < images.size(); ++i)
+  {
+    const ResultCache::RegionResult result =
+      ResultCache::MakeRegionResult(0, uncertainties[i], &images[i]);
+    file.write(reinterpret_cast<const char*>(&result), sizeof(result));
+  }
+
+  if (!file.good())
+  {
+    std::cerr << "Failed to write " << path << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+bool TiledPlanner::ReadCameras(const std::string& path,
+                               const size_t tile_idx,
+                               std::vector<TileCamera>* cameras)
+{
+  std::ifstream file(path, std::ios::binary);
+  if (!file.is_open())
+  {
+    std::cerr << "Failed to open " << path << std::endl;
+    return false;
+  }
+
+  ResultCache::RegionResult result;
+  while (file.read(reinterpret_cast<char*>(&result), sizeof(result)))
+  {
+    cameras->push_back(
+        { ResultCache::VirtualImage(result), result.uncertainty, tile_idx });
+  }
+
+  if (file.gcount() != 0)
+  {
+    std::cerr << "Truncated tile result: " << path << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
+} // namespace mercator
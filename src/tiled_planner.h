@@ -0,0 +1,176 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_TILED_PLANNER_H_
+#define MERCATOR_TILED_PLANNER_H_
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <Eigen/Core>
+
+#include "image.h"
+#include "planner.h"
+#include "util/colmap.h"
+#include "util/logger.h"
+
+namespace mercator {
+
+// Rectangle of the XY plane, including its lower and excluding its upper
+// bounds
+struct Tile {
+  Eigen::Vector2d min = Eigen::Vector2d::Zero();
+  Eigen::Vector2d max = Eigen::Vector2d::Zero();
+
+  bool Contains(const Eigen::Vector3d& xyz) const;
+
+  // The tile grown by margin on every side
+  Tile Expanded(const double margin) const;
+
+  // "min_x,min_y,max_x,max_y", precise enough to be parsed back exactly
+  std::string ToString() const;
+
+  static bool Parse(const std::string& str, Tile* tile);
+};
+
+// A virtual camera planned for a tile
+struct TileCamera {
+  Image image;
+
+  // Uncertainty of the region the camera was planned for
+  double uncertainty;
+
+  size_t tile_idx;
+};
+
+// Plans a scene too large for one process in square tiles of the XY plane,
+// each planned by a worker process running mercator on the same model.
+//
+// A worker reads only the points of its tile and of a halo around it, and
+// plans for the regions whose point with the lowest ID lies in the tile. The
+// halo is at least as wide as a region, so that regions reaching into the
+// tile are built the same in every tile. The worker also reads every point
+// the bundle adjustments of its regions hold in a single process, the points
+// seen by the images that see a region and the points seen by its candidate
+// cameras, and the images that see any of these points. The cameras of all
+// tiles are then merged, keeping only the best of any near duplicates planned
+// by neighbouring tiles.
+//
+// The process that splits the scene holds the whole model and finds the
+// regions and the subset of each tile once. A worker skips everything else
+// while reading, so its memory is bounded by its subset rather than by the
+// model.
+class TiledPlanner {
+ public:
+  struct Options {
+    // Edge length of the tiles, in model units
+    double tile_size = 0.0;
+
+    // Number of workers running at once. If not positive, one per hardware
+    // thread.
+    int num_workers = 0;
+  };
+
+  TiledPlanner(const Options& options,
+               Planner* planner,
+               ColmapReader* reader,
+               const Logger& logger);
+
+  // Tiles of the grid aligned to multiples of the tile size that contain
+  // points of the reader, in row-major order
+  std::vector<Tile> MakeTiles() const;
+
+  // Width of the halo, the largest distance of a virtual camera from its
+  // region allowed by the ground sampling distance, and at least the size of
+  // a region
+  double HaloSize() const;
+
+  // Plan every tile in a worker by running the program with the given
+  // arguments, the first being the program itself, followed by --tile,
+  // --tile-output and --tile-input. The merged cameras are added to the
+  // planner. Returns false if a worker failed.
+  bool Run(const std::vector<std::string>& worker_args);
+
+  // Run in a worker, whose reader holds the subset of the tile: plan for the
+  // regions of the tile and write the cameras to path. Returns false if they
+  // could not be written.
+  bool PlanTile(const Tile& tile, const std::string& path);
+
+  // Read the sorted IDs of the images and points of a tile, written by Run()
+  // for the worker. Returns false if the file could not be read.
+  static bool ReadSubset(const std::string& path,
+                         std::vector<uint32_t>* image_ids,
+                         std::vector<uint64_t>* point3d_ids);
+
+  // Remove the cameras that have a camera of another tile with a lower
+  // uncertainty within the given distance of their projection center and
+  // the given angle of their optical axis
+  static std::vector<TileCamera> MergeCameras(
+      const std::vector<TileCamera>& cameras,
+      const double max_distance,
+      const double max_angle);
+
+ private:
+  // IDs of the points in each cell of the tile grid, by row and column
+  typedef std::map<std::pair<int64_t, int64_t>, std::vector<uint64_t>>
+    CellPoints;
+
+  CellPoints PointsByCell() const;
+
+  // Find the sorted IDs of the images and points that a worker reads to plan
+  // the given regions of a tile
+  void FindSubset(const Tile& tile,
+                  const std::vector<const PointRegion*>& regions,
+                  const CellPoints& cells,
+                  std::vector<uint32_t>* image_ids,
+                  std::vector<uint64_t>* point3d_ids) const;
+
+  static bool WriteSubset(const std::string& path,
+                          const std::vector<uint32_t>& image_ids,
+                          const std::vector<uint64_t>& point3d_ids);
+
+  // Start a worker for a tile. Returns its process ID, or -1.
+  int Spawn(const std::vector<std::string>& worker_args,
+            const Tile& tile,
+            const std::string& path,
+            const std::string& subset_path) const;
+
+  static bool WriteCameras(const std::string& path, const Planner& planner);
+
+  static bool ReadCameras(const std::string& path,
+                          const size_t tile_idx,
+                          std::vector<TileCamera>* cameras);
+
+  const Options options_;
+
+  Planner* planner_;
+
+  ColmapReader* reader_;
+
+  const Logger& logger_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_TILED_PLANNER_H_
@@ -24,14 +24,26 @@
 #include <exception>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <set>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
+#include "camera_models.h"
 #include "util/colmap.h"
+#include "util/hash.h"
+#include "util/memory.h"
+#include "util/trace.h"
 #include "util/types.h"
 
 namespace mercator {
 
 namespace {
 
+// Dense index of an image of a model index that is not kept by the filter
+const uint32_t kInvalidImageIdx = std::numeric_limits<uint32_t>::max();
+
 inline bool IsLittleEndian()
 {
 #ifdef BOOST_BIG_ENDIAN
@@ -67,11 +79,62 @@ T ReadBinary(std::istream* stream)
   return IsLittleEndian() ? data_little_endian : ReverseBytes(data_little_endian);
 }
 
+// Reads a file and hashes every byte as it is read, so that a model is
+// hashed while it is parsed instead of being read twice
+class HashingFileBuffer : public std::streambuf {
+ public:
+  HashingFileBuffer(const std::string& path, uint64_t* hash)
+    : buffer_(1 << 20), hash_(hash)
+  {
+    file_.open(path, std::ios::in | std::ios::binary);
+  }
+
+  bool IsOpen() const { return file_.is_open(); }
+
+  // Hash the rest of the file, which was not parsed
+  void Drain()
+  {
+    while (underflow() != traits_type::eof())
+    {
+      setg(egptr(), egptr(), egptr());
+    }
+  }
+
+ protected:
+  int_type underflow() override
+  {
+    if (gptr() < egptr())
+    {
+      return traits_type::to_int_type(*gptr());
+    }
+
+    const std::streamsize n = file_.sgetn(buffer_.data(), buffer_.size());
+    if (n <= 0)
+    {
+      return traits_type::eof();
+    }
+
+    *hash_ = HashBytes(buffer_.data(), n, *hash_);
+    setg(buffer_.data(), buffer_.data(), buffer_.data() + n);
+    return traits_type::to_int_type(*gptr());
+  }
+
+ private:
+  std::filebuf file_;
+  std::vector<char> buffer_;
+  uint64_t* hash_;
+};
+
 } // namespace
 
-ColmapReader::ColmapReader() {}
+ColmapReader::ColmapReader() : model_hash_(0), compute_uncertainty_(true) {}
 
 bool ColmapReader::Read(const std::string& path)
+{
+  return Read(path, PointCallback());
+}
+
+bool ColmapReader::Read(const std::string& path, const PointCallback& callback)
 {
   if (!points3d_.empty() || !cameras_.empty() || !images_.empty())
   {
@@ -81,18 +144,355 @@ bool ColmapReader::Read(const std::string& path)
     return false;
   }
 
-  return ReadCameras(path) && ReadImages(path) && ReadPoints(path);
-  
+  model_hash_ = kFnvOffsetBasis;
+  return ReadCameras(path) && ReadImages(path) && ReadPoints(path, callback);
+}
+
+bool ColmapReader::ReadIndex(const ModelIndex& index)
+{
+  ScopedTrace trace("read_index");
+
+  if (!points3d_.empty() || !cameras_.empty() || !images_.empty())
+  {
+    std::cerr << "ColmapReader instance is stale. Create a new instance to "
+              << "read new data."
+              << std::endl;
+    return false;
+  }
+
+  model_hash_ = index.ModelHash();
+
+  for (size_t i = 0; i < index.NumCameras(); ++i)
+  {
+    const ModelIndex::CameraRecord& record = index.Cameras()[i];
+    class Camera camera;
+    camera.SetCameraId(record.camera_id);
+    camera.SetWidth(record.width);
+    camera.SetHeight(record.height);
+    camera.SetParams(std::vector<double>(record.params, record.params + 4));
+    cameras_.emplace(camera.CameraId(), camera);
+  }
+
+  const size_t num_images = index.NumImages();
+  const size_t num_points = index.NumPoints();
+  const uint64_t* point3d_ids = index.PointIds();
+  const Observation* observations = index.TrackObservations();
+
+  // A filtered index is copied, with the images that are kept renumbered
+  const bool filtered = image_filter_ || point_filter_;
+  std::vector<uint32_t> image_ids(num_images);
+  std::vector<uint32_t> kept_image_idxs(num_images, kInvalidImageIdx);
+  for (size_t i = 0; i < num_images; ++i)
+  {
+    const ModelIndex::ImageRecord& record = index.Images()[i];
+    image_ids[i] = record.image_id;
+    if (image_filter_ && !image_filter_(record.image_id))
+    {
+      continue;
+    }
+
+    class Image image;
+    image.SetImageId(record.image_id);
+    image.SetCameraId(record.camera_id);
+    image.SetName(std::string(index.ImageNames() + record.name_offset,
+                              record.name_size));
+    image.SetRotation(Eigen::Quaterniond(record.rotation[0],
+                                         record.rotation[1],
+                                         record.rotation[2],
+                                         record.rotation[3]));
+    image.SetTranslation(Eigen::Vector3d(record.translation[0],
+                                         record.translation[1],
+                                         record.translation[2]));
+
+    const uint64_t begin = index.ImagePoint2dOffsets()[i];
+    const uint64_t end = index.ImagePoint2dOffsets()[i + 1];
+    image.Points2d().reserve(end - begin);
+    uint32_t num_points3d = 0;
+    for (uint64_t j = begin; j < end; ++j)
+    {
+      const ModelIndex::ImagePoint2d& image_point = index.ImagePoints2d()[j];
+      Point2d point2d(image_point.x, image_point.y);
+      point2d.SetPoint3dId(image_point.point3d_id);
+      num_points3d += point2d.HasPoint3d();
+      image.Points2d().push_back(point2d);
+    }
+    image.SetNumPoints3d(num_points3d);
+
+    if (filtered)
+    {
+      kept_image_idxs[i] = observations_.AddImage(image.ImageId());
+    }
+    poses_.AddPose(image);
+    images_.emplace(image.ImageId(), std::move(image));
+  }
+
+  // Points are stored in order of their IDs when the model was, in which
+  // case every insertion is at the end of the map
+  for (size_t i = 0; i < num_points; ++i)
+  {
+    if (point_filter_ && !point_filter_(point3d_ids[i]))
+    {
+      continue;
+    }
+
+    Point3d point;
+    point.SetPoint3dId(point3d_ids[i]);
+    point.SetCoords(Eigen::Map<const Eigen::Vector3d>(index.Coords() + 3 * i));
+    point.SetCovariance(
+        Eigen::Map<const Eigen::Matrix3d>(index.Covariances() + 9 * i),
+        index.Uncertainties()[i]);
+    point.SetColor(Eigen::Map<const Eigen::Vector3ub>(index.Colors() + 3 * i));
+
+    const uint64_t begin = index.TrackOffsets()[i];
+    const uint64_t end = index.TrackOffsets()[i + 1];
+    point.ImageIds().reserve(end - begin);
+    if (filtered)
+    {
+      observations_.AddPoint(point.Point3dId());
+    }
+    for (uint64_t j = begin; j < end; ++j)
+    {
+      const Observation& observation = observations[j];
+      if (filtered)
+      {
+        const uint32_t image_idx =
+          kept_image_idxs.at(observation.image_idx);
+        if (image_idx == kInvalidImageIdx)
+        {
+          continue;
+        }
+        observations_.AddObservation(
+            image_idx, observation.point2d_idx,
+            Eigen::Vector2d(observation.x, observation.y));
+      }
+      point.ImageIds().push_back(image_ids.at(observation.image_idx));
+    }
+
+    points3d_.emplace_hint(points3d_.end(), point.Point3dId(),
+                           std::move(point));
+  }
+
+  if (filtered)
+  {
+    return true;
+  }
+
+  // The tracks are used in place, so that processes that map the same index
+  // do not each hold a copy
+  observations_.Map(
+      std::move(image_ids),
+      std::vector<uint64_t>(point3d_ids, point3d_ids + num_points),
+      index.TrackOffsets(),
+      observations);
+
+  return true;
+}
+
+bool ColmapReader::ApplyDelta(const ModelDelta& delta,
+                              std::vector<uint64_t>* point3d_ids)
+{
+  ScopedTrace trace("apply_delta");
+
+  // Images as they will be after the update
+  std::map<uint32_t, const class Image*> images;
+  for (const auto& image : images_)
+  {
+    images.emplace(image.first, &image.second);
+  }
+  for (const auto& image : delta.images)
+  {
+    if (cameras_.count(image.CameraId()) == 0)
+    {
+      std::cerr << "Image " << image.ImageId() << " has unknown camera "
+                << image.CameraId() << std::endl;
+      return false;
+    }
+    images[image.ImageId()] = &image;
+  }
+
+  for (const auto& update : delta.points)
+  {
+    for (const auto& element : update.track)
+    {
+      const auto it = images.find(element.first);
+      if (it == images.end() ||
+          element.second >= it->second->Points2d().size())
+      {
+        std::cerr << "Point " << update.point.Point3dId()
+                  << " is observed by unknown 2D point " << element.second
+                  << " of image " << element.first << std::endl;
+        return false;
+      }
+    }
+  }
+
+  std::set<uint64_t> updated_ids;
+  for (const auto& update : delta.points)
+  {
+    updated_ids.insert(update.point.Point3dId());
+  }
+  for (const auto& update : delta.covariances)
+  {
+    if (points3d_.count(update.point3d_id) == 0 &&
+        updated_ids.count(update.point3d_id) == 0)
+    {
+      std::cerr << "Covariance of unknown point " << update.point3d_id
+                << std::endl;
+      return false;
+    }
+  }
+
+  // Images, and the coordinates of the observations in the images that
+  // existed before
+  std::unordered_map<uint32_t, const std::vector<Point2d>*> moved_points2d;
+  for (const auto& image : delta.images)
+  {
+    const auto it = images_.find(image.ImageId());
+    if (it == images_.end())
+    {
+      images_.emplace(image.ImageId(), image);
+      observations_.AddImage(image.ImageId());
+      poses_.AddPose(image);
+    }
+    else
+    {
+      it->second = image;
+      const uint32_t image_idx = observations_.ImageIdx(image.ImageId());
+      poses_.SetPose(image_idx, image);
+      moved_points2d.emplace(image_idx, &it->second.Points2d());
+    }
+  }
+  observations_.UpdateCoords(moved_points2d);
+
+  std::vector<std::pair<uint64_t, std::vector<Observation>>> tracks;
+  tracks.reserve(delta.points.size());
+  for (const auto& update : delta.points)
+  {
+    const uint64_t point3d_id = update.point.Point3dId();
+    Point3d point = update.point;
+
+    // Unmatch the 2D points of the previous track
+    const auto it = points3d_.find(point3d_id);
+    if (it != points3d_.end())
+    {
+      point.SetCovered(it->second.Covered());
+      for (const auto& observation : observations_.TrackForPoint(point3d_id))
+      {
+        class Image& image =
+          images_.at(observations_.ImageId(observation.image_idx));
+        if (observation.point2d_idx < image.NumPoints2d() &&
+            image.Points2d()[observation.point2d_idx].Point3dId() ==
+              point3d_id)
+        {
+          image.ResetPoint3dForPoint2d(observation.point2d_idx);
+        }
+      }
+    }
+    else
+    {
+      point.SetCovered(false);
+    }
+
+    std::vector<Observation> observations;
+    observations.reserve(update.track.size());
+    point.ImageIds().clear();
+    for (const auto& element : update.track)
+    {
+      class Image& image = images_.at(element.first);
+      image.SetPoint3dForPoint2d(element.second, point3d_id);
+      observations.push_back(
+          { observations_.ImageIdx(element.first), element.second,
+            image.Points2d()[element.second].X(),
+            image.Points2d()[element.second].Y() });
+      point.ImageIds().push_back(element.first);
+    }
+    tracks.emplace_back(point3d_id, std::move(observations));
+
+    if (compute_uncertainty_)
+    {
+      point.SetCovariance(point.Covariance());
+    }
+    else
+    {
+      point.SetUncertainty(-1.0);
+    }
+
+    points3d_[point3d_id] = point;
+  }
+  observations_.UpdateTracks(tracks);
+
+  for (const auto& update : delta.covariances)
+  {
+    Point3d& point = points3d_.at(update.point3d_id);
+    if (compute_uncertainty_)
+    {
+      point.SetCovariance(update.covariance);
+    }
+    else
+    {
+      point.SetCovariance(update.covariance, -1.0);
+    }
+    updated_ids.insert(update.point3d_id);
+  }
+
+  point3d_ids->insert(point3d_ids->end(), updated_ids.begin(),
+                      updated_ids.end());
 
   return true;
 }
 
+void ColmapReader::SetFilter(const ImageFilter& image_filter,
+                             const PointFilter& point_filter)
+{
+  image_filter_ = image_filter;
+  point_filter_ = point_filter;
+}
+
+void ColmapReader::SetComputeUncertainty(const bool compute_uncertainty)
+{
+  compute_uncertainty_ = compute_uncertainty;
+}
+
+uint64_t ColmapReader::ModelHash() const { return model_hash_; }
+
+std::map<std::string, size_t> ColmapReader::MemoryUsage() const
+{
+  std::map<std::string, size_t> usage;
+
+  usage["cameras"] = MapBytes(cameras_);
+  for (const auto& camera : cameras_)
+  {
+    usage["cameras"] += camera.second.Params().size() * sizeof(double);
+  }
+
+  usage["images"] = MapBytes(images_);
+  for (const auto& image : images_)
+  {
+    usage["images"] += VectorBytes(image.second.Points2d())
+      + image.second.Name().capacity();
+  }
+
+  usage["points"] = MapBytes(points3d_);
+  for (const auto& point : points3d_)
+  {
+    usage["points"] += VectorBytes(point.second.ImageIds());
+  }
+
+  usage["observations"] = observations_.MemoryUsage();
+  usage["poses"] = poses_.MemoryUsage();
+
+  return usage;
+}
+
 bool ColmapReader::ReadCameras(const std::string& path)
 {
+  ScopedTrace trace("read_cameras");
+
   const std::string cameras_path = path + "/cameras.bin";
-  std::ifstream cameras_file(cameras_path, std::ios::binary);
+  HashingFileBuffer cameras_buffer(cameras_path, &model_hash_);
+  std::istream cameras_file(&cameras_buffer);
 
-  if (!cameras_file.is_open())
+  if (!cameras_buffer.IsOpen())
   {
     std::cerr << "Couldn't open file " << cameras_path << std::endl;
     return false;
@@ -106,14 +506,33 @@ bool ColmapReader::ReadCameras(const std::string& path)
     {
       class Camera camera;
       camera.SetCameraId(ReadBinary<uint32_t>(&cameras_file));
-      ReadBinary<int>(&cameras_file); // model_id
+      const auto model_id = ReadBinary<int>(&cameras_file);
       camera.SetWidth(ReadBinary<uint64_t>(&cameras_file));
       camera.SetHeight(ReadBinary<uint64_t>(&cameras_file));
 
-      for (size_t j = 0; j < camera.Params().size(); j++)
+      // The number of parameters depends on the camera model
+      const CameraModel* model = FindCameraModel(model_id);
+      if (model == nullptr)
+      {
+        std::cerr << "Unknown camera model " << model_id << " of camera "
+                  << camera.CameraId() << std::endl;
+        return false;
+      }
+
+      std::vector<double> params(model->num_params);
+      for (size_t j = 0; j < params.size(); j++)
       {
-        camera.Params()[j] = ReadBinary<double>(&cameras_file);
+        params[j] = ReadBinary<double>(&cameras_file);
       }
+
+      if (!model->exact)
+      {
+        std::cerr << "Camera " << camera.CameraId() << " uses the "
+                  << model->name << " model, which is approximated by "
+                  << "SIMPLE_RADIAL" << std::endl;
+      }
+      camera.Params() = ToSimpleRadialParams(*model, params);
+
       cameras_.emplace(camera.CameraId(), camera);
     }
   }
@@ -124,11 +543,14 @@ bool ColmapReader::ReadCameras(const std::string& path)
     return false;
   }
 
+  cameras_buffer.Drain();
   return true;
 }
 
 bool ColmapReader::ReadImages(const std::string& path)
 {
+  ScopedTrace trace("read_images");
+
   if (cameras_.empty())
   {
     std::cerr << "Cameras must be read before images." << std::endl;
@@ -136,9 +558,10 @@ bool ColmapReader::ReadImages(const std::string& path)
   }
 
   const std::string images_path = path + "/images.bin";
-  std::ifstream images_file(images_path, std::ios::binary);
+  HashingFileBuffer images_buffer(images_path, &model_hash_);
+  std::istream images_file(&images_buffer);
 
-  if (!images_file.is_open())
+  if (!images_buffer.IsOpen())
   {
     std::cerr << "Could not open file " << images_path << std::endl;
     return false;
@@ -153,15 +576,19 @@ bool ColmapReader::ReadImages(const std::string& path)
       class Image image;
       image.SetImageId(ReadBinary<uint32_t>(&images_file));
 
-      image.Rotation().w() = ReadBinary<double>(&images_file);
-      image.Rotation().x() = ReadBinary<double>(&images_file);
-      image.Rotation().y() = ReadBinary<double>(&images_file);
-      image.Rotation().z() = ReadBinary<double>(&images_file);
-      image.Rotation().normalize();
+      Eigen::Quaterniond rotation;
+      rotation.w() = ReadBinary<double>(&images_file);
+      rotation.x() = ReadBinary<double>(&images_file);
+      rotation.y() = ReadBinary<double>(&images_file);
+      rotation.z() = ReadBinary<double>(&images_file);
+      rotation.normalize();
+      image.SetRotation(rotation);
 
-      image.Translation()(0) = ReadBinary<double>(&images_file);
-      image.Translation()(1) = ReadBinary<double>(&images_file);
-      image.Translation()(2) = ReadBinary<double>(&images_file);
+      Eigen::Vector3d translation;
+      translation(0) = ReadBinary<double>(&images_file);
+      translation(1) = ReadBinary<double>(&images_file);
+      translation(2) = ReadBinary<double>(&images_file);
+      image.SetTranslation(translation);
 
       image.SetCameraId(ReadBinary<uint32_t>(&images_file));
 
@@ -199,9 +626,17 @@ bool ColmapReader::ReadImages(const std::string& path)
         }
       }
 
+      if (image_filter_ && !image_filter_(image.ImageId()))
+      {
+        continue;
+      }
+
       images_.emplace(image.ImageId(), image);
+      observations_.AddImage(image.ImageId());
+      poses_.AddPose(image);
     }
 
+    images_buffer.Drain();
     return true;
   }
   catch (std::exception& e)
@@ -212,7 +647,8 @@ bool ColmapReader::ReadImages(const std::string& path)
   }
 }
 
-bool ColmapReader::ReadPoints(const std::string& path)
+bool ColmapReader::ReadPoints(const std::string& path,
+                              const PointCallback& callback)
 {
   if (images_.empty())
   {
@@ -221,14 +657,27 @@ bool ColmapReader::ReadPoints(const std::string& path)
   }
 
   const std::string points3d_path = path + "/points3D.bin";
-  std::ifstream points3d_file(points3d_path, std::ios::binary);
+  HashingFileBuffer points3d_buffer(points3d_path, &model_hash_);
+  std::istream points3d_file(&points3d_buffer);
 
-  if (!points3d_file.is_open())
+  if (!points3d_buffer.IsOpen())
   {
     std::cerr << "Could not open file " << points3d_path << std::endl;
     return false;
   }
 
+  // Images in the order of their dense index in the observation store
+  std::vector<const class Image*> images;
+  images.reserve(observations_.NumImages());
+  for (size_t image_idx = 0; image_idx < observations_.NumImages(); ++image_idx)
+  {
+    images.push_back(&images_.at(observations_.ImageId(image_idx)));
+  }
+
+  // Points are traced in chunks, as a single point is too short to show
+  const size_t trace_chunk_size = 4096;
+  uint64_t chunk_start_ns = Tracer::IsEnabled() ? Tracer::Instance().Now() : 0;
+
   // Read points
   const auto num_points = ReadBinary<uint64_t>(&points3d_file);
   try
@@ -257,18 +706,56 @@ bool ColmapReader::ReadPoints(const std::string& path)
         covariance(j) = ReadBinary<double>(&points3d_file);
       }
 
-      point.SetCovariance(covariance);
+      // A point that is not kept is still parsed up to the next one
+      const bool keep = !point_filter_ || point_filter_(point.Point3dId());
+      if (keep && compute_uncertainty_)
+      {
+        point.SetCovariance(covariance);
+      }
+      else if (keep)
+      {
+        point.SetCovariance(covariance, -1.0);
+      }
 
       // Next are the tracks
+      if (keep)
+      {
+        observations_.AddPoint(point.Point3dId());
+      }
       const auto track_length = ReadBinary<uint64_t>(&points3d_file);
+      point.ImageIds().reserve(keep ? track_length : 0);
       for (size_t j = 0; j < track_length; j++)
       {
         const auto image_id = ReadBinary<uint32_t>(&points3d_file);
+        const auto point2d_idx = ReadBinary<uint32_t>(&points3d_file);
+        if (!keep || (image_filter_ && !observations_.HasImage(image_id)))
+        {
+          continue;
+        }
         point.ImageIds().push_back(image_id);
-        ReadBinary<uint32_t>(&points3d_file); // point2d_idx
+
+        const uint32_t image_idx = observations_.ImageIdx(image_id);
+        const Point2d& point2d = images[image_idx]->Points2d().at(point2d_idx);
+        observations_.AddObservation(image_idx, point2d_idx, point2d.Coords());
       }
 
-      points3d_.emplace(point.Point3dId(), point);
+      if (keep)
+      {
+        auto it = points3d_.emplace(point.Point3dId(), point).first;
+        if (callback)
+        {
+          callback(&it->second);
+        }
+      }
+
+      if (Tracer::IsEnabled() &&
+          ((i + 1) % trace_chunk_size == 0 || i + 1 == num_points))
+      {
+        Tracer& tracer = Tracer::Instance();
+        const uint64_t now_ns = tracer.Now();
+        tracer.Complete("read_points_chunk", chunk_start_ns, now_ns);
+        chunk_start_ns = now_ns;
+      }
     }
   }
   catch (std::exception& e)
@@ -278,6 +765,7 @@ bool ColmapReader::ReadPoints(const std::string& path)
     return false;
   }
 
+  points3d_buffer.Drain();
   return true;
 }
 
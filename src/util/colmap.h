@@ -23,20 +23,63 @@
 #ifndef MERCATOR_COLMAP_H_
 #define MERCATOR_COLMAP_H_
 
+#include <functional>
 #include <map>
 #include <string>
 
 #include "camera.h"
 #include "image.h"
+#include "model_delta.h"
+#include "model_index.h"
+#include "observation_store.h"
 #include "point3d.h"
+#include "pose_table.h"
 
 namespace mercator {
 
 class ColmapReader {
  public:
+  // Called with every point as soon as it has been read. The points read
+  // before are not modified while the rest of the file is decoded.
+  typedef std::function<void(Point3d*)> PointCallback;
+
+  // Decide from its ID whether an image or a point is kept while reading
+  typedef std::function<bool(uint32_t)> ImageFilter;
+  typedef std::function<bool(uint64_t)> PointFilter;
+
   ColmapReader();
 
   bool Read(const std::string& path);
+  bool Read(const std::string& path, const PointCallback& callback);
+
+  // Load a reconstruction from a model index instead of the COLMAP files.
+  // The tracks are used in place, so the index must stay open as long as the
+  // reader.
+  bool ReadIndex(const ModelIndex& index);
+
+  // Apply changes to the loaded reconstruction, keeping the observation
+  // store, the pose table and the 2D-3D matches of the images up to date.
+  // The IDs of the points that were added or changed are appended to
+  // point3d_ids. Returns false without changing anything if the delta refers
+  // to cameras, images or 2D points that do not exist.
+  bool ApplyDelta(const ModelDelta& delta, std::vector<uint64_t>* point3d_ids);
+
+  // Only keep the images and points accepted by the filters, either of which
+  // may be empty to keep everything. The observations in images that are not
+  // kept are dropped from the tracks of the points. Set before reading; the
+  // tracks of a filtered model index are copied instead of used in place.
+  void SetFilter(const ImageFilter& image_filter,
+                 const PointFilter& point_filter);
+
+  // Whether to compute the uncertainty of each point while reading, which is
+  // the default. Otherwise it is left to the first call of the non-const
+  // Point3d::Uncertainty(), so that it can be restored from a cache instead.
+  void SetComputeUncertainty(const bool compute_uncertainty);
+
+  // Content hash of the cameras, images and points files of the model that
+  // was read, computed while they are parsed, or the hash stored in the
+  // model index
+  uint64_t ModelHash() const;
 
   inline const std::map<uint32_t, class Camera>& Cameras() const;
   inline std::map<uint32_t, class Camera>& Cameras();
@@ -50,16 +93,38 @@ class ColmapReader {
   inline std::map<uint64_t, Point3d>& Points();
   inline Point3d& Point(const uint64_t point3d_id);
 
+  inline const ObservationStore& Observations() const;
+
+  inline const PoseTable& Poses() const;
+
+  // Estimated heap bytes of each container of the reconstruction, including
+  // the memory owned by the elements
+  std::map<std::string, size_t> MemoryUsage() const;
+
  private:
   bool ReadCameras(const std::string& path);
   bool ReadImages(const std::string& path);
-  bool ReadPoints(const std::string& path);
+  bool ReadPoints(const std::string& path, const PointCallback& callback);
 
   std::map<uint32_t, class Camera> cameras_;
 
   std::map<uint32_t, class Image> images_;
 
   std::map<uint64_t, Point3d> points3d_;
+
+  // Tracks of every point, including the index of each observation in the
+  // list of 2D points of its image
+  ObservationStore observations_;
+
+  // Poses of every image, indexed like the images of the observation store
+  PoseTable poses_;
+
+  uint64_t model_hash_;
+
+  bool compute_uncertainty_;
+
+  ImageFilter image_filter_;
+  PointFilter point_filter_;
 };
 
 const std::map<uint32_t, class Camera>& ColmapReader::Cameras() const { return cameras_; }
@@ -89,6 +154,13 @@ Point3d& ColmapReader::Point(const uint64_t point3d_id)
   return points3d_.at(point3d_id);
 }
 
+const ObservationStore& ColmapReader::Observations() const
+{
+  return observations_;
+}
+
+const PoseTable& ColmapReader::Poses() const { return poses_; }
+
 } // namespace mercator
 
 #endif // MERCATOR_COLMAP_H_
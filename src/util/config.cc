@@ -21,6 +21,7 @@
 // Author: Greg Anders
 
 #include <fstream>
+#include <iostream>
 #include <sstream>
 
 #include "util/config.h"
@@ -29,7 +30,46 @@ namespace mercator {
 
 namespace po = boost::program_options;
 
+namespace {
+
+// Parse comma-separated values. An empty string is an empty list.
+template<typename T>
+bool ParseList(const std::string& str, std::vector<T>* values)
+{
+  values->clear();
+  if (str.empty())
+  {
+    return true;
+  }
+
+  std::istringstream ss(str);
+  std::string item;
+  while (std::getline(ss, item, ','))
+  {
+    std::istringstream item_ss(item);
+    T value;
+    if (!(item_ss >> value) || !(item_ss >> std::ws).eof())
+    {
+      return false;
+    }
+    values->push_back(value);
+  }
+
+  return !values->empty() && str.back() != ',';
+}
+
+} // namespace
+
 ConfigManager::ConfigManager()
+  : cli_desc_("Usage: mercator [options] <path>\n"
+              "       mercator index [--output <file>] <path>\n"
+              "       mercator serve [--socket <file>] <path>\n"
+              "       mercator batch [--threads <n>] <list>\n"
+              "       mercator sweep [--sweep-uncertainty <a,b,...>] <path>\n"
+              "       mercator redundancy [--ranking <file>] <path>\n"
+              "<path> is a COLMAP model directory or, to plan or serve, a model index\n"
+              "<list> is a file with one COLMAP model directory per line\n"
+              "Options")
 {
   desc_.add_options()("uncertainty_threshold",
                      po::value<double>(&uncertainty_threshold)->required(),
@@ -48,7 +88,119 @@ ConfigManager::ConfigManager()
                      "Print a summary of the bundle adjustment (0, 1, or 2)")
                      ("log_level",
                      po::value<int>(&log_level)->default_value(2),
-                     "Log level (0, 1, 2, 3)");
+                     "Log level (0, 1, 2, 3)")
+                     ("region_voxel_size",
+                     po::value<double>(&region_voxel_size)->default_value(1.0),
+                     "Voxel size used to group uncovered points into regions "
+                     "(0 = one region per point)")
+                     ("max_candidates_per_region",
+                     po::value<int>(&max_candidates_per_region)
+                       ->default_value(4),
+                     "Number of candidate cameras tried for each region")
+                     ("candidate_angle_step",
+                     po::value<double>(&candidate_angle_step)
+                       ->default_value(0.26),
+                     "Angle (in radians) between successive candidate "
+                     "cameras of a region")
+                     ("lod_levels",
+                     po::value<int>(&lod_levels)->default_value(0),
+                     "Number of levels of the point hierarchy (0 = disabled)")
+                     ("lod_voxel_size",
+                     po::value<double>(&lod_voxel_size)->default_value(0.5),
+                     "Voxel size of the finest level of the point hierarchy");
+
+  cli_desc_.add_options()("help,h", "Print this message")
+                         ("config",
+                         po::value<std::string>(&config_path)
+                           ->default_value("config.ini"),
+                         "Configuration file")
+                         ("time-budget",
+                         po::value<double>(&time_budget)->default_value(0.0),
+                         "Stop planning after this many seconds and keep the "
+                         "best cameras found so far (0 = no limit)")
+                         ("report",
+                         po::value<std::string>(&report_path),
+                         "Write timings and counters of the run as JSON to "
+                         "this file")
+                         ("trace",
+                         po::value<std::string>(&trace_path),
+                         "Write a Chrome trace of the run to this file")
+                         ("capture",
+                         po::value<std::string>(&capture_path),
+                         "Write the inputs of every bundle adjustment to this "
+                         "corpus file for mercator_replay")
+                         ("cache",
+                         po::value<std::string>(&cache_dir),
+                         "Directory of the result cache. Points and regions "
+                         "unchanged since a previous run with the same "
+                         "configuration are not planned again")
+                         ("output",
+                         po::value<std::string>(&index_path),
+                         "File written by mercator index (default: "
+                         "<path>/model.mercidx)")
+                         ("ranking",
+                         po::value<std::string>(&ranking_path),
+                         "CSV file the image ranking of mercator redundancy "
+                         "is written to")
+                         ("pixel-sigma",
+                         po::value<double>(&pixel_sigma)->default_value(1.0),
+                         "Standard deviation of the image observations, in "
+                         "pixels, assumed by mercator redundancy")
+                         ("socket",
+                         po::value<std::string>(&socket_path)
+                           ->default_value("mercator.sock"),
+                         "Unix domain socket of mercator serve")
+                         ("pipeline",
+                         po::bool_switch(&pipeline),
+                         "Overlap loading, classification and bundle "
+                         "adjustment in a pipeline of threads")
+                         ("tiles",
+                         po::value<double>(&tile_size)->default_value(0.0),
+                         "Split the scene into square tiles of this edge "
+                         "length and plan each in a worker process "
+                         "(0 = disabled)")
+                         ("workers",
+                         po::value<int>(&num_workers)->default_value(0),
+                         "Number of worker processes planning tiles at once "
+                         "(0 = one per hardware thread)")
+                         ("threads",
+                         po::value<int>(&num_threads)->default_value(0),
+                         "Threads shared by the models of mercator batch, or "
+                         "analyzing images in mercator redundancy "
+                         "(0 = one per hardware thread)")
+                         ("memory-limit",
+                         po::value<double>(&memory_limit)->default_value(0.0),
+                         "Megabytes above which mercator batch skips a model, "
+                         "by the size of its files and of the model once read; "
+                         "planning itself is not limited (0 = no limit)")
+                         ("sweep-uncertainty",
+                         po::value<std::string>(&sweep_uncertainty_),
+                         "Comma-separated values of uncertainty_threshold "
+                         "for mercator sweep")
+                         ("sweep-min-cameras",
+                         po::value<std::string>(&sweep_min_cameras_),
+                         "Comma-separated values of min_cameras for "
+                         "mercator sweep")
+                         ("sweep-gsd",
+                         po::value<std::string>(&sweep_gsd_),
+                         "Comma-separated values of "
+                         "min_ground_sampling_distance for mercator sweep");
+
+  cli_hidden_desc_.add_options()("args",
+                                po::value<std::vector<std::string>>(
+                                  &positional_args_),
+                                "Command and path to the reconstruction")
+                                ("tile",
+                                po::value<std::string>(&tile),
+                                "Tile planned by a worker process")
+                                ("tile-output",
+                                po::value<std::string>(&tile_output),
+                                "File the worker writes its cameras to")
+                                ("tile-input",
+                                po::value<std::string>(&tile_input),
+                                "File of the images and points the worker "
+                                "reads");
+  cli_positional_.add("args", 2);
 }
 
 bool ConfigManager::ReadConfigFile(const std::string& path)
@@ -65,6 +217,79 @@ bool ConfigManager::ReadConfigFile(const std::string& path)
   return true;
 }
 
+bool ConfigManager::ReadCommandLine(int argc, char* argv[])
+{
+  po::options_description all;
+  all.add(cli_desc_).add(cli_hidden_desc_);
+
+  po::variables_map vmap;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv)
+        .options(all)
+        .positional(cli_positional_)
+        .run(), vmap);
+    po::notify(vmap);
+  }
+  catch (po::error& e)
+  {
+    std::cerr << e.what() << "\n" << cli_desc_ << std::endl;
+    return false;
+  }
+
+  std::vector<std::string> args = positional_args_;
+  if (!args.empty() &&
+      (args[0] == "index" || args[0] == "serve" || args[0] == "batch" ||
+       args[0] == "sweep" || args[0] == "redundancy"))
+  {
+    command = args[0];
+    args.erase(args.begin());
+  }
+  if (!args.empty())
+  {
+    model_path = args.back();
+  }
+
+  if (command == "index" && index_path.empty() && !model_path.empty())
+  {
+    index_path = model_path + "/model.mercidx";
+  }
+
+  // Every command reads one model, model index or list of models
+  bool valid = args.size() == 1;
+
+  // Only planning is split into tiles, and a worker must be given its tile,
+  // its output and its input
+  if ((!command.empty() && (tile_size > 0 || !tile.empty())) ||
+      tile.empty() != tile_output.empty() ||
+      tile.empty() != tile_input.empty())
+  {
+    valid = false;
+  }
+
+  if (!ParseList(sweep_uncertainty_, &sweep_uncertainty_thresholds) ||
+      !ParseList(sweep_min_cameras_, &sweep_min_cameras) ||
+      !ParseList(sweep_gsd_, &sweep_min_ground_sampling_distances))
+  {
+    std::cerr << "Invalid list of sweep values" << std::endl;
+    valid = false;
+  }
+
+  if (!(pixel_sigma > 0))
+  {
+    std::cerr << "The pixel noise must be positive" << std::endl;
+    valid = false;
+  }
+
+  if (vmap.count("help") || !valid)
+  {
+    std::cerr << cli_desc_ << std::endl;
+    return false;
+  }
+
+  return true;
+}
+
 const std::string ConfigManager::PrintOptions() const
 {
   std::ostringstream ss;
@@ -73,7 +298,12 @@ const std::string ConfigManager::PrintOptions() const
     << "min_cameras = " << min_cameras << "\n"
     << "camera_pixel_size = " << camera_pixel_size << "\n"
     << "min_ground_sampling_distance = " << min_ground_sampling_distance << "\n"
-    << "print_ba_summary = " << print_ba_summary << "\n";
+    << "print_ba_summary = " << print_ba_summary << "\n"
+    << "region_voxel_size = " << region_voxel_size << "\n"
+    << "max_candidates_per_region = " << max_candidates_per_region << "\n"
+    << "candidate_angle_step = " << candidate_angle_step << "\n"
+    << "lod_levels = " << lod_levels << "\n"
+    << "lod_voxel_size = " << lod_voxel_size << "\n";
   return ss.str();
 }
 
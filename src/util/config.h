@@ -25,6 +25,7 @@
 
 #include <boost/program_options.hpp>
 #include <string>
+#include <vector>
 
 namespace mercator {
 
@@ -34,6 +35,10 @@ class ConfigManager {
 
   bool ReadConfigFile(const std::string&);
 
+  // Parse the command line arguments. Returns false and prints the usage if
+  // the arguments are invalid or help was requested.
+  bool ReadCommandLine(int argc, char* argv[]);
+
   const std::string PrintOptions() const;
 
   double uncertainty_threshold;
@@ -42,11 +47,70 @@ class ConfigManager {
   uint64_t min_cameras;
   int print_ba_summary;
   int log_level;
+  double region_voxel_size;
+  int max_candidates_per_region;
+  double candidate_angle_step;
+  int lod_levels;
+  double lod_voxel_size;
+
+  // Command line options. The command is empty to plan, "index" to write
+  // the model index of model_path to index_path, "serve" to answer planning
+  // requests on socket_path, "batch" to plan every model listed in the
+  // file model_path, "sweep" to plan with every combination of the sweep
+  // values or "redundancy" to rank the images by what removing them would
+  // lose, writing the ranking to ranking_path if it is set.
+  std::string command;
+  std::string config_path;
+  std::string model_path;
+  std::string index_path;
+  std::string socket_path;
+  double time_budget;
+  bool pipeline;
+  std::string report_path;
+  std::string trace_path;
+  std::string capture_path;
+  std::string cache_dir;
+
+  // Image ranking: the CSV file it is written to and the standard deviation
+  // of the image observations, in pixels
+  std::string ranking_path;
+  double pixel_sigma;
+
+  // Tiled planning: the scene is split into tiles of tile_size planned by up
+  // to num_workers processes. A worker plans the tile given by tile, reading
+  // only the images and points listed in tile_input, and writes its cameras
+  // to tile_output.
+  double tile_size;
+  int num_workers;
+  std::string tile;
+  std::string tile_output;
+  std::string tile_input;
+
+  // Batch planning: threads shared by all models and the size, in megabytes,
+  // above which a model is skipped
+  int num_threads;
+  double memory_limit;
+
+  // Values of the thresholds swept by mercator sweep. Empty lists take the
+  // value of the configuration file.
+  std::vector<double> sweep_uncertainty_thresholds;
+  std::vector<uint64_t> sweep_min_cameras;
+  std::vector<double> sweep_min_ground_sampling_distances;
 
  private:
   boost::program_options::options_description desc_;
   boost::program_options::variables_map vmap_;
 
+  boost::program_options::options_description cli_desc_;
+  boost::program_options::options_description cli_hidden_desc_;
+  boost::program_options::positional_options_description cli_positional_;
+
+  std::vector<std::string> positional_args_;
+
+  std::string sweep_uncertainty_;
+  std::string sweep_min_cameras_;
+  std::string sweep_gsd_;
+
 };
 
 } // namespace mercator
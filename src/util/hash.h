@@ -0,0 +1,63 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_UTIL_HASH_H_
+#define MERCATOR_UTIL_HASH_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace mercator {
+
+// 64-bit FNV-1a hash. Hashes can be chained by passing the previous hash as
+// the seed.
+const uint64_t kFnvOffsetBasis = 0xcbf29ce484222325ULL;
+const uint64_t kFnvPrime = 0x100000001b3ULL;
+
+inline uint64_t HashBytes(const void* data,
+                          const size_t size,
+                          uint64_t hash = kFnvOffsetBasis)
+{
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for (size_t i = 0; i < size; ++i)
+  {
+    hash = (hash ^ bytes[i]) * kFnvPrime;
+  }
+  return hash;
+}
+
+template<typename T>
+uint64_t HashValue(const T& value, const uint64_t hash = kFnvOffsetBasis)
+{
+  return HashBytes(&value, sizeof(T), hash);
+}
+
+// Hash the contents of a file. Returns false if it could not be read.
+bool HashFile(const std::string& path, uint64_t* hash);
+
+// Fixed width hexadecimal representation, e.g. for file names
+std::string HashToString(const uint64_t hash);
+
+} // namespace mercator
+
+#endif // MERCATOR_UTIL_HASH_H_
@@ -0,0 +1,71 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <cmath>
+#include <iomanip>
+
+#include "json.h"
+
+namespace mercator {
+
+void WriteJsonString(std::ostream& os, const std::string& s)
+{
+  os << '"';
+  for (const char c : s)
+  {
+    switch (c)
+    {
+      case '"': os << "\\\""; break;
+      case '\\': os << "\\\\"; break;
+      case '\n': os << "\\n"; break;
+      case '\r': os << "\\r"; break;
+      case '\t': os << "\\t"; break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+          const char fill = os.fill('0');
+          os << "\\u" << std::hex << std::setw(4)
+             << static_cast<int>(c) << std::dec;
+          os.fill(fill);
+        }
+        else
+        {
+          os << c;
+        }
+    }
+  }
+  os << '"';
+}
+
+void WriteJsonNumber(std::ostream& os, const double value)
+{
+  if (std::isfinite(value))
+  {
+    os << value;
+  }
+  else
+  {
+    os << "null";
+  }
+}
+
+} // namespace mercator
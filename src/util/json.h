@@ -0,0 +1,41 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_UTIL_JSON_H_
+#define MERCATOR_UTIL_JSON_H_
+
+#include <ostream>
+#include <string>
+
+namespace mercator {
+
+// Write a string as a JSON string literal. Quotes and backslashes are
+// escaped, and control characters are written as \u00XX.
+void WriteJsonString(std::ostream& os, const std::string& s);
+
+// Write a number as JSON. NaN and infinity, which JSON cannot represent, are
+// written as null.
+void WriteJsonNumber(std::ostream& os, const double value);
+
+} // namespace mercator
+
+#endif // MERCATOR_UTIL_JSON_H_
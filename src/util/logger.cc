@@ -24,104 +24,281 @@
 
 namespace mercator {
 
+namespace {
+
+// Number of lines a thread can queue before it waits for the writer
+const size_t kQueueCapacity = 1024;
+
+std::atomic<uint64_t> next_logger_id(1);
+
+} // namespace
+
 Logger::Logger(const LogLevel level)
-  : os_(std::cout), level_(level) {}
+  : Logger(std::cout, level) {}
 
 Logger::Logger(std::ostream& os, const LogLevel level)
-  : os_(os), level_(level) {}
+  : level_(level),
+    os_(os),
+    id_(next_logger_id++),
+    writer_waiting_(false),
+    stop_(false)
+{
+  writer_ = std::thread(&Logger::WriterLoop, this);
+}
+
+Logger::~Logger()
+{
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    stop_ = true;
+  }
+  wake_.notify_one();
+  writer_.join();
+
+  Flush();
+}
 
 void Logger::SetLogLevel(const Logger::LogLevel level) { level_ = level; }
 
-std::ostream& Logger::Log() const
+LogMessage Logger::Log() const
 {
-  os_ << "LOG: ";
-  return os_;
+  return LogMessage(this, "LOG: ", false);
 }
 
-std::ostream& Logger::Log(const std::string& msg) const
+void Logger::Log(const std::string& msg) const
 {
-  os_ << "LOG: " << msg << std::endl;
-  return os_;
+  Log() << msg;
 }
 
-std::ostream& Logger::Debug() const
+LogMessage Logger::Debug() const
 {
-  if (level_ <= Logger::LogLevel::DEBUG)
-  {
-    os_ << "DEBUG: ";
-    return os_;
-  }
-  return null_;
+  return LogMessage(IsEnabled(LogLevel::DEBUG) ? this : nullptr, "DEBUG: ",
+                    false);
 }
 
-std::ostream& Logger::Debug(const std::string& msg) const
+void Logger::Debug(const std::string& msg) const
 {
-  if (level_ <= Logger::LogLevel::DEBUG)
-  {
-    os_ << "DEBUG: " << msg << std::endl;
-    return os_;
-  }
-  return null_;
+  Debug() << msg;
+}
+
+LogMessage Logger::Info() const
+{
+  return LogMessage(IsEnabled(LogLevel::INFO) ? this : nullptr, "INFO: ",
+                    false);
+}
+
+void Logger::Info(const std::string& msg) const
+{
+  Info() << msg;
+}
+
+LogMessage Logger::Warn() const
+{
+  return LogMessage(IsEnabled(LogLevel::WARN) ? this : nullptr, "WARNING: ",
+                    false);
+}
+
+void Logger::Warn(const std::string& msg) const
+{
+  Warn() << msg;
+}
+
+LogMessage Logger::Error() const
+{
+  return LogMessage(IsEnabled(LogLevel::ERROR) ? this : nullptr, "ERROR: ",
+                    true);
+}
+
+void Logger::Error(const std::string& msg) const
+{
+  Error() << msg;
 }
 
-std::ostream& Logger::Info() const
+void Logger::Flush() const
 {
-  if (level_ <= Logger::LogLevel::INFO)
+  Drain();
+
+  std::lock_guard<std::mutex> lock(drain_mutex_);
+  os_.flush();
+}
+
+void Logger::Submit(std::string&& line, const bool flush) const
+{
+  LocalQueue()->Push(std::move(line));
+
+  if (flush)
   {
-    os_ << "INFO: ";
-    return os_;
+    Flush();
+    return;
+  }
+
+  // The line is queued before the flag is read, and the writer raises the
+  // flag before it checks the queues, so one of the two sees the other
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (writer_waiting_.load(std::memory_order_relaxed))
+  {
+    std::lock_guard<std::mutex> lock(wake_mutex_);
+    writer_waiting_.store(false, std::memory_order_relaxed);
+    wake_.notify_one();
   }
-  return null_;
 }
 
-std::ostream& Logger::Info(const std::string& msg) const
+Logger::Queue* Logger::LocalQueue() const
 {
-  if (level_ <= Logger::LogLevel::INFO)
+  // Cache of the queue of the logger this thread used last
+  thread_local uint64_t cached_id = 0;
+  thread_local Queue* cached_queue = nullptr;
+
+  if (cached_id != id_)
   {
-    os_ << "INFO: " << msg << std::endl;
-    return os_;
+    std::lock_guard<std::mutex> lock(queues_mutex_);
+
+    const auto thread_id = std::this_thread::get_id();
+    cached_queue = nullptr;
+    for (size_t i = 0; i < queue_threads_.size(); ++i)
+    {
+      if (queue_threads_[i] == thread_id)
+      {
+        cached_queue = queues_[i].get();
+        break;
+      }
+    }
+
+    if (cached_queue == nullptr)
+    {
+      queues_.emplace_back(new Queue(kQueueCapacity));
+      queue_threads_.push_back(thread_id);
+      cached_queue = queues_.back().get();
+    }
+
+    cached_id = id_;
   }
-  return null_;
+
+  return cached_queue;
 }
 
-std::ostream& Logger::Warn() const
+bool Logger::Drain() const
 {
-  if (level_ <= Logger::LogLevel::WARN)
+  std::lock_guard<std::mutex> drain_lock(drain_mutex_);
+
+  std::vector<Queue*> queues;
+  {
+    std::lock_guard<std::mutex> lock(queues_mutex_);
+    for (const auto& queue : queues_)
+    {
+      queues.push_back(queue.get());
+    }
+  }
+
+  bool wrote = false;
+  std::string line;
+  for (const auto queue : queues)
   {
-    os_ << "WARNING: ";
-    return os_;
+    while (queue->TryPop(&line))
+    {
+      os_ << line;
+      wrote = true;
+    }
   }
-  return null_;
+
+  return wrote;
 }
 
-std::ostream& Logger::Warn(const std::string& msg) const
+bool Logger::Pending() const
 {
-  if (level_ <= Logger::LogLevel::WARN)
+  std::lock_guard<std::mutex> lock(queues_mutex_);
+  for (const auto& queue : queues_)
   {
-    os_ << "WARNING: " << msg << std::endl;
-    return os_;
+    if (!queue->Empty())
+    {
+      return true;
+    }
   }
-  return null_;
+
+  return false;
 }
 
-std::ostream& Logger::Error() const
+void Logger::WriterLoop()
 {
-  if (level_ <= Logger::LogLevel::ERROR)
+  bool dirty = false;
+
+  std::unique_lock<std::mutex> lock(wake_mutex_);
+  while (!stop_)
   {
-    os_ << "ERROR: ";
-    return os_;
+    lock.unlock();
+    const bool wrote = Drain();
+    lock.lock();
+
+    if (wrote)
+    {
+      dirty = true;
+      continue;
+    }
+
+    // Flush once the queues run empty, then wait for more
+    if (dirty)
+    {
+      lock.unlock();
+      {
+        std::lock_guard<std::mutex> drain_lock(drain_mutex_);
+        os_.flush();
+      }
+      lock.lock();
+      dirty = false;
+    }
+
+    writer_waiting_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (Pending())
+    {
+      writer_waiting_.store(false, std::memory_order_relaxed);
+      continue;
+    }
+
+    wake_.wait(lock, [this]
+               {
+                 return stop_ ||
+                   !writer_waiting_.load(std::memory_order_relaxed);
+               });
+    writer_waiting_.store(false, std::memory_order_relaxed);
   }
-  return null_;
 }
 
-std::ostream& Logger::Error(const std::string& msg) const
+LogMessage::LogMessage(const Logger* logger,
+                       const char* prefix,
+                       const bool flush)
+  : logger_(logger),
+    prefix_(prefix),
+    flush_(flush),
+    stream_(logger ? new std::ostringstream : nullptr) {}
+
+LogMessage::LogMessage(LogMessage&& other)
+  : logger_(other.logger_),
+    prefix_(other.prefix_),
+    flush_(other.flush_),
+    stream_(std::move(other.stream_))
+{
+  other.logger_ = nullptr;
+}
+
+LogMessage::~LogMessage()
 {
-  if (level_ <= Logger::LogLevel::ERROR)
+  if (logger_ == nullptr || stream_ == nullptr)
+  {
+    return;
+  }
+
+  std::string line = prefix_ + stream_->str();
+
+  // Messages end with exactly one newline, whether or not the caller added
+  // std::endl
+  while (!line.empty() && line.back() == '\n')
   {
-    os_ << "ERROR: " << msg << std::endl;
-    return os_;
+    line.pop_back();
   }
-  return null_;
+  line.push_back('\n');
+
+  logger_->Submit(std::move(line), flush_);
 }
 
 } // namespace mercator
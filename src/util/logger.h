@@ -23,12 +23,41 @@
 #ifndef MERCATOR_LOGGER_H
 #define MERCATOR_LOGGER_H
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <thread>
+#include <vector>
+
+#include "spsc_queue.h"
+
+// Log with a level check that happens before any argument is formatted or
+// even evaluated, e.g.
+//
+//   MERCATOR_DEBUG(logger) << "Adding point " << point3d_id;
+//
+#define MERCATOR_LOG_IF_ENABLED(logger, level, method) \
+  !(logger).IsEnabled(::mercator::Logger::LogLevel::level) \
+    ? (void) 0 : ::mercator::LogVoidify() & (logger).method()
+
+#define MERCATOR_DEBUG(logger) MERCATOR_LOG_IF_ENABLED(logger, DEBUG, Debug)
+#define MERCATOR_INFO(logger) MERCATOR_LOG_IF_ENABLED(logger, INFO, Info)
+#define MERCATOR_WARN(logger) MERCATOR_LOG_IF_ENABLED(logger, WARN, Warn)
+#define MERCATOR_ERROR(logger) MERCATOR_LOG_IF_ENABLED(logger, ERROR, Error)
 
 namespace mercator {
 
+class LogMessage;
+
+// Asynchronous, thread-safe logger. Each thread formats its messages into its
+// own lock-free queue, which a background thread drains into the output
+// stream. The stream is flushed whenever the queues run empty rather than
+// after every line, and immediately after errors.
 class Logger {
  public:
   enum class LogLevel
@@ -42,42 +71,126 @@ class Logger {
   Logger(const LogLevel level);
   Logger(std::ostream& os = std::cout, const LogLevel level = LogLevel::WARN);
 
+  // Writes every pending message
+  ~Logger();
+
+  Logger(const Logger&) = delete;
+  Logger& operator=(const Logger&) = delete;
+
   void SetLogLevel(const LogLevel level);
 
-  std::ostream& Log() const;
-  std::ostream& Log(const std::string& msg) const;
+  bool IsEnabled(const LogLevel level) const
+  {
+    return level >= level_.load(std::memory_order_relaxed);
+  }
 
-  std::ostream& Debug() const;
-  std::ostream& Debug(const std::string& msg) const;
+  // The stream-style overloads return a message that is submitted at the end
+  // of the statement. Disabled messages skip formatting, but their arguments
+  // are still evaluated; use the MERCATOR_* macros on hot paths.
+  LogMessage Log() const;
+  void Log(const std::string& msg) const;
 
-  std::ostream& Info() const;
-  std::ostream& Info(const std::string& msg) const;
+  LogMessage Debug() const;
+  void Debug(const std::string& msg) const;
 
-  std::ostream& Warn() const;
-  std::ostream& Warn(const std::string& msg) const;
+  LogMessage Info() const;
+  void Info(const std::string& msg) const;
 
-  std::ostream& Error() const;
-  std::ostream& Error(const std::string& msg) const;
+  LogMessage Warn() const;
+  void Warn(const std::string& msg) const;
+
+  LogMessage Error() const;
+  void Error(const std::string& msg) const;
+
+  // Block until every message submitted so far has been written and the
+  // stream has been flushed
+  void Flush() const;
 
  private:
-  class NullBuffer : public std::streambuf {
-   public:
-    inline int overflow(int c);
-  };
+  friend class LogMessage;
 
-  class NullStream : public std::ostream {
-   public:
-    NullStream() : std::ostream(&m_sb) {}
-   private:
-    NullBuffer m_sb;
-  };
+  typedef SpscQueue<std::string> Queue;
+
+  // Queue one line from the calling thread
+  void Submit(std::string&& line, const bool flush) const;
+
+  Queue* LocalQueue() const;
+
+  // Write every queued line. Returns false if there was nothing to write.
+  bool Drain() const;
+
+  // Whether any queue holds a line
+  bool Pending() const;
 
-  LogLevel level_;
-  mutable NullStream null_;
+  void WriterLoop();
+
+  std::atomic<LogLevel> level_;
   std::ostream& os_;
+
+  // Distinguishes loggers in the per-thread queue cache
+  const uint64_t id_;
+
+  // One queue per thread that has logged, owned by the logger
+  mutable std::mutex queues_mutex_;
+  mutable std::vector<std::unique_ptr<Queue>> queues_;
+  mutable std::vector<std::thread::id> queue_threads_;
+
+  // Only one thread at a time consumes the queues and writes to the stream
+  mutable std::mutex drain_mutex_;
+
+  // The writer sleeps once the queues are empty. Submit wakes it if
+  // writer_waiting_ is set.
+  mutable std::mutex wake_mutex_;
+  mutable std::condition_variable wake_;
+  mutable std::atomic<bool> writer_waiting_;
+  bool stop_;
+
+  std::thread writer_;
+};
+
+// A single message, formatted in a buffer of its own and submitted to the
+// logger when destroyed
+class LogMessage {
+ public:
+  // A null logger creates a disabled message
+  LogMessage(const Logger* logger, const char* prefix, const bool flush);
+  LogMessage(LogMessage&& other);
+  ~LogMessage();
+
+  LogMessage(const LogMessage&) = delete;
+  LogMessage& operator=(const LogMessage&) = delete;
+
+  template<typename T>
+  LogMessage& operator<<(const T& value)
+  {
+    if (stream_)
+    {
+      *stream_ << value;
+    }
+    return *this;
+  }
+
+  // Manipulators such as std::endl; a trailing newline is implied anyway
+  LogMessage& operator<<(std::ostream& (*manipulator)(std::ostream&))
+  {
+    if (stream_)
+    {
+      manipulator(*stream_);
+    }
+    return *this;
+  }
+
+ private:
+  const Logger* logger_;
+  const char* prefix_;
+  bool flush_;
+  std::unique_ptr<std::ostringstream> stream_;
 };
 
-int Logger::NullBuffer::overflow(int c) { return c; }
+// Turns a message expression into void for the MERCATOR_* macros
+struct LogVoidify {
+  void operator&(const LogMessage&) const {}
+};
 
 } // namespace mercator
 
@@ -0,0 +1,240 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include "memory.h"
+
+namespace mercator {
+
+#ifdef MERCATOR_MEMORY_HOOKS
+namespace {
+
+std::atomic<uint64_t> num_allocations(0);
+std::atomic<uint64_t> num_frees(0);
+std::atomic<uint64_t> allocated_bytes(0);
+std::atomic<uint64_t> live_bytes(0);
+std::atomic<uint64_t> peak_live_bytes(0);
+
+// Every block starts with its size, padded to keep the alignment that
+// malloc guarantees
+const size_t kHeaderSize = alignof(std::max_align_t);
+
+void* CountedAllocate(const size_t size)
+{
+  void* block = std::malloc(size + kHeaderSize);
+  if (block == nullptr)
+  {
+    return nullptr;
+  }
+  *static_cast<size_t*>(block) = size;
+
+  num_allocations.fetch_add(1, std::memory_order_relaxed);
+  allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+  const uint64_t live =
+    live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+  uint64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+  while (live > peak &&
+         !peak_live_bytes.compare_exchange_weak(peak, live,
+                                                std::memory_order_relaxed))
+  {
+  }
+
+  return static_cast<char*>(block) + kHeaderSize;
+}
+
+void CountedFree(void* ptr)
+{
+  if (ptr == nullptr)
+  {
+    return;
+  }
+
+  void* block = static_cast<char*>(ptr) - kHeaderSize;
+  const size_t size = *static_cast<size_t*>(block);
+  num_frees.fetch_add(1, std::memory_order_relaxed);
+  live_bytes.fetch_sub(size, std::memory_order_relaxed);
+  std::free(block);
+}
+
+} // namespace
+#endif
+
+size_t CurrentRss()
+{
+  // The second field is the number of resident pages
+  std::ifstream statm("/proc/self/statm");
+  size_t num_pages = 0;
+  size_t num_resident = 0;
+  if (!(statm >> num_pages >> num_resident))
+  {
+    return 0;
+  }
+  return num_resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+size_t PeakRss()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+  {
+    return 0;
+  }
+
+  // Reported in kilobytes on Linux and in bytes on macOS
+#ifdef __APPLE__
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+}
+
+bool AllocationHooksEnabled()
+{
+#ifdef MERCATOR_MEMORY_HOOKS
+  return true;
+#else
+  return false;
+#endif
+}
+
+AllocationStats GetAllocationStats()
+{
+  AllocationStats stats;
+#ifdef MERCATOR_MEMORY_HOOKS
+  stats.num_allocations = num_allocations.load(std::memory_order_relaxed);
+  stats.num_frees = num_frees.load(std::memory_order_relaxed);
+  stats.allocated_bytes = allocated_bytes.load(std::memory_order_relaxed);
+  stats.live_bytes = live_bytes.load(std::memory_order_relaxed);
+  stats.peak_live_bytes = peak_live_bytes.load(std::memory_order_relaxed);
+#endif
+  return stats;
+}
+
+void AddMemoryToReport(RunReport* report)
+{
+  report->SetValue("memory/peak_rss_bytes", PeakRss());
+  report->SetValue("memory/rss_bytes", CurrentRss());
+
+  if (AllocationHooksEnabled())
+  {
+    const AllocationStats stats = GetAllocationStats();
+    report->SetValue("memory/allocations", stats.num_allocations);
+    report->SetValue("memory/allocated_bytes", stats.allocated_bytes);
+    report->SetValue("memory/live_bytes", stats.live_bytes);
+    report->SetValue("memory/peak_live_bytes", stats.peak_live_bytes);
+  }
+}
+
+ScopedMemoryProbe::ScopedMemoryProbe(RunReport* report,
+                                     const std::string& stage)
+  : report_(report->MemoryProbes() ? report : nullptr),
+    stage_(stage)
+{
+  if (report_ != nullptr)
+  {
+    start_ = GetAllocationStats();
+  }
+}
+
+ScopedMemoryProbe::~ScopedMemoryProbe()
+{
+  if (report_ == nullptr)
+  {
+    return;
+  }
+
+  const std::string prefix = "memory/" + stage_ + "/";
+  report_->AddSample(prefix + "rss_bytes", CurrentRss());
+
+  if (AllocationHooksEnabled())
+  {
+    const AllocationStats end = GetAllocationStats();
+    report_->AddSample(prefix + "allocations",
+                       end.num_allocations - start_.num_allocations);
+    report_->AddSample(prefix + "allocated_bytes",
+                       end.allocated_bytes - start_.allocated_bytes);
+  }
+}
+
+} // namespace mercator
+
+#ifdef MERCATOR_MEMORY_HOOKS
+// Replacements of the global allocation functions, which route every heap
+// allocation of the program through the counters above
+
+void* operator new(std::size_t size)
+{
+  void* ptr = mercator::CountedAllocate(size);
+  if (ptr == nullptr)
+  {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new[](std::size_t size)
+{
+  return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+  return mercator::CountedAllocate(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+  return mercator::CountedAllocate(size);
+}
+
+void operator delete(void* ptr) noexcept { mercator::CountedFree(ptr); }
+
+void operator delete[](void* ptr) noexcept { mercator::CountedFree(ptr); }
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+  mercator::CountedFree(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+  mercator::CountedFree(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+  mercator::CountedFree(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+  mercator::CountedFree(ptr);
+}
+#endif
@@ -0,0 +1,106 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_UTIL_MEMORY_H_
+#define MERCATOR_UTIL_MEMORY_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "report.h"
+
+namespace mercator {
+
+// Resident set size of the process and its peak so far, in bytes. Zero if
+// the platform does not provide them.
+size_t CurrentRss();
+size_t PeakRss();
+
+// Heap activity counted by the global operator new and operator delete. The
+// counters are only maintained when built with MERCATOR_MEMORY_HOOKS.
+struct AllocationStats {
+  uint64_t num_allocations = 0;
+  uint64_t num_frees = 0;
+  uint64_t allocated_bytes = 0;
+  uint64_t live_bytes = 0;
+  uint64_t peak_live_bytes = 0;
+};
+
+bool AllocationHooksEnabled();
+
+AllocationStats GetAllocationStats();
+
+// Record the memory figures of a run: the peak resident set size and, with
+// the allocation hooks, the total and peak heap usage
+void AddMemoryToReport(RunReport* report);
+
+// Records the memory used by a stage when it goes out of scope: the resident
+// set size at the end of the stage and, with the allocation hooks, the number
+// and bytes of the allocations made during it. The allocation counters are
+// process-wide, so concurrent stages are attributed each other's allocations.
+// Does nothing unless the memory probes of the report are enabled.
+class ScopedMemoryProbe {
+ public:
+  ScopedMemoryProbe(RunReport* report, const std::string& stage);
+  ~ScopedMemoryProbe();
+
+ private:
+  // Null if the probes are disabled
+  RunReport* report_;
+  const std::string stage_;
+  AllocationStats start_;
+};
+
+// Estimated heap bytes of standard containers, including their capacity and
+// node overhead but not the heap memory owned by the elements themselves
+
+template<typename T>
+size_t VectorBytes(const std::vector<T>& v)
+{
+  return v.capacity() * sizeof(T);
+}
+
+template<typename Key, typename T>
+size_t MapBytes(const std::map<Key, T>& m)
+{
+  // Red-black tree nodes hold three pointers and a color
+  return m.size() *
+    (sizeof(typename std::map<Key, T>::value_type) + 4 * sizeof(void*));
+}
+
+template<typename Key, typename T, typename Hash>
+size_t UnorderedMapBytes(const std::unordered_map<Key, T, Hash>& m)
+{
+  // Nodes hold the next pointer and the cached hash, and every bucket is a
+  // pointer
+  return m.size() *
+    (sizeof(typename std::unordered_map<Key, T, Hash>::value_type)
+     + 2 * sizeof(void*))
+    + m.bucket_count() * sizeof(void*);
+}
+
+} // namespace mercator
+
+#endif // MERCATOR_UTIL_MEMORY_H_
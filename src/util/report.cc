@@ -0,0 +1,236 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <utility>
+
+#include "json.h"
+#include "report.h"
+
+namespace mercator {
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// Nearest-rank percentile of sorted values
+double Percentile(const std::vector<double>& sorted, const double p)
+{
+  const size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+  return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+void WriteDistribution(std::ostream& os,
+                       const RunReport::Distribution& d)
+{
+  const std::pair<const char*, double> fields[] = {
+    { "total", d.total }, { "mean", d.mean }, { "min", d.min },
+    { "max", d.max }, { "p50", d.p50 }, { "p95", d.p95 }, { "p99", d.p99 } };
+
+  os << "{\"count\": " << d.count;
+  for (const auto& field : fields)
+  {
+    os << ", \"" << field.first << "\": ";
+    WriteJsonNumber(os, field.second);
+  }
+  os << "}";
+}
+
+} // namespace
+
+RunReport::RunReport() : start_(Clock::now()), memory_probes_(false) {}
+
+void RunReport::AddTiming(const std::string& stage, const double seconds)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  timings_[stage].push_back(seconds);
+}
+
+void RunReport::AddSample(const std::string& name, const double value)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  samples_[name].push_back(value);
+}
+
+void RunReport::AddCount(const std::string& counter, const int64_t count)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  counters_[counter] += count;
+}
+
+void RunReport::SetValue(const std::string& name, const double value)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  values_[name] = value;
+}
+
+RunReport::Distribution RunReport::Timing(const std::string& stage) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = timings_.find(stage);
+  return it == timings_.end() ? Distribution() : Summarize(it->second);
+}
+
+RunReport::Distribution RunReport::Sample(const std::string& name) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = samples_.find(name);
+  return it == samples_.end() ? Distribution() : Summarize(it->second);
+}
+
+int64_t RunReport::Count(const std::string& counter) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = counters_.find(counter);
+  return it == counters_.end() ? 0 : it->second;
+}
+
+double RunReport::Value(const std::string& name) const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const auto it = values_.find(name);
+  return it == values_.end() ? 0.0 : it->second;
+}
+
+void RunReport::Clear()
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  start_ = Clock::now();
+  timings_.clear();
+  samples_.clear();
+  counters_.clear();
+  values_.clear();
+}
+
+void RunReport::SetMemoryProbes(const bool enabled)
+{
+  memory_probes_ = enabled;
+}
+
+bool RunReport::MemoryProbes() const { return memory_probes_; }
+
+const std::string RunReport::ToJson() const
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  std::ostringstream ss;
+  ss << std::setprecision(9);
+
+  ss << "{\n  \"wall_seconds\": "
+     << std::chrono::duration<double>(Clock::now() - start_).count();
+
+  const std::pair<const char*,
+                  const std::map<std::string, std::vector<double>>*>
+    series[] = { { "timings", &timings_ }, { "samples", &samples_ } };
+  for (const auto& section : series)
+  {
+    ss << ",\n  \"" << section.first << "\": {";
+    bool first = true;
+    for (const auto& entry : *section.second)
+    {
+      ss << (first ? "\n    " : ",\n    ");
+      WriteJsonString(ss, entry.first);
+      ss << ": ";
+      WriteDistribution(ss, Summarize(entry.second));
+      first = false;
+    }
+    ss << (first ? "}" : "\n  }");
+  }
+
+  ss << ",\n  \"counters\": {";
+  bool first = true;
+  for (const auto& entry : counters_)
+  {
+    ss << (first ? "\n    " : ",\n    ");
+    WriteJsonString(ss, entry.first);
+    ss << ": " << entry.second;
+    first = false;
+  }
+  ss << (first ? "}" : "\n  }");
+
+  ss << ",\n  \"values\": {";
+  first = true;
+  for (const auto& entry : values_)
+  {
+    ss << (first ? "\n    " : ",\n    ");
+    WriteJsonString(ss, entry.first);
+    ss << ": ";
+    WriteJsonNumber(ss, entry.second);
+    first = false;
+  }
+  ss << (first ? "}" : "\n  }") << "\n}\n";
+
+  return ss.str();
+}
+
+bool RunReport::Write(const std::string& path) const
+{
+  std::ofstream file(path);
+  if (!file.is_open())
+  {
+    return false;
+  }
+
+  file << ToJson();
+  return file.good();
+}
+
+RunReport::Distribution RunReport::Summarize(std::vector<double> values)
+{
+  Distribution d;
+  if (values.empty())
+  {
+    return d;
+  }
+
+  std::sort(values.begin(), values.end());
+
+  d.count = values.size();
+  for (const auto value : values)
+  {
+    d.total += value;
+  }
+  d.mean = d.total / d.count;
+  d.min = values.front();
+  d.max = values.back();
+  d.p50 = Percentile(values, 0.50);
+  d.p95 = Percentile(values, 0.95);
+  d.p99 = Percentile(values, 0.99);
+
+  return d;
+}
+
+ScopedTimer::ScopedTimer(RunReport* report, const std::string& stage)
+  : report_(report), stage_(stage), start_(Clock::now()) {}
+
+ScopedTimer::~ScopedTimer() { report_->AddTiming(stage_, Elapsed()); }
+
+double ScopedTimer::Elapsed() const
+{
+  return std::chrono::duration<double>(Clock::now() - start_).count();
+}
+
+} // namespace mercator
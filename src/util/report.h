@@ -0,0 +1,116 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_UTIL_REPORT_H_
+#define MERCATOR_UTIL_REPORT_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mercator {
+
+// Collects the timings, sampled values and counters of a run and writes them
+// as a JSON document. Safe to use from several threads.
+class RunReport {
+ public:
+  // Summary statistics of a series of values
+  struct Distribution {
+    size_t count = 0;
+    double total = 0.0;
+    double mean = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    double p50 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+  };
+
+  RunReport();
+
+  // Record the duration (in seconds) of one execution of a stage
+  void AddTiming(const std::string& stage, const double seconds);
+
+  // Record one value of a quantity that varies per item, e.g. the number of
+  // points of each bundle adjustment
+  void AddSample(const std::string& name, const double value);
+
+  void AddCount(const std::string& counter, const int64_t count = 1);
+
+  // Record a single figure of the run, replacing any previous value
+  void SetValue(const std::string& name, const double value);
+
+  Distribution Timing(const std::string& stage) const;
+  Distribution Sample(const std::string& name) const;
+  int64_t Count(const std::string& counter) const;
+  double Value(const std::string& name) const;
+
+  void Clear();
+
+  // Whether ScopedMemoryProbe and other costly memory figures are recorded.
+  // Off by default; set before the run.
+  void SetMemoryProbes(const bool enabled);
+  bool MemoryProbes() const;
+
+  const std::string ToJson() const;
+
+  static Distribution Summarize(std::vector<double> values);
+
+  // Write the JSON document to a file. Returns false if the file could not be
+  // written.
+  bool Write(const std::string& path) const;
+
+ private:
+  mutable std::mutex mutex_;
+
+  std::chrono::steady_clock::time_point start_;
+
+  std::map<std::string, std::vector<double>> timings_;
+  std::map<std::string, std::vector<double>> samples_;
+  std::map<std::string, int64_t> counters_;
+  std::map<std::string, double> values_;
+
+  bool memory_probes_;
+};
+
+// Adds the time between its construction and destruction to a stage of a
+// report
+class ScopedTimer {
+ public:
+  ScopedTimer(RunReport* report, const std::string& stage);
+  ~ScopedTimer();
+
+  // Seconds since construction
+  double Elapsed() const;
+
+ private:
+  RunReport* report_;
+  const std::string stage_;
+  const std::chrono::steady_clock::time_point start_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_UTIL_REPORT_H_
@@ -0,0 +1,223 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_UTIL_SPSC_QUEUE_H_
+#define MERCATOR_UTIL_SPSC_QUEUE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace mercator {
+
+// Bounded lock-free queue for exactly one producer thread and one consumer
+// thread. The producer closes the queue once it is done; the consumer then
+// drains the remaining items. The blocking variants sleep on a condition
+// variable while waiting, which is only locked when the other side sleeps.
+template<typename T>
+class SpscQueue {
+ public:
+  explicit SpscQueue(const size_t capacity)
+    : slots_(capacity + 1),
+      head_(0),
+      tail_(0),
+      closed_(false),
+      producer_waiting_(false),
+      consumer_waiting_(false),
+      max_size_(0),
+      size_sum_(0),
+      num_pushes_(0) {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // The indices are on cache lines of their own, an alignment that the
+  // default operator new only honours from C++17 on
+  static void* operator new(const size_t size)
+  {
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, alignof(SpscQueue), size) != 0)
+    {
+      throw std::bad_alloc();
+    }
+    return ptr;
+  }
+
+  static void operator delete(void* ptr) { free(ptr); }
+
+  // Producer side. Returns false if the queue is full.
+  bool TryPush(T&& item)
+  {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    const size_t next = Next(tail);
+    const size_t head = head_.load(std::memory_order_acquire);
+    if (next == head)
+    {
+      return false;
+    }
+
+    slots_[tail] = std::move(item);
+    tail_.store(next, std::memory_order_release);
+    Wake(consumer_waiting_, &not_empty_);
+
+    const size_t size = (next + slots_.size() - head) % slots_.size();
+    max_size_ = std::max(max_size_, size);
+    size_sum_ += size;
+    ++num_pushes_;
+    return true;
+  }
+
+  // Producer side. Waits until there is room in the queue.
+  void Push(T item)
+  {
+    while (!TryPush(std::move(item)))
+    {
+      Wait(&producer_waiting_, &not_full_, [this]
+           {
+             return Next(tail_.load(std::memory_order_relaxed)) !=
+               head_.load(std::memory_order_acquire);
+           });
+    }
+  }
+
+  // Producer side. No items may be pushed afterwards.
+  void Close()
+  {
+    closed_.store(true, std::memory_order_release);
+    Wake(consumer_waiting_, &not_empty_);
+  }
+
+  // Consumer side. Returns false if the queue is empty.
+  bool TryPop(T* item)
+  {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_.load(std::memory_order_acquire))
+    {
+      return false;
+    }
+
+    *item = std::move(slots_[head]);
+    head_.store(Next(head), std::memory_order_release);
+    Wake(producer_waiting_, &not_full_);
+    return true;
+  }
+
+  // Consumer side. Waits for an item and returns false once the queue is
+  // closed and empty.
+  bool Pop(T* item)
+  {
+    while (!TryPop(item))
+    {
+      if (closed_.load(std::memory_order_acquire))
+      {
+        // Items may have been pushed just before the queue was closed
+        return TryPop(item);
+      }
+      Wait(&consumer_waiting_, &not_empty_, [this]
+           {
+             return head_.load(std::memory_order_relaxed) !=
+               tail_.load(std::memory_order_acquire) ||
+               closed_.load(std::memory_order_acquire);
+           });
+    }
+    return true;
+  }
+
+  // Consumer side
+  bool Empty() const
+  {
+    return head_.load(std::memory_order_relaxed) ==
+      tail_.load(std::memory_order_acquire);
+  }
+
+  size_t Capacity() const { return slots_.size() - 1; }
+
+  // Statistics of the number of queued items, sampled by the producer on
+  // every push. Only valid once the producer is done.
+  size_t MaxSize() const { return max_size_; }
+  double MeanSize() const
+  {
+    return num_pushes_ > 0 ? static_cast<double>(size_sum_) / num_pushes_ : 0;
+  }
+
+ private:
+  size_t Next(const size_t idx) const { return (idx + 1) % slots_.size(); }
+
+  // Sleep until ready() holds. The flag is raised before ready() is checked
+  // and the other side updates the indices before checking the flag, so
+  // with the fences between them one of the two sees the other.
+  template<typename Ready>
+  void Wait(std::atomic<bool>* waiting,
+            std::condition_variable* condition,
+            Ready ready)
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    waiting->store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    condition->wait(lock, ready);
+    waiting->store(false, std::memory_order_relaxed);
+  }
+
+  // Wake the other side if it sleeps. Taking the lock ensures that it is
+  // either waiting or will check ready() after the update.
+  void Wake(const std::atomic<bool>& waiting,
+            std::condition_variable* condition)
+  {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed))
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      condition->notify_one();
+    }
+  }
+
+  std::vector<T> slots_;
+
+  // Index of the next item to pop, written by the consumer
+  alignas(64) std::atomic<size_t> head_;
+
+  // Index of the next free slot, written by the producer
+  alignas(64) std::atomic<size_t> tail_;
+
+  std::atomic<bool> closed_;
+
+  // Only used while one side sleeps
+  std::mutex mutex_;
+  std::condition_variable not_full_;
+  std::condition_variable not_empty_;
+  std::atomic<bool> producer_waiting_;
+  std::atomic<bool> consumer_waiting_;
+
+  // Owned by the producer
+  alignas(64) size_t max_size_;
+  size_t size_sum_;
+  size_t num_pushes_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_UTIL_SPSC_QUEUE_H_
@@ -0,0 +1,151 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <utility>
+
+#include "util/thread_pool.h"
+
+namespace mercator {
+
+ThreadPool::ThreadPool(const size_t num_threads)
+  : num_busy_(0), num_lent_(0), stop_(false)
+{
+  const size_t n = num_threads > 0
+    ? num_threads : std::max(1u, std::thread::hardware_concurrency());
+
+  threads_.reserve(n);
+  for (size_t i = 0; i < n; ++i)
+  {
+    threads_.emplace_back(&ThreadPool::WorkerLoop, this);
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  Wait();
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    stop_ = true;
+  }
+  work_.notify_all();
+
+  for (auto& thread : threads_)
+  {
+    thread.join();
+  }
+}
+
+size_t ThreadPool::NumThreads() const
+{
+  return threads_.size();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    tasks_.push_back(std::move(task));
+  }
+  work_.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  done_.wait(lock, [this] { return tasks_.empty() && num_busy_ == 0; });
+}
+
+size_t ThreadPool::Borrow(const size_t max_threads)
+{
+  std::lock_guard<std::mutex> lock(mutex_);
+  const size_t num_idle = threads_.size() - num_busy_ - num_lent_;
+  const size_t num_threads = std::min(max_threads, num_idle);
+  num_lent_ += num_threads;
+  return num_threads;
+}
+
+void ThreadPool::Return(const size_t num_threads)
+{
+  if (num_threads == 0)
+  {
+    return;
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_lent_ -= num_threads;
+  }
+  work_.notify_all();
+}
+
+void ThreadPool::WorkerLoop()
+{
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true)
+  {
+    // A task only starts if no thread it would run on is lent out
+    work_.wait(lock, [this]
+        {
+          return stop_ || (!tasks_.empty() &&
+                           num_busy_ + num_lent_ < threads_.size());
+        });
+    if (stop_)
+    {
+      return;
+    }
+
+    std::function<void()> task = std::move(tasks_.front());
+    tasks_.pop_front();
+    ++num_busy_;
+
+    lock.unlock();
+    task();
+    lock.lock();
+
+    --num_busy_;
+    if (tasks_.empty() && num_busy_ == 0)
+    {
+      done_.notify_all();
+    }
+  }
+}
+
+ThreadLease::ThreadLease(ThreadPool* pool, const size_t max_threads)
+  : pool_(pool),
+    num_borrowed_(pool != nullptr ? pool->Borrow(max_threads) : 0) {}
+
+ThreadLease::~ThreadLease()
+{
+  if (pool_ != nullptr)
+  {
+    pool_->Return(num_borrowed_);
+  }
+}
+
+int ThreadLease::NumThreads() const
+{
+  return static_cast<int>(num_borrowed_) + 1;
+}
+
+} // namespace mercator
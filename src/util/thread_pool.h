@@ -0,0 +1,99 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_UTIL_THREAD_POOL_H_
+#define MERCATOR_UTIL_THREAD_POOL_H_
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace mercator {
+
+// Fixed set of threads running queued tasks in order. A running task may
+// borrow the threads that have no task, e.g. to give their cores to the
+// threads of a solver, and the pool starts no task on them until they are
+// returned. Tasks and what they borrow thus never use more threads than the
+// pool has.
+class ThreadPool {
+ public:
+  // If num_threads is 0, one thread per hardware thread
+  explicit ThreadPool(const size_t num_threads = 0);
+
+  // Waits for every submitted task
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  size_t NumThreads() const;
+
+  void Submit(std::function<void()> task);
+
+  // Block until every submitted task has finished
+  void Wait();
+
+  // Borrow up to max_threads of the threads that have no task. Returns the
+  // number of threads borrowed, which may be 0.
+  size_t Borrow(const size_t max_threads);
+
+  void Return(const size_t num_threads);
+
+ private:
+  void WorkerLoop();
+
+  std::mutex mutex_;
+  std::condition_variable work_;
+  std::condition_variable done_;
+
+  std::deque<std::function<void()>> tasks_;
+  size_t num_busy_;
+  size_t num_lent_;
+  bool stop_;
+
+  std::vector<std::thread> threads_;
+};
+
+// Threads borrowed from a pool for the lifetime of the lease. Without a pool
+// the lease holds only the calling thread.
+class ThreadLease {
+ public:
+  ThreadLease(ThreadPool* pool, const size_t max_threads);
+  ~ThreadLease();
+
+  ThreadLease(const ThreadLease&) = delete;
+  ThreadLease& operator=(const ThreadLease&) = delete;
+
+  // The calling thread and the borrowed threads
+  int NumThreads() const;
+
+ private:
+  ThreadPool* pool_;
+  size_t num_borrowed_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_UTIL_THREAD_POOL_H_
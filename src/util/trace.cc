@@ -0,0 +1,149 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+#include "json.h"
+#include "trace.h"
+
+namespace mercator {
+
+namespace {
+
+uint64_t SteadyNanoseconds()
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+std::atomic<bool> Tracer::enabled_(false);
+
+Tracer::Tracer() : epoch_ns_(SteadyNanoseconds()), events_per_thread_(0) {}
+
+Tracer& Tracer::Instance()
+{
+  static Tracer tracer;
+  return tracer;
+}
+
+void Tracer::Enable(const size_t events_per_thread)
+{
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    events_per_thread_ = std::max<size_t>(events_per_thread, 1);
+  }
+  enabled_.store(true);
+}
+
+void Tracer::Disable() { enabled_.store(false); }
+
+uint64_t Tracer::Now() const { return SteadyNanoseconds() - epoch_ns_; }
+
+void Tracer::Complete(const char* name,
+                      const uint64_t start_ns,
+                      const uint64_t end_ns)
+{
+  ThreadBuffer* buffer = LocalBuffer();
+
+  // Overwrite the oldest event once the buffer is full
+  Event& event = buffer->events[buffer->num_recorded % buffer->events.size()];
+  event.name = name;
+  event.start_ns = start_ns;
+  event.end_ns = end_ns;
+  ++buffer->num_recorded;
+}
+
+void Tracer::SetThreadName(const std::string& name)
+{
+  LocalBuffer()->name = name;
+}
+
+Tracer::ThreadBuffer* Tracer::LocalBuffer()
+{
+  thread_local ThreadBuffer* buffer = nullptr;
+  if (buffer == nullptr)
+  {
+    // The tracer owns the buffer so that events survive the thread
+    std::lock_guard<std::mutex> lock(mutex_);
+    buffers_.emplace_back(new ThreadBuffer);
+    buffer = buffers_.back().get();
+    buffer->tid = static_cast<uint32_t>(buffers_.size());
+    buffer->events.resize(std::max<size_t>(events_per_thread_, 1));
+  }
+  return buffer;
+}
+
+bool Tracer::Write(const std::string& path) const
+{
+  std::ofstream file(path);
+  if (!file.is_open())
+  {
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+
+  file << std::fixed << std::setprecision(3);
+  file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+
+  bool first = true;
+  for (const auto& buffer : buffers_)
+  {
+    if (!buffer->name.empty())
+    {
+      file << (first ? "\n" : ",\n")
+           << "{\"ph\": \"M\", \"pid\": 1, \"tid\": " << buffer->tid
+           << ", \"name\": \"thread_name\", \"args\": {\"name\": ";
+      WriteJsonString(file, buffer->name);
+      file << "}}";
+      first = false;
+    }
+
+    // Oldest first
+    const size_t capacity = buffer->events.size();
+    const uint64_t num_kept = std::min<uint64_t>(buffer->num_recorded,
+                                                 capacity);
+    for (uint64_t i = buffer->num_recorded - num_kept;
+         i < buffer->num_recorded; ++i)
+    {
+      const Event& event = buffer->events[i % capacity];
+      file << (first ? "\n" : ",\n")
+           << "{\"ph\": \"X\", \"pid\": 1, \"tid\": " << buffer->tid
+           << ", \"name\": ";
+      WriteJsonString(file, event.name);
+      file << ", \"ts\": " << event.start_ns / 1000.0
+           << ", \"dur\": " << (event.end_ns - event.start_ns) / 1000.0
+           << "}";
+      first = false;
+    }
+  }
+
+  file << "\n]}\n";
+  return file.good();
+}
+
+} // namespace mercator
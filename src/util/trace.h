@@ -0,0 +1,127 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_UTIL_TRACE_H_
+#define MERCATOR_UTIL_TRACE_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace mercator {
+
+// Records timed events into a ring buffer per thread and writes them in the
+// Chrome trace event format, which can be opened in Perfetto or
+// chrome://tracing. While tracing is disabled, recording an event costs a
+// single relaxed atomic load.
+//
+// Event names must outlive the tracer; string literals are expected.
+class Tracer {
+ public:
+  static Tracer& Instance();
+
+  // Start recording, keeping at most events_per_thread of the latest events
+  // of each thread
+  void Enable(const size_t events_per_thread = 1 << 16);
+
+  void Disable();
+
+  static bool IsEnabled()
+  {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Nanoseconds since the tracer was created
+  uint64_t Now() const;
+
+  // Record an event that started at start_ns and ended at end_ns on the
+  // calling thread
+  void Complete(const char* name, const uint64_t start_ns,
+                const uint64_t end_ns);
+
+  // Name the calling thread in the trace
+  void SetThreadName(const std::string& name);
+
+  // Write the recorded events as JSON. Must not be called while other
+  // threads are recording.
+  bool Write(const std::string& path) const;
+
+ private:
+  struct Event {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t end_ns;
+  };
+
+  // Written only by the thread it belongs to
+  struct ThreadBuffer {
+    uint32_t tid;
+    std::string name;
+    std::vector<Event> events;
+    uint64_t num_recorded = 0;
+  };
+
+  Tracer();
+
+  ThreadBuffer* LocalBuffer();
+
+  static std::atomic<bool> enabled_;
+
+  const uint64_t epoch_ns_;
+
+  size_t events_per_thread_;
+
+  // Guards the list of buffers, not their contents
+  mutable std::mutex mutex_;
+  std::vector<std::unique_ptr<ThreadBuffer>> buffers_;
+};
+
+// Records an event spanning its lifetime if tracing is enabled
+class ScopedTrace {
+ public:
+  explicit ScopedTrace(const char* name)
+    : name_(Tracer::IsEnabled() ? name : nullptr),
+      start_ns_(name_ ? Tracer::Instance().Now() : 0) {}
+
+  ~ScopedTrace()
+  {
+    if (name_)
+    {
+      Tracer& tracer = Tracer::Instance();
+      tracer.Complete(name_, start_ns_, tracer.Now());
+    }
+  }
+
+  ScopedTrace(const ScopedTrace&) = delete;
+  ScopedTrace& operator=(const ScopedTrace&) = delete;
+
+ private:
+  const char* name_;
+  const uint64_t start_ns_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_UTIL_TRACE_H_
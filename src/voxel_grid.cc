@@ -0,0 +1,87 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <algorithm>
+#include <cmath>
+
+#include "voxel_grid.h"
+
+namespace mercator {
+
+VoxelGrid::VoxelGrid(const double voxel_size) : voxel_size_(voxel_size) {}
+
+double VoxelGrid::VoxelSize() const { return voxel_size_; }
+
+VoxelKey VoxelGrid::Key(const Eigen::Vector3d& xyz) const
+{
+  return { static_cast<int64_t>(std::floor(xyz(0) / voxel_size_)),
+           static_cast<int64_t>(std::floor(xyz(1) / voxel_size_)),
+           static_cast<int64_t>(std::floor(xyz(2) / voxel_size_)) };
+}
+
+Eigen::Vector3d VoxelGrid::Center(const VoxelKey& key) const
+{
+  return voxel_size_ * Eigen::Vector3d(key.x + 0.5, key.y + 0.5, key.z + 0.5);
+}
+
+void VoxelGrid::Insert(const uint64_t point3d_id, const Eigen::Vector3d& xyz)
+{
+  voxels_[Key(xyz)].push_back(point3d_id);
+}
+
+bool VoxelGrid::Remove(const uint64_t point3d_id, const Eigen::Vector3d& xyz)
+{
+  const auto voxel = voxels_.find(Key(xyz));
+  if (voxel == voxels_.end())
+  {
+    return false;
+  }
+
+  auto& ids = voxel->second;
+  const auto it = std::find(ids.begin(), ids.end(), point3d_id);
+  if (it == ids.end())
+  {
+    return false;
+  }
+
+  *it = ids.back();
+  ids.pop_back();
+  if (ids.empty())
+  {
+    voxels_.erase(voxel);
+  }
+  return true;
+}
+
+void VoxelGrid::Clear() { voxels_.clear(); }
+
+size_t VoxelGrid::NumVoxels() const { return voxels_.size(); }
+
+const std::vector<uint64_t>* VoxelGrid::Find(const VoxelKey& key) const
+{
+  const auto voxel = voxels_.find(key);
+  return voxel == voxels_.end() ? nullptr : &voxel->second;
+}
+
+const VoxelGrid::VoxelMap& VoxelGrid::Voxels() const { return voxels_; }
+
+} // namespace mercator
@@ -0,0 +1,94 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#ifndef MERCATOR_VOXEL_GRID_H_
+#define MERCATOR_VOXEL_GRID_H_
+
+#include <unordered_map>
+#include <vector>
+
+#include <Eigen/Core>
+
+namespace mercator {
+
+// Integer coordinates of a voxel
+struct VoxelKey {
+  int64_t x;
+  int64_t y;
+  int64_t z;
+
+  bool operator==(const VoxelKey& other) const
+  {
+    return x == other.x && y == other.y && z == other.z;
+  }
+};
+
+struct VoxelKeyHash {
+  size_t operator()(const VoxelKey& key) const
+  {
+    // Large primes, as in the spatial hashing scheme of Teschner et al.
+    return (static_cast<size_t>(key.x) * 73856093)
+      ^ (static_cast<size_t>(key.y) * 19349663)
+      ^ (static_cast<size_t>(key.z) * 83492791);
+  }
+};
+
+// Sparse grid of cubic voxels, each holding the IDs of the 3D points that
+// fall inside it
+class VoxelGrid {
+ public:
+  typedef std::unordered_map<VoxelKey, std::vector<uint64_t>, VoxelKeyHash>
+    VoxelMap;
+
+  explicit VoxelGrid(const double voxel_size);
+
+  double VoxelSize() const;
+
+  VoxelKey Key(const Eigen::Vector3d& xyz) const;
+
+  // Center of a voxel in world coordinates
+  Eigen::Vector3d Center(const VoxelKey& key) const;
+
+  void Insert(const uint64_t point3d_id, const Eigen::Vector3d& xyz);
+
+  // Remove a point that was inserted with the given coordinates. Returns
+  // false if the point was not found.
+  bool Remove(const uint64_t point3d_id, const Eigen::Vector3d& xyz);
+
+  void Clear();
+
+  size_t NumVoxels() const;
+
+  // Points of a voxel, or nullptr if the voxel is empty
+  const std::vector<uint64_t>* Find(const VoxelKey& key) const;
+
+  const VoxelMap& Voxels() const;
+
+ private:
+  double voxel_size_;
+
+  VoxelMap voxels_;
+};
+
+} // namespace mercator
+
+#endif // MERCATOR_VOXEL_GRID_H_
@@ -0,0 +1,175 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "synthetic_scene.h"
+
+using namespace mercator;
+
+namespace po = boost::program_options;
+
+int main(int argc, char* argv[])
+{
+  SyntheticScene::Options options;
+  std::string output;
+  std::string track_distribution;
+
+  po::options_description desc(
+      "Usage: mercator_generate [options] <output>\n"
+      "Write a synthetic COLMAP reconstruction into <output>\nOptions");
+  desc.add_options()("help,h", "Print this message")
+                    ("images",
+                    po::value<uint32_t>(&options.num_images)
+                      ->default_value(options.num_images),
+                    "Number of images")
+                    ("points",
+                    po::value<uint64_t>(&options.num_points)
+                      ->default_value(options.num_points),
+                    "Number of 3D points")
+                    ("track-distribution",
+                    po::value<std::string>(&track_distribution)
+                      ->default_value("geometric"),
+                    "Distribution of the track lengths (uniform, geometric)")
+                    ("min-track-length",
+                    po::value<int>(&options.min_track_length)
+                      ->default_value(options.min_track_length),
+                    "Minimum number of images that see a point")
+                    ("mean-track-length",
+                    po::value<double>(&options.mean_track_length)
+                      ->default_value(options.mean_track_length),
+                    "Mean track length of the geometric distribution")
+                    ("max-track-length",
+                    po::value<int>(&options.max_track_length)
+                      ->default_value(options.max_track_length),
+                    "Maximum number of images that see a point")
+                    ("covariance-scale",
+                    po::value<double>(&options.covariance_scale)
+                      ->default_value(options.covariance_scale),
+                    "Median eigenvalue of the point covariances")
+                    ("covariance-spread",
+                    po::value<double>(&options.covariance_spread)
+                      ->default_value(options.covariance_spread),
+                    "Standard deviation of the log of the eigenvalues")
+                    ("camera-model",
+                    po::value<std::string>(&options.camera_model)
+                      ->default_value(options.camera_model),
+                    "COLMAP camera model")
+                    ("width",
+                    po::value<uint64_t>(&options.width)
+                      ->default_value(options.width),
+                    "Image width in pixels")
+                    ("height",
+                    po::value<uint64_t>(&options.height)
+                      ->default_value(options.height),
+                    "Image height in pixels")
+                    ("focal-length",
+                    po::value<double>(&options.focal_length)
+                      ->default_value(options.focal_length),
+                    "Focal length in pixels")
+                    ("radial-distortion",
+                    po::value<double>(&options.radial_distortion)
+                      ->default_value(options.radial_distortion),
+                    "Radial distortion coefficient")
+                    ("altitude",
+                    po::value<double>(&options.altitude)
+                      ->default_value(options.altitude),
+                    "Height of the cameras above the ground")
+                    ("pixel-noise",
+                    po::value<double>(&options.pixel_noise)
+                      ->default_value(options.pixel_noise),
+                    "Standard deviation of the 2D point noise, in pixels")
+                    ("seed",
+                    po::value<uint64_t>(&options.seed)
+                      ->default_value(options.seed),
+                    "Random seed");
+
+  po::options_description hidden;
+  hidden.add_options()("output", po::value<std::string>(&output));
+  po::positional_options_description positional;
+  positional.add("output", 1);
+
+  po::options_description all;
+  all.add(desc).add(hidden);
+
+  po::variables_map vmap;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv)
+        .options(all)
+        .positional(positional)
+        .run(), vmap);
+    po::notify(vmap);
+  }
+  catch (po::error& e)
+  {
+    std::cerr << e.what() << "\n" << desc << std::endl;
+    return 1;
+  }
+
+  if (vmap.count("help") || output.empty())
+  {
+    std::cerr << desc << std::endl;
+    return 1;
+  }
+
+  if (track_distribution == "uniform")
+  {
+    options.track_length_distribution =
+      SyntheticScene::TrackLengthDistribution::UNIFORM;
+  }
+  else if (track_distribution == "geometric")
+  {
+    options.track_length_distribution =
+      SyntheticScene::TrackLengthDistribution::GEOMETRIC;
+  }
+  else
+  {
+    std::cerr << "Unknown track distribution " << track_distribution
+              << std::endl;
+    return 1;
+  }
+
+  if (mkdir(output.c_str(), 0755) != 0 && errno != EEXIST)
+  {
+    std::cerr << "Could not create directory " << output << std::endl;
+    return 1;
+  }
+
+  SyntheticScene scene(options);
+  if (!scene.Write(output))
+  {
+    std::cerr << "Failed to write the reconstruction" << std::endl;
+    return 1;
+  }
+
+  std::cout << "Wrote " << options.num_images << " images and "
+            << options.num_points << " points to " << output << std::endl;
+
+  return 0;
+}
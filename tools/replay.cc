@@ -0,0 +1,212 @@
+// Copyright (c) 2017 The University of Texas Radionavigation Lab
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to
+// deal in the Software without restriction, including without limitation the
+// rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+// sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+// FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+// IN THE SOFTWARE.
+//
+// Author: Greg Anders
+
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+#include <boost/program_options.hpp>
+
+#include "bundle_adjustment.h"
+#include "problem_corpus.h"
+#include "util/report.h"
+
+using namespace mercator;
+
+namespace po = boost::program_options;
+
+namespace {
+
+void PrintDistribution(const std::string& name,
+                       const RunReport::Distribution& seconds)
+{
+  std::cout << std::setw(12) << name
+            << std::setw(12) << 1e3 * seconds.total
+            << std::setw(12) << 1e3 * seconds.mean
+            << std::setw(12) << 1e3 * seconds.p50
+            << std::setw(12) << 1e3 * seconds.p95
+            << std::setw(12) << 1e3 * seconds.max << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+  google::InitGoogleLogging(argv[0]);
+
+  std::string corpus_path;
+  std::string report_path;
+  int repeat;
+  int max_iterations;
+  bool per_observation = false;
+  bool skip_covariance = false;
+
+  po::options_description desc(
+      "Usage: mercator_replay [options] <corpus>\n"
+      "Rerun the bundle adjustments captured with mercator --capture\n"
+      "Options");
+  desc.add_options()("help,h", "Print this message")
+                    ("repeat",
+                    po::value<int>(&repeat)->default_value(1),
+                    "Number of times each problem is run")
+                    ("max-iterations",
+                    po::value<int>(&max_iterations)->default_value(
+                      BundleAdjustment::Options()
+                        .solver_options.max_num_iterations),
+                    "Maximum number of solver iterations")
+                    ("per-observation",
+                    po::bool_switch(&per_observation),
+                    "Use one residual block per observation instead of one "
+                    "per point")
+                    ("no-covariance",
+                    po::bool_switch(&skip_covariance),
+                    "Do not compute the covariance of the region")
+                    ("report",
+                    po::value<std::string>(&report_path),
+                    "Write the timings as JSON to this file");
+
+  po::options_description hidden;
+  hidden.add_options()("corpus", po::value<std::string>(&corpus_path));
+  po::positional_options_description positional;
+  positional.add("corpus", 1);
+
+  po::options_description all;
+  all.add(desc).add(hidden);
+
+  po::variables_map vmap;
+  try
+  {
+    po::store(po::command_line_parser(argc, argv)
+        .options(all)
+        .positional(positional)
+        .run(), vmap);
+    po::notify(vmap);
+  }
+  catch (po::error& e)
+  {
+    std::cerr << e.what() << "\n" << desc << std::endl;
+    return 1;
+  }
+
+  if (vmap.count("help") || corpus_path.empty())
+  {
+    std::cerr << desc << std::endl;
+    return 1;
+  }
+
+  ProblemCorpusReader corpus;
+  if (!corpus.Open(corpus_path))
+  {
+    return 1;
+  }
+
+  BundleAdjustment::Options options;
+  options.group_observations_by_point = !per_observation;
+  options.solver_options.max_num_iterations = max_iterations;
+
+  RunReport report;
+
+  std::cout << std::setw(8) << "problem"
+            << std::setw(10) << "points"
+            << std::setw(8) << "images"
+            << std::setw(14) << "observations"
+            << std::setw(12) << "build ms"
+            << std::setw(12) << "solve ms"
+            << std::setw(12) << "cov ms"
+            << std::setw(8) << "iters" << std::endl;
+
+  CapturedProblem problem;
+  size_t num_problems = 0;
+  while (corpus.Read(&problem))
+  {
+    const std::vector<uint64_t> region_point3d_ids =
+      problem.RegionPoint3dIds();
+
+    for (int run = 0; run < repeat; ++run)
+    {
+      BundleAdjustment ba(options);
+
+      double build_seconds;
+      {
+        ScopedTimer build(&report, "build");
+        problem.ToBundleAdjustment(&ba);
+        build_seconds = build.Elapsed();
+      }
+
+      double solve_seconds;
+      {
+        ScopedTimer solve(&report, "solve");
+        ba.Run();
+        solve_seconds = solve.Elapsed();
+      }
+
+      double covariance_seconds = 0.0;
+      if (!skip_covariance)
+      {
+        ScopedTimer covariance(&report, "covariance");
+        ba.ComputeCovariance(region_point3d_ids);
+        covariance_seconds = covariance.Elapsed();
+      }
+
+      const ceres::Solver::Summary& summary = ba.Summary();
+      const int iterations =
+        summary.num_successful_steps + summary.num_unsuccessful_steps;
+      report.AddSample("solver_iterations", iterations);
+
+      std::cout << std::setw(8) << num_problems
+                << std::setw(10) << problem.points.size()
+                << std::setw(8) << problem.images.size()
+                << std::setw(14) << problem.observations.size()
+                << std::setw(12) << 1e3 * build_seconds
+                << std::setw(12) << 1e3 * solve_seconds
+                << std::setw(12) << 1e3 * covariance_seconds
+                << std::setw(8) << iterations << std::endl;
+    }
+
+    report.AddSample("points_per_ba", problem.points.size());
+    report.AddSample("images_per_ba", problem.images.size());
+    report.AddSample("observations_per_ba", problem.observations.size());
+    ++num_problems;
+  }
+
+  std::cout << "\nReplayed " << num_problems << " problems\n"
+            << std::setw(12) << "stage"
+            << std::setw(12) << "total ms"
+            << std::setw(12) << "mean ms"
+            << std::setw(12) << "p50 ms"
+            << std::setw(12) << "p95 ms"
+            << std::setw(12) << "max ms" << std::endl;
+  PrintDistribution("build", report.Timing("build"));
+  PrintDistribution("solve", report.Timing("solve"));
+  if (!skip_covariance)
+  {
+    PrintDistribution("covariance", report.Timing("covariance"));
+  }
+
+  if (!report_path.empty() && !report.Write(report_path))
+  {
+    std::cerr << "Failed to write report: " << report_path << std::endl;
+    return 1;
+  }
+
+  return 0;
+}